@@ -0,0 +1,1331 @@
+#pragma once
+
+#include "Editor.h"
+#include "UndoLog.h"
+#include "Search.h"
+#include "Snapshot.h"
+#include "LineCache.h"
+#include "Highlighter.h"
+#include "Utf8.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Editor logic shared by every backend that stores the text as one flat, byte addressable sequence
+// The storage class derives from us, CRTP style, so all the per-byte calls below can inline
+// B must provide:
+//   size_t length( )                                  -- Number of bytes stored
+//   char at( size_t off )                             -- Byte at offset
+//   void insert( size_t off, const char * str, size_t len )
+//   void erase( size_t off, size_t len )
+// B may also shadow lineStart, lineEnd, linesBefore, newlineAt, lineCount, offsetOfLine, extract and forChunks / forChunksBack
+//   with faster versions, and save / restore and snapshot if it can keep text for undo or for other threads without copying it
+// B may load the text in the background too, and then shadows awaitOffset / awaitLine to block until the text a key needs
+//   is in, and loadStatus to say how far it's got -- Text only ever arrives at the end, so nothing before it moves
+// Both backends keep a line index, so everything line based below is O(log n) on them rather than a scan
+//
+// The text is UTF-8 -- The cursor moves a grapheme cluster at a time, and currx / goalx are display columns,
+//   not bytes, which the LineCache turns into offsets and back for the lines being worked on
+//
+// There can be any number of cursors, each with its own selection -- A key that edits or moves goes to all of them at
+//   once, as one walk through the buffer from front to back, one undo group and one redraw
+//
+// Source files are coloured as lines are drawn, from the start state the Highlighter keeps for every line -- What's
+//   on screen is lexed there and then, and the rest of the file a chunk at a time from doPoll, which asks to be
+//   woken again until it's done
+template<typename B>
+class BufferEditor : public Editor {
+protected:
+
+	// Byte offset of the cursor in the buffer, always at the start of a cluster -- currx / curry are kept in sync with this
+	size_t curr = 0;
+
+	// Column we try to get back to when moving up and down across short lines
+	size_t goalx = 0;
+
+	// Cursors besides curr, by offset, never two in one place -- Each selects from its anchor to itself, nothing when
+	//   they're the same, and typing replaces the selection
+	struct Cursor {
+		size_t off;
+		size_t anchor;
+		size_t goalx;
+	};
+	std::vector<Cursor> cursors;
+
+	// The same for curr, only kept while there are other cursors
+	size_t anchor = 0;
+
+	// Visible window -- First line shown, and its size
+	size_t top = 0;
+	size_t cols = 80;
+	size_t rows = 24;
+
+	// While set the bottom row is an echo area for prompts, and the text gets one row less
+	bool echo = false;
+
+	size_t textRows( ) const { return this->rows - ( this->echo && this->rows > 1 ); };
+
+	// While set nothing is drawn, for a run of keys where only how it ends is worth showing -- releaseDrawing( ) then
+	//   draws that once, along with the last thing put in the echo area if it's still up
+	bool held = false;
+	std::string heldEcho;
+
+	// Every edit goes through insertText / eraseText, and is recorded here
+	UndoLog history;
+
+	// Layouts of the lines around the cursor and on screen, kept up to date by the same two
+	LineCache layouts;
+
+	// A line's text while it's laid out -- Kept so a miss doesn't allocate once it's as long as the longest line
+	std::string layoutText;
+
+	// Start states of the lines for colouring, kept in step by the same two as well
+	Highlighter highlight;
+
+	// A line drawn before its start state is known gets the state the line drawn above it left off in, or failing
+	//   that the one it had before the last edit -- Once what's on screen is known it's all drawn again
+	size_t guessLine = (size_t)-1;
+	Highlighter::State guessState = Highlighter::normal;
+	bool guessed = false;
+
+	// How far past the known states drawing a line lexes to get its real one rather than guessing, and how many
+	//   lines each doPoll does while the rest of the file is still to do
+	static constexpr size_t lexAhead = 1024;
+	static constexpr size_t lexChunk = 4096;
+
+	// Scratch for lexing, reused
+	std::string lexText;
+	std::vector<ColourRun> lexRuns;
+
+	// Scratch for colouring in cursors, a colour per byte drawn
+	std::vector<Colour> marks;
+
+	B & buffer( ) { return static_cast<B &>( *this ); };
+
+	// How the line starting at start lays out -- Good until the next edit
+	const LineCache::Layout & layout( size_t start ) {
+
+		if( const LineCache::Layout * hit = this->layouts.find( start ) )
+			return *hit;
+
+		std::string & text = this->layoutText;
+		text.resize( buffer( ).lineEnd( start ) - start );
+		buffer( ).extract( start, text.size( ), text.data( ) );
+		return this->layouts.build( start, text.data( ), text.size( ) );
+
+	};
+
+public:
+
+	// Default line scanning, one byte at a time
+	// Offset of the first byte of the line containing off
+	size_t lineStart( size_t off ) {
+		while( off > 0 && buffer( ).at( off - 1 ) != '\n' )
+			--off;
+		return off;
+	};
+
+	// Offset of the newline ending the line containing off, or length if it is the last line
+	size_t lineEnd( size_t off ) {
+		size_t len = buffer( ).length( );
+		while( off < len && buffer( ).at( off ) != '\n' )
+			++off;
+		return off;
+	};
+
+	// Number of newlines before off
+	size_t linesBefore( size_t off ) {
+		size_t count = 0;
+		for( size_t idx = 0; idx < off; ++idx )
+			count += buffer( ).at( idx ) == '\n';
+		return count;
+	};
+
+	// Offset of the k-th newline, counting from 1 -- length if there aren't that many
+	size_t newlineAt( size_t k ) {
+		size_t len = buffer( ).length( );
+		for( size_t off = 0; off < len && k > 0; ++off )
+			if( buffer( ).at( off ) == '\n' && --k == 0 )
+				return off;
+		return len;
+	};
+
+	size_t lineCount( ) { return buffer( ).linesBefore( buffer( ).length( ) ) + 1; };
+
+	// Block until the byte at off is in, or the whole text is -- Everything is in from the start by default
+	void awaitOffset( size_t off ) { };
+
+	// Block until line and the newline ending it are in, or the whole text is
+	void awaitLine( size_t line ) { };
+
+	// How far loading has got -- Offsets are into the file, lines are what the buffer has so far
+	struct LoadStatus {
+		bool loading = false;
+		size_t read = 0;
+		size_t total = 0;
+		size_t lines = 0;
+
+		// Bytes that weren't valid UTF-8
+		size_t invalid = 0;
+	};
+
+	LoadStatus loadStatus( ) { return { false, buffer( ).length( ), buffer( ).length( ), buffer( ).lineCount( ), 0 }; };
+
+	// Offset of the first byte of line, counting from 0 -- length if there aren't that many
+	size_t offsetOfLine( size_t line ) { return line == 0 ? 0 : std::min( buffer( ).newlineAt( line ) + 1, buffer( ).length( ) ); };
+
+	// Copy len bytes starting at off into out
+	void extract( size_t off, size_t len, char * out ) {
+		for( size_t idx = off; idx < off + len; ++idx )
+			*out++ = buffer( ).at( idx );
+	};
+
+	// Hand visit( data, len, off ) the bytes in [ from, to ) as contiguous chunks, in order, until it returns true
+	// Returns whether it did -- By default the bytes are copied out a block at a time, B should hand over its own storage
+	template<typename F>
+	bool forChunks( size_t from, size_t to, F && visit ) {
+		char block[ 4096 ];
+		for( size_t off = from; off < to; off += sizeof( block ) ) {
+			size_t len = std::min( sizeof( block ), to - off );
+			buffer( ).extract( off, len, block );
+			if( visit( (const char *)block, len, off ) )
+				return true;
+		}
+		return false;
+	};
+
+	// Same, last chunk first
+	template<typename F>
+	bool forChunksBack( size_t from, size_t to, F && visit ) {
+		char block[ 4096 ];
+		for( size_t end = to; end > from; end -= std::min( sizeof( block ), end - from ) ) {
+			size_t len = std::min( sizeof( block ), end - from );
+			buffer( ).extract( end - len, len, block );
+			if( visit( (const char *)block, len, end - len ) )
+				return true;
+		}
+		return false;
+	};
+
+	// Offset of the first match starting at or after from, or Searcher::none
+	// Each chunk is searched where it lies, plus the seam with the chunks before it for matches running across
+	size_t find( const Searcher & query, size_t from ) {
+
+		if( query.length( ) == 0 )
+			return from;
+
+		size_t reach = query.length( ) - 1;
+
+		// Still loading, the match can be in what's to come -- Once more is in, the last reach bytes are looked at
+		//   again along with it
+		for( ;; ) {
+
+			size_t loaded = buffer( ).length( );
+			size_t found = Searcher::none;
+
+			// The last reach bytes before the current chunk, then the first of the chunk joined on
+			std::string seam;
+
+			buffer( ).forChunks( from, loaded, [ & ]( const char * data, size_t len, size_t off ) {
+
+				size_t carried = seam.size( );
+				seam.append( data, std::min( len, reach ) );
+				if( carried ) {
+					size_t at = query.forward( seam.data( ), seam.size( ) );
+					if( at < carried ) {
+						found = off - carried + at;
+						return true;
+					}
+				}
+
+				size_t at = query.forward( data, len );
+				if( at != Searcher::none ) {
+					found = off + at;
+					return true;
+				}
+
+				if( len >= reach )
+					seam.assign( data + len - reach, reach );
+				else
+					seam.erase( 0, seam.size( ) - std::min( seam.size( ), reach ) );
+				return false;
+
+			} );
+
+			if( found != Searcher::none )
+				return found;
+
+			buffer( ).awaitOffset( loaded );
+			if( buffer( ).length( ) == loaded )
+				return Searcher::none;
+			from = std::max( from, loaded - std::min( loaded, reach ) );
+
+		}
+
+	};
+
+	// Offset of the last match starting before before, or Searcher::none -- The match itself can run past before
+	size_t findBack( const Searcher & query, size_t before ) {
+
+		if( query.length( ) == 0 )
+			return std::min( before, buffer( ).length( ) );
+
+		size_t reach = query.length( ) - 1;
+		size_t found = Searcher::none;
+
+		// The last bytes of the current chunk, then the first reach bytes after it
+		std::string seam;
+
+		buffer( ).forChunksBack( 0, std::min( before + reach, buffer( ).length( ) ), [ & ]( const char * data, size_t len, size_t off ) {
+
+			size_t carried = seam.size( );
+			size_t head = std::min( len, reach );
+			seam.insert( 0, data + len - head, head );
+			if( carried ) {
+				// Only as far as a match starting in this chunk can reach
+				size_t at = query.backward( seam.data( ), std::min( seam.size( ), head + reach ) );
+				if( at != Searcher::none ) {
+					found = off + len - head + at;
+					return true;
+				}
+			}
+
+			size_t at = query.backward( data, len );
+			if( at != Searcher::none ) {
+				found = off + at;
+				return true;
+			}
+
+			if( len >= reach )
+				seam.assign( data, reach );
+			else
+				seam.resize( std::min( seam.size( ), reach ) );
+			return false;
+
+		} );
+
+		return found;
+
+	};
+
+	// The text as it is now, for reading on another thread -- By default a copy, B should hand out views if it can
+	std::shared_ptr<const Snapshot> snapshot( ) {
+
+		std::shared_ptr<std::string> text = std::make_shared<std::string>( buffer( ).length( ), '\0' );
+		buffer( ).extract( 0, text->size( ), text->data( ) );
+
+		std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>( );
+		snap->add( text->data( ), text->size( ) );
+		snap->owners.push_back( std::move( text ) );
+		return snap;
+
+	};
+
+	// Describe [ off, off + len ) to the undo log before it is erased -- By default the bytes are copied into it
+	void save( size_t off, size_t len, UndoLog & log ) {
+		char * text = log.copy( len );
+		if( text )
+			buffer( ).extract( off, len, text );
+	};
+
+	// Put back one piece of erased text at off
+	void restore( size_t off, const UndoLog::Span & span, UndoLog & log ) {
+		buffer( ).insert( off, log.text( span ), span.len );
+	};
+
+protected:
+
+	// Lex on from the last known line until line's start state is known
+	void lexTo( size_t line ) {
+
+		Highlighter & hl = this->highlight;
+		size_t next = (size_t)-1;
+		size_t start = 0;
+
+		while( hl.valid( ) <= line && !hl.done( ) ) {
+
+			// Carry on from where the last line ended, unless converging skipped ahead
+			size_t at = hl.valid( ) - 1;
+			if( at != next )
+				start = buffer( ).offsetOfLine( at );
+			size_t end = buffer( ).lineEnd( start );
+
+			Highlighter::State state = hl.stateOf( at );
+			if( end - start <= Highlighter::maxLine ) {
+				this->lexText.resize( end - start );
+				buffer( ).extract( start, end - start, this->lexText.data( ) );
+				state = Highlighter::lex( this->lexText.data( ), this->lexText.size( ), state, nullptr );
+			}
+			hl.lexed( state );
+
+			next = at + 1;
+			start = end + 1;
+
+		}
+
+	};
+
+	// Colours for the first len bytes of line, [ start, end ), in the batch's arena -- text is the line if the
+	//   caller has all of it to hand already, or null
+	std::span<ColourRun> colourLine( ScreenBatch & out, size_t start, size_t end, const char * text, size_t len, size_t line ) {
+
+		Highlighter & hl = this->highlight;
+		if( line >= hl.valid( ) && line < hl.valid( ) + lexAhead )
+			this->lexTo( line );
+
+		Highlighter::State state;
+		if( line < hl.valid( ) ) {
+			state = hl.stateOf( line );
+		} else {
+			state = line == this->guessLine ? this->guessState : hl.stateOf( line );
+			this->guessed = true;
+		}
+
+		// All of it, a token running on past what's drawn still colours as what it is
+		this->lexRuns.clear( );
+		if( end - start <= Highlighter::maxLine ) {
+			if( !text ) {
+				this->lexText.resize( end - start );
+				buffer( ).extract( start, end - start, this->lexText.data( ) );
+				text = this->lexText.data( );
+			}
+			state = Highlighter::lex( text, end - start, state, &this->lexRuns );
+		}
+		this->guessLine = line + 1;
+		this->guessState = state;
+
+		size_t count = 0, total = 0;
+		while( count < this->lexRuns.size( ) && total < len )
+			total += this->lexRuns[ count++ ].len;
+		if( count == 0 )
+			return { };
+
+		ColourRun * runs = out.runs( count );
+		std::copy_n( this->lexRuns.begin( ), count, runs );
+		if( total > len )
+			runs[ count - 1 ].len -= (uint32_t)( total - len );
+		return { runs, count };
+
+	};
+
+	// An edit on line took out removed newlines and put in added
+	void recolour( size_t line, size_t removed, size_t added ) {
+		this->highlight.edited( line, removed, added );
+		this->guessLine = (size_t)-1;
+	};
+
+	// Screen helpers
+
+	// Draw the line containing off, starting from column x, onto screen row y -- off starts a cluster, and x is its column
+	// Pad out to the edge of the screen so whatever was there before gets overwritten
+	void drawLine( ScreenBatch & out, size_t off, size_t x, size_t y ) {
+
+		if( y >= this->textRows( ) || x >= this->cols || this->held )
+			return;
+
+		// An edit can recolour what's before it on the line, a word turning into a keyword, so coloured lines go whole
+		if( this->highlight.active( ) && x > 0 ) {
+			off = buffer( ).lineStart( off );
+			x = 0;
+		}
+
+		size_t end = buffer( ).lineEnd( off );
+		size_t width = this->cols - x;
+
+		// Straight into the batch's arena, no string of our own
+		// Enough bytes for width columns of ASCII, and more if it turns out not to be -- Where a cluster ends is
+		//   only certain a whole character short of the end of what was taken, the next could have joined on
+		size_t take = std::min( end - off, width + 4 );
+		char * line;
+		size_t len, used;
+		for( ;; ) {
+			line = out.text( take + width );
+			buffer( ).extract( off, take, line );
+			len = clustersFitting( line, take, width, used );
+			if( len + 4 <= take || take == end - off )
+				break;
+			take = std::min( end - off, take * 2 );
+		}
+
+		// Lexed before the control characters go, they mean something to it
+		std::span<ColourRun> runs;
+		if( this->highlight.active( ) )
+			runs = this->colourLine( out, off, end, take == end - off ? line : nullptr, len, this->top + y );
+
+		if( !this->cursors.empty( ) )
+			runs = this->markCursors( out, runs, line, off, end, len, len + width - used );
+
+		// Control characters would move the terminal cursor around on us
+		std::replace_if( line, line + len, [ ]( char c ) { return (unsigned char)c < 0x20; }, ' ' );
+		std::fill( line + len, line + len + width - used, ' ' );
+
+		out.add( ScreenCommand( std::string_view( line, len + width - used ), runs, x, y, false ) );
+
+	};
+
+	// Draw every line from the one starting at off downwards, beginning at screen row y and stopping before row end
+	// Rows past the end of the buffer get blanked
+	void drawFrom( ScreenBatch & out, size_t off, size_t y, size_t end = (size_t)-1 ) {
+
+		size_t len = buffer( ).length( );
+		bool more = true;
+
+		for( end = std::min( end, this->textRows( ) ); y < end; ++y ) {
+
+			if( more ) {
+				this->drawLine( out, off, 0, y );
+
+				off = buffer( ).lineEnd( off );
+				if( off < len )
+					++off;
+				else
+					more = false;
+
+			} else if( !this->held ) {
+				char * blank = out.text( this->cols );
+				std::fill( blank, blank + this->cols, ' ' );
+				out.add( ScreenCommand( std::string_view( blank, this->cols ), 0, y, false ) );
+			}
+
+		}
+
+	};
+
+	// Redraw the whole window
+	void drawAll( ScreenBatch & out ) {
+
+		this->drawFrom( out, buffer( ).offsetOfLine( this->top ), 0 );
+
+	};
+
+	// Keep the cursor inside the window -- Returns true if we had to scroll
+	bool scrollToCursor( ) {
+
+		if( this->curry < this->top ) {
+			this->top = this->curry;
+			return true;
+		}
+
+		if( this->curry >= this->top + this->textRows( ) ) {
+			this->top = this->curry - this->textRows( ) + 1;
+			return true;
+		}
+
+		return false;
+
+	};
+
+	// The window moved from line was to top -- Scroll what's on screen along with it, leaving the rows that came in
+	//   for the caller to draw, or false if it's moved too far for that to be worth it and it all needs drawing
+	bool shiftView( ScreenBatch & out, size_t was ) {
+
+		size_t rows = this->textRows( );
+		size_t by = this->top > was ? this->top - was : was - this->top;
+		if( by >= rows || this->held )
+			return false;
+
+		out.add( ScreenCommand::scroll( 0, rows, (ptrdiff_t)this->top - (ptrdiff_t)was ) );
+		return true;
+
+	};
+
+	// Keep the cursor inside the window, when nothing on screen has changed but the window -- Stepping past the edge
+	//   scrolls and draws the one line that comes in, not the lot
+	void scrollView( ScreenBatch & out ) {
+
+		size_t was = this->top;
+		if( !this->scrollToCursor( ) )
+			return;
+
+		if( !this->shiftView( out, was ) ) {
+			this->drawAll( out );
+			return;
+		}
+
+		size_t rows = this->textRows( );
+		if( this->top > was ) {
+			size_t by = this->top - was;
+			this->drawFrom( out, buffer( ).offsetOfLine( this->top + rows - by ), rows - by );
+		} else {
+			this->drawFrom( out, buffer( ).offsetOfLine( this->top ), 0, was - this->top );
+		}
+
+	};
+
+	// Whether the byte at off is ASCII, or the end -- Clusters only ever grow by non-ASCII characters, so an ASCII byte
+	//   followed by one of these is a cluster on its own, and moving or editing over it needn't look at the line's layout
+	bool plainAt( size_t off ) {
+		return off == buffer( ).length( ) || (unsigned char)buffer( ).at( off ) < 0x80;
+	};
+
+	// Cursor movement -- These only touch the offsets, the storage is not modified
+
+	void moveLeft( ) {
+
+		if( this->curr == 0 )
+			return;
+
+		char prev = buffer( ).at( this->curr - 1 );
+		if( prev == '\n' ) {
+			--this->curr;
+			--this->curry;
+			this->currx = this->layout( buffer( ).lineStart( this->curr ) ).width;
+			return;
+		}
+		if( (unsigned char)prev < 0x80 ) {
+			--this->curr;
+			--this->currx;
+			return;
+		}
+
+		size_t start = buffer( ).lineStart( this->curr );
+		const LineCache::Layout & line = this->layout( start );
+		size_t at = line.clusterStart( this->curr - 1 - start );
+		this->curr = start + at;
+		this->currx = line.column( at );
+
+	};
+
+	void moveRight( ) {
+
+		if( this->curr == buffer( ).length( ) )
+			buffer( ).awaitOffset( this->curr );
+		if( this->curr == buffer( ).length( ) )
+			return;
+
+		char next = buffer( ).at( this->curr );
+		if( next == '\n' ) {
+			++this->curr;
+			++this->curry;
+			this->currx = 0;
+			return;
+		}
+		if( (unsigned char)next < 0x80 && this->plainAt( this->curr + 1 ) ) {
+			++this->curr;
+			++this->currx;
+			return;
+		}
+
+		size_t start = buffer( ).lineStart( this->curr );
+		const LineCache::Layout & line = this->layout( start );
+		size_t at = line.clusterEnd( this->curr - start );
+		this->curr = start + at;
+		this->currx = line.column( at );
+
+	};
+
+	// Put the cursor on the line starting at start, on the cluster under the goal column or the end of the line
+	void moveToGoal( size_t start ) {
+		const LineCache::Layout & line = this->layout( start );
+		size_t at = line.byteAt( this->goalx );
+		this->curr = start + at;
+		this->currx = line.column( at );
+	};
+
+	void moveUp( ) {
+
+		if( this->curry == 0 )
+			return;
+
+		size_t start = buffer( ).lineStart( this->curr );
+		this->moveToGoal( buffer( ).lineStart( start - 1 ) );
+		--this->curry;
+
+	};
+
+	void moveDown( ) {
+
+		buffer( ).awaitLine( this->curry + 1 );
+		size_t end = buffer( ).lineEnd( this->curr );
+		if( end == buffer( ).length( ) )
+			return;
+
+		this->moveToGoal( end + 1 );
+		++this->curry;
+
+	};
+
+	void moveHome( ) {
+		this->curr = buffer( ).lineStart( this->curr );
+		this->currx = 0;
+	};
+
+	void moveEnd( ) {
+		buffer( ).awaitLine( this->curry );
+		size_t start = buffer( ).lineStart( this->curr );
+		const LineCache::Layout & line = this->layout( start );
+		this->curr = start + line.length;
+		this->currx = line.width;
+	};
+
+	// Jump straight to a line, as near the goal column as it goes -- What a run of moveUp / moveDown ends up at
+	void moveToLine( size_t line ) {
+
+		buffer( ).awaitLine( line );
+		line = std::min( line, buffer( ).lineCount( ) - 1 );
+		this->moveToGoal( buffer( ).offsetOfLine( line ) );
+		this->curry = line;
+
+	};
+
+	// Edits -- Storage changes go through these two, so the undo log sees every one
+
+	void insertText( size_t off, const char * str, size_t len, bool typing = false ) {
+		this->history.inserted( off, len, this->curr, typing );
+		if( this->highlight.active( ) )
+			this->recolour( buffer( ).linesBefore( off ), 0, countNewlines( str, len ) );
+		buffer( ).insert( off, str, len );
+		this->layouts.edited( off, 0, str, len );
+	};
+
+	void eraseText( size_t off, size_t len, bool typing = false ) {
+		buffer( ).save( off, len, this->history );
+		this->history.erased( off, len, this->curr, typing );
+		if( this->highlight.active( ) ) {
+			size_t line = buffer( ).linesBefore( off );
+			this->recolour( line, buffer( ).linesBefore( off + len ) - line, 0 );
+		}
+		buffer( ).erase( off, len );
+		this->layouts.edited( off, len, nullptr, 0 );
+	};
+
+	// Put the cursor at off, or the start of the cluster it falls in
+	void moveTo( size_t off ) {
+		buffer( ).awaitOffset( off );
+		off = std::min( off, buffer( ).length( ) );
+		size_t start = buffer( ).lineStart( off );
+		const LineCache::Layout & line = this->layout( start );
+		this->curr = start + line.clusterStart( off - start );
+		this->curry = buffer( ).linesBefore( this->curr );
+		this->currx = line.column( this->curr - start );
+	};
+
+	// Reverse one group from the undo log, as a group of its own, then put the cursor back where it was before the group
+	void playBack( ScreenBatch & out, const UndoLog::Step & step ) {
+
+		for( size_t idx = step.last; idx > step.first; --idx ) {
+
+			UndoLog::Op op = this->history.at( idx - 1 );
+
+			if( !op.erase ) {
+				this->eraseText( op.off, op.len );
+				continue;
+			}
+
+			this->history.inserted( op.off, op.len, this->curr );
+			size_t at = op.off;
+			for( size_t span = this->history.spanFirst( idx - 1 ); span < this->history.spanLast( idx - 1 ); ++span ) {
+				UndoLog::Span piece = this->history.spanAt( span );
+				buffer( ).restore( at, piece, this->history );
+				at += piece.len;
+			}
+
+			this->layouts.edited( op.off, 0, nullptr, op.len );
+			if( this->highlight.active( ) ) {
+				size_t line = buffer( ).linesBefore( op.off );
+				this->recolour( line, 0, buffer( ).linesBefore( op.off + op.len ) - line );
+			}
+
+		}
+
+		// Only now is it safe for the history to go, if an erase was too big to keep
+		this->history.played( );
+
+		// The group only knows where one cursor was, so that's what's left
+		this->dropCursors( );
+		this->moveTo( step.cursor );
+		this->goalx = this->currx;
+		this->scrollToCursor( );
+		this->drawAll( out );
+
+	};
+
+	// Put text up in the echo area, taking the bottom row from the text if it isn't already
+	void showEcho( ScreenBatch & out, std::string_view text ) {
+
+		if( !this->echo ) {
+			this->echo = true;
+			this->scrollView( out );
+		}
+
+		if( this->held ) {
+			this->heldEcho = text;
+			return;
+		}
+
+		size_t y = this->rows - 1;
+		size_t used;
+		size_t len = clustersFitting( text.data( ), text.length( ), this->cols, used );
+		char * line = out.text( len + this->cols - used );
+		std::copy( text.begin( ), text.begin( ) + len, line );
+		std::fill( line + len, line + len + this->cols - used, ' ' );
+		out.add( ScreenCommand( std::string_view( line, len + this->cols - used ), 0, y, false ) );
+
+	};
+
+	// Give the bottom row back to the text
+	void hideEcho( ScreenBatch & out ) {
+
+		if( !this->echo )
+			return;
+
+		this->echo = false;
+		this->scrollToCursor( );
+		this->drawAll( out );
+
+	};
+
+	// Leave the screen cursor where ours is
+	void placeCursor( ScreenBatch & out ) {
+		if( !this->held )
+			out.add( ScreenCommand( std::string_view( ), this->currx, this->curry - this->top, false ) );
+	};
+
+	void holdDrawing( ) {
+		this->held = true;
+		this->heldEcho.clear( );
+	};
+
+	// Draw what was held back -- The whole window, since there's no telling what of it changed
+	void releaseDrawing( ScreenBatch & out ) {
+
+		this->held = false;
+		this->scrollToCursor( );
+		this->drawAll( out );
+		if( this->echo && !this->heldEcho.empty( ) )
+			this->showEcho( out, this->heldEcho );
+		this->heldEcho.clear( );
+		this->placeCursor( out );
+
+	};
+
+	// Multiple cursors
+
+	// First of the other cursors at or after off
+	typename std::vector<Cursor>::iterator cursorFrom( size_t off ) {
+		return std::lower_bound( this->cursors.begin( ), this->cursors.end( ), off, [ ]( const Cursor & c, size_t off ) { return c.off < off; } );
+	};
+
+	// Colour the other cursors and all the selections in over a line's runs -- [ off, off + len ) of the line, which
+	//   ends at end, was drawn as text, padded out to total bytes, and a cursor at the end of the line marks the first blank
+	std::span<ColourRun> markCursors( ScreenBatch & out, std::span<ColourRun> runs, const char * text, size_t off, size_t end, size_t len, size_t total ) {
+
+		std::vector<Colour> & marks = this->marks;
+		marks.assign( total, Colour::CL_DEFAULT );
+		size_t at = 0;
+		for( const ColourRun & run : runs ) {
+			std::fill_n( marks.begin( ) + at, run.len, run.colour );
+			at += run.len;
+		}
+
+		auto select = [ & ]( size_t from, size_t to ) {
+			from = std::max( from, off );
+			to = std::min( to, off + len );
+			if( from < to )
+				std::fill( marks.begin( ) + ( from - off ), marks.begin( ) + ( to - off ), Colour::CL_SELECTION );
+		};
+		select( std::min( this->curr, this->anchor ), std::max( this->curr, this->anchor ) );
+
+		// Selections never overlap, so only the cursor just before the line can have one reaching into it
+		auto first = this->cursorFrom( off );
+		if( first != this->cursors.begin( ) )
+			--first;
+
+		for( auto c = first; c != this->cursors.end( ) && std::min( c->off, c->anchor ) <= end; ++c ) {
+			select( std::min( c->off, c->anchor ), std::max( c->off, c->anchor ) );
+			if( c->off >= off && c->off < off + len ) {
+				size_t from = c->off - off;
+				size_t bytes = std::clamp<size_t>( utf8Length( text[ from ] ), 1, len - from );
+				std::fill_n( marks.begin( ) + from, bytes, Colour::CL_CURSOR );
+			} else if( c->off == end && off + len == end && total > len ) {
+				marks[ len ] = Colour::CL_CURSOR;
+			}
+		}
+
+		size_t count = 0;
+		for( size_t idx = 0; idx < total; ++idx )
+			count += idx == 0 || marks[ idx ] != marks[ idx - 1 ];
+		if( count == 0 )
+			return { };
+
+		ColourRun * merged = out.runs( count );
+		size_t run = 0;
+		merged[ 0 ] = { 0, marks[ 0 ] };
+		for( size_t idx = 0; idx < total; ++idx ) {
+			if( idx > 0 && marks[ idx ] != marks[ idx - 1 ] )
+				merged[ ++run ] = { 0, marks[ idx ] };
+			++merged[ run ].len;
+		}
+		return { merged, count };
+
+	};
+
+	// Another cursor at off, selecting from anchor -- Nothing happens if there's a cursor there already
+	void addCursor( size_t off, size_t anchor, size_t goalx ) {
+
+		if( this->cursors.empty( ) )
+			this->anchor = this->curr;
+		if( off == this->curr )
+			return;
+
+		auto at = this->cursorFrom( off );
+		if( at == this->cursors.end( ) || at->off != off )
+			this->cursors.insert( at, { off, anchor, goalx } );
+
+	};
+
+	// One more cursor, a line below the last or above the first, as near their goal column as it goes
+	void addCursorLine( bool below ) {
+
+		Cursor edge = { this->curr, this->anchor, this->goalx };
+		if( !this->cursors.empty( ) ) {
+			const Cursor & other = below ? this->cursors.back( ) : this->cursors.front( );
+			if( below == ( other.off > edge.off ) )
+				edge = other;
+		}
+
+		size_t line = buffer( ).linesBefore( edge.off );
+		if( !below && line == 0 )
+			return;
+		if( below )
+			buffer( ).awaitLine( line + 1 );
+		if( below && line + 1 >= buffer( ).lineCount( ) )
+			return;
+
+		size_t start = buffer( ).offsetOfLine( below ? line + 1 : line - 1 );
+		size_t off = start + this->layout( start ).byteAt( edge.goalx );
+		this->addCursor( off, off, edge.goalx );
+
+	};
+
+	// Back to just curr
+	void dropCursors( ) {
+		this->cursors.clear( );
+		this->anchor = this->curr;
+	};
+
+	// Run step at every cursor in turn, from the front, with the cursor in curr -- step moves it, and can edit
+	// Whatever an edit adds or takes away shifts the cursors after it, which is caught up with as the walk gets to each,
+	//   so the buffer is walked through once however many cursors there are, and a gap buffer's gap only goes forwards
+	// Cursors that end up in the same place, an edit swallowing the ones just before it, become one
+	template<typename F>
+	void forEachCursor( F step ) {
+
+		// curr goes in among the others for the walk, and comes back out after
+		std::vector<Cursor> & all = this->cursors;
+		auto slot = this->cursorFrom( this->curr );
+		size_t main = slot - all.begin( );
+		all.insert( slot, { this->curr, this->anchor, this->goalx } );
+
+		ptrdiff_t shift = 0;
+		size_t floor = 0;
+		for( size_t idx = 0; idx < all.size( ); ++idx ) {
+
+			Cursor & c = all[ idx ];
+			c.off = std::max<size_t>( c.off + shift, floor );
+			c.anchor = std::max<size_t>( c.anchor + shift, floor );
+
+			size_t before = buffer( ).length( );
+			this->moveTo( c.off );
+			this->goalx = c.goalx;
+			step( c );
+
+			c.off = this->curr;
+			c.goalx = this->goalx;
+			shift += (ptrdiff_t)( buffer( ).length( ) - before );
+			floor = this->curr;
+
+			// Erasing backwards can take in cursors already done
+			for( size_t back = idx; back-- > 0 && ( all[ back ].off > floor || all[ back ].anchor > floor ); ) {
+				all[ back ].off = std::min( all[ back ].off, floor );
+				all[ back ].anchor = std::min( all[ back ].anchor, floor );
+			}
+
+		}
+
+		// Merge the ones sharing a place, keeping curr's
+		size_t kept = 0;
+		for( size_t idx = 1; idx < all.size( ); ++idx ) {
+			if( all[ idx ].off != all[ kept ].off )
+				all[ ++kept ] = all[ idx ];
+			else if( idx == main )
+				all[ kept ] = all[ idx ];
+			if( idx == main )
+				main = kept;
+		}
+		all.resize( kept + 1 );
+
+		Cursor mine = all[ main ];
+		all.erase( all.begin( ) + main );
+		this->moveTo( mine.off );
+		this->anchor = mine.anchor;
+		this->goalx = mine.goalx;
+
+	};
+
+	// Take out the selection at the cursor in curr, if it has one
+	bool eraseSelection( Cursor & c ) {
+
+		if( c.anchor == this->curr )
+			return false;
+
+		size_t from = std::min( c.anchor, this->curr );
+		this->eraseText( from, std::max( c.anchor, this->curr ) - from );
+		this->curr = c.anchor = from;
+		return true;
+
+	};
+
+	// A key at every cursor -- False for keys that only ever go to curr
+	bool multiKey( KeyEvent & key, ScreenBatch & out ) {
+
+		if( key.type == KeyEventType::KET_PRINT || key.type == KeyEventType::KET_PASTE ) {
+
+			char code[ 4 ];
+			std::string_view text;
+			if( key.type == KeyEventType::KET_PASTE ) {
+				text = *std::get<KeyEventPaste>( key.event ).text;
+			} else {
+				KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+				if( prnt.ctrl || prnt.alt || prnt.os )
+					return false;
+				text = std::string_view( code, utf8Encode( prnt.code, code ) );
+			}
+
+			this->forEachCursor( [ & ]( Cursor & c ) {
+				this->eraseSelection( c );
+				this->insertAtCursor( text );
+				this->goalx = this->currx;
+				c.anchor = this->curr;
+			} );
+
+		} else if( key.type == KeyEventType::KET_CONTROL ) {
+
+			KeyEventControl ck = std::get<KeyEventControl>( key.event );
+			switch( ck ) {
+			case KeyEventControl::CK_BKSPC:
+			case KeyEventControl::CK_DEL:
+				this->forEachCursor( [ & ]( Cursor & c ) {
+					if( !this->eraseSelection( c ) ) {
+						size_t from = this->curr;
+						if( ck == KeyEventControl::CK_BKSPC )
+							this->moveLeft( );
+						else
+							this->moveRight( );
+						size_t to = std::max( from, this->curr );
+						this->curr = std::min( from, this->curr );
+						if( to > this->curr )
+							this->eraseText( this->curr, to - this->curr );
+					}
+					// What's left either side can join up into one cluster, and then the cursor goes to its front
+					this->moveTo( this->curr );
+					this->goalx = this->currx;
+					c.anchor = this->curr;
+				} );
+				break;
+
+			case KeyEventControl::CK_LEFT:
+			case KeyEventControl::CK_RIGHT:
+			case KeyEventControl::CK_UP:
+			case KeyEventControl::CK_DOWN:
+			case KeyEventControl::CK_HOME:
+			case KeyEventControl::CK_END:
+				this->forEachCursor( [ & ]( Cursor & c ) {
+					switch( ck ) {
+					case KeyEventControl::CK_LEFT: this->moveLeft( ); break;
+					case KeyEventControl::CK_RIGHT: this->moveRight( ); break;
+					case KeyEventControl::CK_UP: this->moveUp( ); break;
+					case KeyEventControl::CK_DOWN: this->moveDown( ); break;
+					case KeyEventControl::CK_HOME: this->moveHome( ); break;
+					default: this->moveEnd( ); break;
+					}
+					if( ck != KeyEventControl::CK_UP && ck != KeyEventControl::CK_DOWN )
+						this->goalx = this->currx;
+					c.anchor = this->curr;
+				} );
+				break;
+
+			default:
+				return false;
+			}
+
+		} else {
+			return false;
+		}
+
+		this->scrollToCursor( );
+		this->drawAll( out );
+		this->placeCursor( out );
+		return true;
+
+	};
+
+public:
+
+	// Undo and redo are whole commands, for the modes layered above us to bind to keys of their choosing
+	// Repeated, undo keeps walking back -- See UndoLog for how the chain works
+
+	void undo( ScreenBatch & out ) {
+		UndoLog::Step step;
+		this->history.command( );
+		if( this->history.undo( step ) )
+			this->playBack( out, step );
+		this->placeCursor( out );
+	};
+
+	void redo( ScreenBatch & out ) {
+		UndoLog::Step step;
+		this->history.command( );
+		if( this->history.redo( step ) )
+			this->playBack( out, step );
+		this->placeCursor( out );
+	};
+
+	// Cap on the memory the undo history can use
+	void setUndoBudget( size_t bytes ) { this->history.setBudget( bytes ); };
+
+	// Colour the text as source, or stop -- Either way starting over from the top
+	void setHighlighting( bool on ) {
+		this->highlight.reset( buffer( ).lineCount( ), on );
+		this->guessLine = (size_t)-1;
+		this->guessed = false;
+	};
+
+protected:
+
+	void insertChar( ScreenBatch & out, char32_t code ) {
+
+		char text[ 4 ];
+		size_t len = utf8Encode( code, text );
+		bool plain = code < 0x80 && this->plainAt( this->curr );
+		this->insertText( this->curr, text, len, code != '\n' );
+
+		if( code == '\n' ) {
+			++this->curr;
+			++this->curry;
+			this->currx = 0;
+
+			// Enter on the bottom row pushes what's above up, the rest is the same either way
+			size_t was = this->top;
+			if( this->scrollToCursor( ) && !this->shiftView( out, was ) )
+				this->drawAll( out );
+			else
+				this->drawFrom( out, buffer( ).lineStart( this->curr - 1 ), this->curry - 1 - this->top );
+
+			return;
+		}
+
+		if( plain ) {
+			this->drawLine( out, this->curr, this->currx, this->curry - this->top );
+			++this->curr;
+			++this->currx;
+			return;
+		}
+
+		// A mark joins the cluster before it, so the redraw starts from there, and the cursor goes after whatever
+		//   the new character ended up part of
+		size_t start = buffer( ).lineStart( this->curr );
+		const LineCache::Layout & line = this->layout( start );
+		size_t from = line.clusterStart( this->curr - start );
+		this->curr = start + line.clusterEnd( this->curr - start );
+		this->drawLine( out, start + from, line.column( from ), this->curry - this->top );
+		this->currx = line.column( this->curr - start );
+
+	};
+
+	// Put text in at the cursor and move after it -- Or after the cluster it ends in, if it ends in the middle of one
+	void insertAtCursor( std::string_view text ) {
+		size_t end = this->curr + text.length( );
+		this->insertText( this->curr, text.data( ), text.length( ) );
+		this->moveTo( end );
+		if( this->curr < end )
+			this->moveRight( );
+	};
+
+	// A paste, as one edit and one redraw however long it is
+	void insertPaste( ScreenBatch & out, std::string_view text ) {
+
+		if( text.empty( ) )
+			return;
+
+		this->insertAtCursor( text );
+		this->scrollToCursor( );
+		this->drawAll( out );
+
+	};
+
+	void deleteBackward( ScreenBatch & out ) {
+
+		if( this->curr == 0 )
+			return;
+
+		this->moveLeft( );
+		this->deleteForward( out );
+
+	};
+
+	void deleteForward( ScreenBatch & out ) {
+
+		if( this->curr == buffer( ).length( ) )
+			buffer( ).awaitOffset( this->curr );
+		if( this->curr == buffer( ).length( ) )
+			return;
+
+		char c = buffer( ).at( this->curr );
+		bool joined = c == '\n';
+		size_t len = 1;
+		if( !joined && !( (unsigned char)c < 0x80 && this->plainAt( this->curr + 1 ) ) ) {
+			size_t start = buffer( ).lineStart( this->curr );
+			len = start + this->layout( start ).clusterEnd( this->curr - start ) - this->curr;
+		}
+		this->eraseText( this->curr, len, true );
+
+		// What's left either side can come together as one cluster, a flag's two halves or a mark and a base,
+		//   and then the cursor goes to the front of it
+		if( !this->plainAt( this->curr ) ) {
+			size_t start = buffer( ).lineStart( this->curr );
+			const LineCache::Layout & line = this->layout( start );
+			size_t at = line.clusterStart( this->curr - start );
+			this->curr = start + at;
+			this->currx = line.column( at );
+		}
+
+		if( this->scrollToCursor( ) )
+			this->drawAll( out );
+		else if( joined )
+			this->drawFrom( out, buffer( ).lineStart( this->curr ), this->curry - this->top );
+		else
+			this->drawLine( out, this->curr, this->currx, this->curry - this->top );
+
+	};
+
+	// Consume a key, editing the buffer as needed
+	void doConsumeKey( KeyEvent & key, ScreenBatch & out ) {
+
+		bool keepGoal = false;
+		this->history.command( );
+
+		// With more than one cursor, edits and moves go to them all
+		if( !this->cursors.empty( ) && this->multiKey( key, out ) )
+			return;
+
+		switch( key.type ) {
+		case KeyEventType::KET_PRINT:
+		{
+			KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+
+			// Chords are for the modes layered above us to interpret
+			if( prnt.ctrl || prnt.alt || prnt.os )
+				return;
+
+			this->insertChar( out, prnt.code );
+			break;
+		}
+
+		case KeyEventType::KET_CONTROL:
+			switch( std::get<KeyEventControl>( key.event ) ) {
+			case KeyEventControl::CK_BKSPC:
+				this->deleteBackward( out );
+				break;
+			case KeyEventControl::CK_DEL:
+				this->deleteForward( out );
+				break;
+
+			case KeyEventControl::CK_LEFT:
+				this->moveLeft( );
+				break;
+			case KeyEventControl::CK_RIGHT:
+				this->moveRight( );
+				break;
+			case KeyEventControl::CK_UP:
+				this->moveUp( );
+				keepGoal = true;
+				break;
+			case KeyEventControl::CK_DOWN:
+				this->moveDown( );
+				keepGoal = true;
+				break;
+			case KeyEventControl::CK_HOME:
+				this->moveHome( );
+				break;
+			case KeyEventControl::CK_END:
+				this->moveEnd( );
+				break;
+			case KeyEventControl::CK_PGUP:
+				this->moveToLine( this->curry - std::min( this->curry, this->textRows( ) - 1 ) );
+				keepGoal = true;
+				break;
+			case KeyEventControl::CK_PGDN:
+				this->moveToLine( this->curry + this->textRows( ) - 1 );
+				keepGoal = true;
+				break;
+
+			default:
+				return;
+			}
+
+			this->scrollView( out );
+			break;
+
+		case KeyEventType::KET_RESIZE:
+		{
+			KeyEventResize & size = std::get<KeyEventResize>( key.event );
+			this->cols = std::max<size_t>( size.cols, 1 );
+			this->rows = std::max<size_t>( size.rows, 1 );
+
+			// Screen needs to size its buffers before we draw into them
+			out.add( ScreenCommand( this->cols, this->rows ) );
+
+			this->scrollToCursor( );
+			this->drawAll( out );
+			break;
+		}
+
+		case KeyEventType::KET_PASTE:
+			this->insertPaste( out, *std::get<KeyEventPaste>( key.event ).text );
+			break;
+		}
+
+		if( !keepGoal )
+			this->goalx = this->currx;
+
+		// Finish with an empty string to leave the screen cursor where ours is
+		this->placeCursor( out );
+
+	};
+
+	// Colour what's on screen if it's near enough, then the next chunk of the file, and redraw the lines on screen
+	//   whose colours came out different
+	void doPoll( ScreenBatch & out ) {
+
+		Highlighter & hl = this->highlight;
+		if( !hl.active( ) )
+			return;
+
+		size_t bottom = std::min( this->top + this->textRows( ), hl.lines( ) );
+		if( bottom <= hl.valid( ) + lexAhead )
+			this->lexTo( bottom - 1 );
+		if( !hl.done( ) )
+			this->lexTo( std::min( hl.valid( ) + lexChunk, hl.lines( ) ) - 1 );
+
+		std::pair<size_t, size_t> changed = hl.changes( );
+		size_t from = std::max( changed.first, this->top );
+		size_t to = std::min( changed.second, bottom );
+
+		if( this->guessed && hl.valid( ) >= bottom ) {
+			this->guessed = false;
+			this->drawAll( out );
+			this->placeCursor( out );
+		} else if( from < to ) {
+			for( size_t line = from; line < to; ++line )
+				this->drawLine( out, buffer( ).offsetOfLine( line ), 0, line - this->top );
+			this->placeCursor( out );
+		}
+
+		if( !hl.done( ) && this->wake )
+			this->wake( );
+
+	};
+
+};
\ No newline at end of file
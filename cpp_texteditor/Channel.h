@@ -1,45 +1,213 @@
 #pragma once
 
-#include <queue>
-#include <memory>
-#include <mutex>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
 
 
-// Very simple thread-safe queue
-// Basically just wrap push/pop with a mutex and unique_locks
+// Bounded single producer / single consumer queue
+// Every channel in this program has exactly one thread on each end, so there is no need for a lock:
+//   the producer only ever writes tail, the consumer only ever writes head, and the slots between them change hands
+//   through acquire / release on those two indices
+// Messages are moved into preallocated slots, so pushing and popping never touch the heap
+// An empty consumer or a blocked producer sleeps on a futex (std::atomic::wait) until the other end wakes it,
+//   and each end only pays for the wake syscall when the other one has actually gone to sleep
 
 template <typename M>
 class Channel {
 
-	std::mutex queue_mtx;
-	std::queue<std::unique_ptr<M>> queue;
+	// Keep the two ends on their own cache lines so they don't fight over them
+	static constexpr size_t cacheLine = 64;
+
+	// Storage -- Capacity is a power of two so wrapping is a mask
+	std::vector<M> slots;
+	size_t mask;
+
+	// Consumer side -- Next slot to read, plus the last tail we saw so we don't reload it every pop
+	alignas( cacheLine ) std::atomic<size_t> head = 0;
+	size_t tailSeen = 0;
+
+	// Producer side -- Next slot to write, plus the last head we saw
+	alignas( cacheLine ) std::atomic<size_t> tail = 0;
+	size_t headSeen = 0;
+
+	// Sleeping -- Each side advertises when it's about to sleep, and waits on a counter the other side bumps
+	alignas( cacheLine ) std::atomic<bool> consumerAsleep = false;
+	std::atomic<uint32_t> pushed = 0;
+	alignas( cacheLine ) std::atomic<bool> producerAsleep = false;
+	std::atomic<uint32_t> popped = 0;
+	std::atomic<bool> closed = false;
+
+	// Set by poke( ), the consumer's next wait( ) returns even if nothing was pushed
+	std::atomic<bool> poked = false;
+
+	// Called after publishing -- The fence pairs with the one in sleepUntil so one side always sees the other
+	// Whoever clears asleep makes the one syscall -- Otherwise every push landing before the sleeper has run again
+	//   pays for a wake of its own
+	static void wake( std::atomic<bool> & asleep, std::atomic<uint32_t> & signal ) {
+
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if( asleep.load( std::memory_order_relaxed ) && asleep.exchange( false, std::memory_order_relaxed ) ) {
+			signal.fetch_add( 1, std::memory_order_release );
+			signal.notify_one( );
+		}
+
+	};
+
+	// Block until ready( ) holds -- Returns false if it doesn't and the channel is closed
+	template <typename F>
+	bool sleepUntil( std::atomic<bool> & asleep, std::atomic<uint32_t> & signal, F ready ) {
+
+		while( true ) {
+
+			if( ready( ) )
+				return true;
+			if( this->closed.load( std::memory_order_acquire ) )
+				return false;
+
+			uint32_t seen = signal.load( std::memory_order_acquire );
+			asleep.store( true, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+
+			// Check again now we've said we're asleep, anything published after this will wake us
+			if( !ready( ) && !this->closed.load( std::memory_order_relaxed ) )
+				signal.wait( seen, std::memory_order_acquire );
+
+			asleep.store( false, std::memory_order_relaxed );
+
+		}
+
+	};
+
+	static size_t roundUp( size_t capacity ) {
+		size_t size = 2;
+		while( size < capacity )
+			size <<= 1;
+		return size;
+	};
 
 public:
-	void push( M && msg ) {
+	Channel( size_t capacity = 4096 ) : slots( roundUp( capacity ) ), mask( roundUp( capacity ) - 1 ) { };
+
+	// Producer only -- Returns false and leaves msg alone if the queue is full
+	bool tryPush( M && msg ) {
+
+		size_t at = this->tail.load( std::memory_order_relaxed );
+
+		if( at - this->headSeen > this->mask ) {
+			this->headSeen = this->head.load( std::memory_order_acquire );
+			if( at - this->headSeen > this->mask )
+				return false;
+		}
+
+		this->slots[ at & this->mask ] = std::move( msg );
+		this->tail.store( at + 1, std::memory_order_release );
+		wake( this->consumerAsleep, this->pushed );
+
+		return true;
 
-		std::unique_lock<std::mutex> lock( queue_mtx );
-		queue.push( std::move( std::make_unique<M>( std::move( msg ) ) ) );
+	};
+
+	// Producer only -- Sleeps until there's room if the consumer has fallen a whole queue behind
+	// Returns false, dropping msg, if the channel is closed while we wait
+	bool push( M && msg ) {
+
+		while( !this->tryPush( std::move( msg ) ) ) {
+			bool room = this->sleepUntil( this->producerAsleep, this->popped, [ this ]( ) {
+				return this->tail.load( std::memory_order_relaxed ) - this->head.load( std::memory_order_acquire ) <= this->mask;
+			} );
+			if( !room )
+				return false;
+		}
+
+		return true;
 
 	};
 
-	std::unique_ptr<M> pop( ) {
+	// Consumer only -- Sleep until there is something to pop, or somebody pokes us
+	// Returns false once the channel is closed and drained
+	bool wait( ) {
 
-		std::unique_lock<std::mutex> lock( queue_mtx );
-		if( queue.empty( ) )
-			return nullptr;
+		bool ready = this->sleepUntil( this->consumerAsleep, this->pushed, [ this ]( ) {
+			return this->tail.load( std::memory_order_acquire ) != this->head.load( std::memory_order_relaxed )
+				|| this->poked.load( std::memory_order_acquire );
+		} );
 
-		std::unique_ptr<M> last = std::move( queue.front( ) );
-		queue.pop( );
+		// Whoever poked gets looked at now, however we woke
+		this->poked.store( false, std::memory_order_relaxed );
+		return ready;
 
-		return last;
+	};
 
+	// Anyone -- Wake the consumer out of wait( ) without sending anything, for when it has something else to look at
+	// Unlike a push this is safe from any number of threads, pokes that land while the consumer is awake fold into one
+	void poke( ) {
+		this->poked.store( true, std::memory_order_release );
+		wake( this->consumerAsleep, this->pushed );
 	};
 
+	// Either end, or anyone else -- Wake both ends for good
+	// The consumer still gets whatever is queued, after that every wait returns false
+	void close( ) {
+
+		this->closed.store( true, std::memory_order_release );
+
+		this->pushed.fetch_add( 1, std::memory_order_release );
+		this->pushed.notify_all( );
+		this->popped.fetch_add( 1, std::memory_order_release );
+		this->popped.notify_all( );
+
+	};
+
+	// Consumer only -- Returns false if there was nothing to pop
+	bool pop( M & out ) {
+
+		size_t at = this->head.load( std::memory_order_relaxed );
+
+		if( at == this->tailSeen ) {
+			this->tailSeen = this->tail.load( std::memory_order_acquire );
+			if( at == this->tailSeen )
+				return false;
+		}
+
+		out = std::move( this->slots[ at & this->mask ] );
+		this->head.store( at + 1, std::memory_order_release );
+		wake( this->producerAsleep, this->popped );
+
+		return true;
+
+	};
+
+	// Consumer only -- Move everything available (up to max) onto the end of out, returns how many
+	// One acquire and one release for the whole batch
+	size_t pop_n( std::vector<M> & out, size_t max = std::numeric_limits<size_t>::max( ) ) {
+
+		size_t at = this->head.load( std::memory_order_relaxed );
+		this->tailSeen = this->tail.load( std::memory_order_acquire );
+
+		size_t count = std::min( this->tailSeen - at, max );
+		for( size_t idx = 0; idx < count; ++idx )
+			out.push_back( std::move( this->slots[ ( at + idx ) & this->mask ] ) );
+
+		this->head.store( at + count, std::memory_order_release );
+		if( count > 0 )
+			wake( this->producerAsleep, this->popped );
+
+		return count;
+
+	};
+
+	// Only a snapshot -- The other end may have moved on by the time you look at it
 	size_t size( ) {
 
-		std::unique_lock<std::mutex> lock( queue_mtx );
-		return queue.size( );
+		// Head first -- Tail can only have moved further on by the time we read it
+		size_t at = this->head.load( std::memory_order_acquire );
+		return this->tail.load( std::memory_order_acquire ) - at;
 
 	};
 
+	size_t capacity( ) { return this->mask + 1; };
+
 };
\ No newline at end of file
@@ -3,25 +3,58 @@
 // Since this is the middleware class, it needs to know about both incoming Keyboard events and outgoing Screen events
 #include "Keyboard.h"
 #include "Screen.h"
+#include "ScreenBatch.h"
 
 #include <vector>
+#include <functional>
 
 class Editor {
 protected:
+	// Cursor position -- currx is a display column, which is only a byte offset into the line when the line is ASCII
 	size_t currx = 0, curry = 0;
 
-	// Consume a KeyEvent -- Possibly emit a series of ScreenCommands
-	virtual std::vector<ScreenCommand> doConsumeKey( KeyEvent & key ) = 0;
+	// Called from any thread when background work has something for us -- Whoever drives us should then call poll( )
+	// FileIndexer, FileSave and RegexSearch are handed this: each runs a thread of its own, takes its work over a
+	//   Channel, and calls it from that thread whenever there's something new for the editor to poll( ) them for
+	std::function<void( )> wake;
+
+	// Consume a KeyEvent -- Possibly add a series of ScreenCommands to out
+	virtual void doConsumeKey( KeyEvent & key, ScreenBatch & out ) = 0;
+
+	// Pick up whatever background work has finished -- Possibly add ScreenCommands to out
+	virtual void doPoll( ScreenBatch & out ) { };
+
+	// Body of consumeKey, calling the hook through Self -- See Keyboard::readKeyOf
+	template<typename Self>
+	static void consumeKeyOf( Self & editor, KeyEvent & key, ScreenBatch & out ) {
+
+		if( !key.stamp ) {
+			editor.doConsumeKey( key, out );
+			return;
+		}
+
+		uint64_t start = latencyNow( );
+		latency( LatencyStage::LS_INPUT_QUEUE ).record( start - key.stamp );
+
+		out.stampWith( key.stamp );
+		editor.doConsumeKey( key, out );
+		out.stampWith( 0 );
+
+		latency( LatencyStage::LS_EDIT ).record( latencyNow( ) - start );
+
+	};
 
 public:
 	// Get current cursor position
 	std::pair<size_t, size_t> getCurrPos( ) { return { this->currx, this->curry }; };
 
-	// Consume a KeyEvent, convert to ScreenCommands -- This could potentially redraw the entire screen...
-	// TODO: Better concept for screen buffering, or more granular screen commands?
-	//   Or limit the throughput of the channel based on amount of data being sent?
-	//     That would limit overall memory usage, and the editor would just block until the screen catches up
-	//     Could be done directly in the Channel, but means this class would need to learn about Channels..
-	std::vector<ScreenCommand> consumeKey( KeyEvent & key ) { return this->doConsumeKey( key ); };
+	// Consume a KeyEvent, adding ScreenCommands to out -- This could potentially redraw the entire screen...
+	//   While the screen is behind the editor worker keeps adding to the same batch, so redraws nobody saw collapse
+	// Also records how long the key sat in the queue and how long editing took, and stamps the output with the key
+	void consumeKey( KeyEvent & key, ScreenBatch & out ) { consumeKeyOf( *this, key, out ); };
+
+	// Background work -- Set how we ask to be polled before anything starts, then poll whenever asked, on the editor thread
+	void setWake( std::function<void( )> && wake ) { this->wake = std::move( wake ); };
+	void poll( ScreenBatch & out ) { this->doPoll( out ); };
 
 };
\ No newline at end of file
@@ -1,6 +1,14 @@
 #pragma once
 
 #include "LineEditor.h"
+#include "Search.h"
+#include "RegexSearch.h"
+#include "FileSave.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <memory>
 
 // Class wrapping a LineEditor to add on modes, states, and special commands
 // Templated over the type of Editor it extends from...
@@ -8,7 +16,977 @@
 template<typename E>
 class Emacs : public E {
 protected:
+
+	// Incremental search, C-s forward and C-r backward
+	// Every key re-searches from the current match rather than from the top, so typing more of the query
+	//   only ever looks at what's between the old match and the new one
+	struct ISearch {
+
+		// Everything backspace needs to step back to
+		struct State {
+			size_t query;
+			size_t match;
+			bool forward;
+			bool failing;
+			bool wrapped;
+		};
+
+		bool active = false;
+		std::string query;
+		State at;
+
+		// Cursor when the search started, C-g goes back to it
+		size_t origin = 0;
+
+		std::vector<State> steps;
+
+	} isearch;
+
+	// Last query searched for, C-s C-s searches for it again
+	std::string lastQuery;
+
+	void searchShow( ScreenBatch & out ) {
+
+		auto & at = this->isearch.at;
+
+		// Forward the cursor sits after the match, backward before it -- Failing, it stays on the last one found
+		if( !at.failing ) {
+			this->moveTo( at.forward ? at.match + this->isearch.query.length( ) : at.match );
+			this->goalx = this->currx;
+		}
+
+		std::string prompt = std::string( at.failing ? "Failing " : "" ) + ( at.wrapped ? "Wrapped " : "" ) + "I-search"
+			+ ( at.forward ? ": " : " backward: " ) + this->isearch.query;
+		this->scrollView( out );
+		this->showEcho( out, prompt );
+
+	};
+
+	// Look for the query from the current match on -- again moves past the current match instead of staying on it
+	void searchFrom( bool again ) {
+
+		auto & at = this->isearch.at;
+		Searcher query( this->isearch.query );
+		size_t found;
+
+		if( at.forward ) {
+			size_t from = at.failing && again ? 0 : at.match + ( again ? 1 : 0 );
+			found = this->find( query, from );
+		} else {
+			size_t before = at.failing && again ? this->length( ) : at.match + ( again ? 0 : 1 );
+			found = this->findBack( query, before );
+		}
+
+		if( found == Searcher::none ) {
+			at.failing = true;
+			return;
+		}
+
+		at.wrapped |= at.failing && again;
+		at.failing = false;
+		at.match = found;
+
+	};
+
+	void searchStart( ScreenBatch & out, bool forward ) {
+		this->history.command( );
+		this->isearch.active = true;
+		this->isearch.query.clear( );
+		this->isearch.steps.clear( );
+		this->isearch.origin = this->curr;
+		this->isearch.at = { 0, this->curr, forward, false, false };
+		this->searchShow( out );
+	};
+
+	void searchEnd( ScreenBatch & out ) {
+		if( !this->isearch.query.empty( ) )
+			this->lastQuery = this->isearch.query;
+		this->isearch.active = false;
+		this->hideEcho( out );
+	};
+
+	// A key while searching -- False if it ended the search and should be handled as usual
+	bool searchKey( KeyEvent & key, ScreenBatch & out ) {
+
+		ISearch & is = this->isearch;
+
+		if( key.type == KeyEventType::KET_CONTROL && std::get<KeyEventControl>( key.event ) == KeyEventControl::CK_BKSPC ) {
+			if( !is.steps.empty( ) ) {
+				is.at = is.steps.back( );
+				is.steps.pop_back( );
+				is.query.resize( is.at.query );
+			}
+			this->searchShow( out );
+			return true;
+		}
+
+		// A paste goes on the end of the query in one go
+		if( key.type == KeyEventType::KET_PASTE ) {
+			this->searchAppend( out, *std::get<KeyEventPaste>( key.event ).text );
+			return true;
+		}
+
+		if( key.type != KeyEventType::KET_PRINT ) {
+			this->searchEnd( out );
+			return false;
+		}
+
+		KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+
+		if( prnt.ctrl && !prnt.alt && ( prnt.ascii == 's' || prnt.ascii == 'r' ) ) {
+
+			bool forward = prnt.ascii == 's';
+			is.steps.push_back( is.at );
+
+			if( is.query.empty( ) ) {
+				// Straight away, search for the last thing searched for
+				is.query = this->lastQuery;
+				is.at.forward = forward;
+				if( !is.query.empty( ) )
+					this->searchFrom( false );
+			} else if( forward != is.at.forward ) {
+				// Turning around stays on the match, the cursor just goes to its other end
+				is.at.forward = forward;
+			} else {
+				this->searchFrom( true );
+			}
+
+			is.at.query = is.query.length( );
+			this->searchShow( out );
+			return true;
+
+		}
+
+		if( prnt.ctrl && !prnt.alt && prnt.ascii == 'g' ) {
+
+			// Failing, C-g backs up to what was last found -- Otherwise it gives up and goes back to the start
+			if( is.at.failing ) {
+				while( !is.steps.empty( ) && is.at.failing ) {
+					is.at = is.steps.back( );
+					is.steps.pop_back( );
+				}
+				is.query.resize( is.at.query );
+				this->searchShow( out );
+				return true;
+			}
+
+			this->moveTo( is.origin );
+			this->goalx = this->currx;
+			this->searchEnd( out );
+			return true;
+
+		}
+
+		if( prnt.ascii == '\n' && !prnt.ctrl && !prnt.alt ) {
+			this->searchEnd( out );
+			return true;
+		}
+
+		// M-a ends the search with a cursor at the end of every match, each selecting it
+		if( prnt.alt && !prnt.ctrl && prnt.ascii == 'a' && !is.query.empty( ) ) {
+			this->searchEnd( out );
+			this->markMatches( out );
+			return true;
+		}
+
+		if( prnt.ctrl || prnt.alt || prnt.os ) {
+			this->searchEnd( out );
+			return false;
+		}
+
+		char text[ 4 ];
+		this->searchAppend( out, std::string_view( text, prnt.utf8( text ) ) );
+		return true;
+
+	};
+
+	// More on the end of the query, as one step for backspace to take back
+	void searchAppend( ScreenBatch & out, std::string_view text ) {
+		ISearch & is = this->isearch;
+		is.steps.push_back( is.at );
+		is.query.append( text );
+		is.at.query = is.query.length( );
+		if( !is.at.failing )
+			this->searchFrom( false );
+		this->searchShow( out );
+	};
+
+	// Every match of the last search gets a cursor, curr going to the one it's on -- One walk through the buffer
+	void markMatches( ScreenBatch & out ) {
+
+		Searcher query( this->lastQuery );
+		size_t len = this->lastQuery.length( );
+		auto & at = this->isearch.at;
+
+		this->dropCursors( );
+		if( !at.failing )
+			this->moveTo( at.match + len );
+		this->goalx = this->currx;
+
+		for( size_t from = 0, found; ( found = this->find( query, from ) ) != Searcher::none; from = found + len ) {
+			size_t start = this->lineStart( found + len );
+			this->addCursor( found + len, found, this->layout( start ).column( found + len - start ) );
+		}
+		if( !at.failing )
+			this->anchor = at.match;
+
+		this->scrollToCursor( );
+		this->drawAll( out );
+
+	};
+
+	// Regexp search, C-M-s
+	// The scan runs on RegexSearch's thread over a snapshot taken when the search starts, and matches turn up here as
+	//   they're found -- The first lands the cursor while the rest of the buffer is still being looked through
+	// Any key that isn't part of the search ends it, so the buffer can't change under the snapshot while we use it
+	struct RSearch {
+
+		bool active = false;
+		std::string pattern;
+		std::shared_ptr<const Snapshot> text;
+
+		// Cursor when the search started, and the line the scan starts on and wraps round to
+		size_t origin = 0;
+		size_t from = 0;
+
+		// In the order found, which is buffer order from the origin's line on, wrapping round
+		std::vector<RegexMatch> matches;
+		size_t at = Searcher::none;
+		bool forward = true;
+
+		size_t scanned = 0;
+		bool done = false;
+		bool invalid = false;
+
+	} rsearch;
+
+	// Wakes whoever polls us, from the scanning thread -- Declared after rsearch so the scan stops before it goes
+	RegexSearch regex = RegexSearch( [ this ]( ) {
+		if( this->wake )
+			this->wake( );
+	} );
+
+	void regexShow( ScreenBatch & out ) {
+
+		RSearch & rs = this->rsearch;
+
+		if( rs.at != Searcher::none ) {
+			const RegexMatch & match = rs.matches[ rs.at ];
+			this->moveTo( rs.forward ? match.off + match.len : match.off );
+			this->goalx = this->currx;
+		}
+
+		std::string prompt = "Regexp search: " + rs.pattern;
+		if( rs.invalid )
+			prompt += "  [invalid]";
+		else if( !rs.pattern.empty( ) ) {
+			prompt += "  [";
+			if( rs.at != Searcher::none )
+				prompt += std::to_string( rs.at + 1 ) + "/";
+			prompt += std::to_string( rs.matches.size( ) ) + " matches";
+			if( !rs.done && rs.text->length > 0 )
+				prompt += ", scanning " + std::to_string( rs.scanned * 100 / rs.text->length ) + "%";
+			prompt += "]";
+		}
+
+		this->scrollView( out );
+		this->showEcho( out, prompt );
+
+	};
+
+	// The pattern changed -- Drop what the last one found and scan again, from the start line
+	void regexRestart( ) {
+
+		RSearch & rs = this->rsearch;
+		rs.matches.clear( );
+		rs.at = Searcher::none;
+		rs.scanned = 0;
+		rs.invalid = false;
+		rs.done = rs.pattern.empty( );
+
+		if( rs.done )
+			this->regex.cancel( );
+		else
+			this->regex.start( rs.text, rs.pattern, rs.from );
+
+		this->moveTo( rs.origin );
+		this->goalx = this->currx;
+
+	};
+
+	void regexStart( ScreenBatch & out ) {
+		RSearch & rs = this->rsearch;
+		this->history.command( );
+		rs.active = true;
+		rs.pattern.clear( );
+		rs.text = this->snapshot( );
+		rs.origin = this->curr;
+		rs.from = this->lineStart( this->curr );
+		rs.forward = true;
+		this->regexRestart( );
+		this->regexShow( out );
+	};
+
+	void regexEnd( ScreenBatch & out ) {
+		this->regex.cancel( );
+		this->rsearch.active = false;
+		this->rsearch.text.reset( );
+		this->rsearch.matches.clear( );
+		this->hideEcho( out );
+	};
+
+	// A key while regexp searching -- False if it ended the search and should be handled as usual
+	bool regexKey( KeyEvent & key, ScreenBatch & out ) {
+
+		RSearch & rs = this->rsearch;
+
+		if( key.type == KeyEventType::KET_CONTROL && std::get<KeyEventControl>( key.event ) == KeyEventControl::CK_BKSPC ) {
+			if( !rs.pattern.empty( ) ) {
+				// A whole character, not the last byte of one
+				while( rs.pattern.size( ) > 1 && ( (unsigned char)rs.pattern.back( ) & 0xC0 ) == 0x80 )
+					rs.pattern.pop_back( );
+				rs.pattern.pop_back( );
+				this->regexRestart( );
+			}
+			this->regexShow( out );
+			return true;
+		}
+
+		if( key.type != KeyEventType::KET_PRINT ) {
+			this->regexEnd( out );
+			return false;
+		}
+
+		KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+
+		// C-s and C-r step through what's been found so far -- Forward stops at the last one until the scan is done
+		if( prnt.ctrl && ( prnt.ascii == 's' || prnt.ascii == 'r' ) ) {
+
+			rs.forward = prnt.ascii == 's';
+			size_t count = rs.matches.size( );
+
+			if( count > 0 ) {
+				if( rs.at == Searcher::none )
+					rs.at = 0;
+				else if( rs.forward && ( rs.at + 1 < count || rs.done ) )
+					rs.at = ( rs.at + 1 ) % count;
+				else if( !rs.forward )
+					rs.at = ( rs.at + count - 1 ) % count;
+			}
+
+			this->regexShow( out );
+			return true;
+
+		}
+
+		if( prnt.ctrl && !prnt.alt && prnt.ascii == 'g' ) {
+			this->moveTo( rs.origin );
+			this->goalx = this->currx;
+			this->regexEnd( out );
+			return true;
+		}
+
+		if( prnt.ascii == '\n' && !prnt.ctrl && !prnt.alt ) {
+			this->regexEnd( out );
+			return true;
+		}
+
+		if( prnt.ctrl || prnt.alt || prnt.os ) {
+			this->regexEnd( out );
+			return false;
+		}
+
+		char text[ 4 ];
+		rs.pattern.append( text, prnt.utf8( text ) );
+		this->regexRestart( );
+		this->regexShow( out );
+		return true;
+
+	};
+
+	// Matches from the scan -- The first one at or after where we started is where the cursor goes
+	void doPoll( ScreenBatch & out ) {
+
+		E::doPoll( out );
+		this->loadPoll( out );
+		this->savePoll( out );
+		this->diskPoll( out );
+
+		RSearch & rs = this->rsearch;
+		if( !rs.active )
+			return;
+
+		RegexResults batch;
+		bool any = false;
+		while( this->regex.poll( batch ) ) {
+			rs.matches.insert( rs.matches.end( ), batch.matches.begin( ), batch.matches.end( ) );
+			rs.scanned = batch.scanned;
+			rs.done |= batch.done;
+			rs.invalid |= batch.invalid;
+			any = true;
+		}
+
+		if( !any )
+			return;
+
+		// Matches before the origin on its own line come first, everything else is in order from there
+		for( size_t idx = 0; rs.at == Searcher::none && idx < rs.matches.size( ); ++idx )
+			if( rs.matches[ idx ].off >= rs.origin || rs.matches[ idx ].off < rs.from )
+				rs.at = idx;
+		if( rs.at == Searcher::none && rs.done && !rs.matches.empty( ) )
+			rs.at = 0;
+
+		this->regexShow( out );
+		this->placeCursor( out );
+
+	};
+
+	// Save, C-x C-s -- The text is snapshotted and written out on FileSave's thread, typing carries on meanwhile
+	struct Saving {
+		std::string path;
+		Durability durability = Durability::DU_DIRECTORY;
+
+		// Latest save started, and whether it's still going
+		uint64_t save = 0;
+		bool busy = false;
+	} saving;
+
+	// The file we were loaded from, when it's a mapping -- Somebody else writing to it shows straight through, and
+	//   cutting it short leaves zeros where the lost text was, so both get mentioned, and saving the zeros back
+	//   waits for C-x C-s a second time in a row
+	// Our own saves rename a new file over it and leave the mapped one be, so after one we stop watching
+	struct Disk {
+		std::shared_ptr<MappedFile> file;
+		bool toldChanged = false;
+		bool toldTruncated = false;
+		bool confirm = false;
+
+		// A stat a key is cheap, but not free
+		uint64_t checked = 0;
+	} disk;
+
+	static constexpr uint64_t diskInterval = 1000000000;
+
+	// Loading and saving say how they're going in the echo area unless a prompt is using it, and the note stays up
+	//   until a key after they're both done
+	bool noted = false;
+
+	// The file is still being read in, and how far it had got when that was last shown
+	bool loading = false;
+	size_t loadShown = 0;
+
+	// C-x, waiting for the key that goes with it
+	bool ctrlX = false;
+
+	// C-u, and the count typed after it -- Only C-x e takes any notice of it for now
+	struct Argument {
+		bool reading = false;
+		bool typed = false;
+		size_t count = 0;
+	} argument;
+
+	// Keyboard macros, C-x ( to start recording, C-x ) to stop and C-x e to play back
+	// Playing back calls straight through to doConsumeKey with drawing held, so however many times it runs the
+	//   screen gets one redraw at the end, and the keys never go near the keyboard's channel
+	struct Macro {
+		bool recording = false;
+		bool playing = false;
+		std::vector<KeyEvent> keys;
+
+		// The last macro recorded, while another is being
+		std::vector<KeyEvent> last;
+	} macro;
+
+	// Wakes whoever polls us, from the writing thread
+	FileSave saver = FileSave( [ this ]( ) {
+		if( this->wake )
+			this->wake( );
+	} );
+
+	bool prompting( ) const { return this->isearch.active || this->rsearch.active || this->gotoLine.active || this->argument.reading; };
+
+	void note( ScreenBatch & out, const std::string & text ) {
+		if( this->prompting( ) )
+			return;
+		this->showEcho( out, text );
+		this->noted = true;
+	};
+
+	// How far the file has been read, each time it gets further -- Then how many lines it came to, and whether
+	//   any of it wasn't UTF-8
+	void loadPoll( ScreenBatch & out ) {
+
+		typename E::LoadStatus status = this->loadStatus( );
+		if( !status.loading && !this->loading )
+			return;
+		if( status.loading && status.read == this->loadShown )
+			return;
+
+		std::string name = this->saving.path.empty( ) ? "file" : this->saving.path;
+		if( status.loading ) {
+			this->note( out, "Loading " + name + ": " + std::to_string( status.lines ) + " lines, "
+				+ std::to_string( status.total ? status.read * 100 / status.total : 100 ) + "%" );
+		} else {
+			std::string invalid = status.invalid ? ", " + std::to_string( status.invalid ) + " bytes not UTF-8" : "";
+			this->note( out, "Loaded " + name + ": " + std::to_string( status.lines ) + " lines" + invalid );
+		}
+
+		this->loading = status.loading;
+		this->loadShown = status.read;
+		this->placeCursor( out );
+
+	};
+
+	// Whether the file changed under us, or lost text -- Each is told once, while no prompt is up to hide it
+	void diskPoll( ScreenBatch & out ) {
+
+		Disk & dk = this->disk;
+		if( !dk.file || dk.toldTruncated || this->prompting( ) )
+			return;
+
+		uint64_t now = latencyNow( );
+		if( now - dk.checked < diskInterval )
+			return;
+		dk.checked = now;
+
+		if( !dk.file->changed( ) )
+			return;
+
+		std::string name = this->saving.path.empty( ) ? "file" : this->saving.path;
+		if( dk.file->truncated( ) ) {
+			dk.toldTruncated = true;
+			this->note( out, name + " was truncated on disk, the lost text reads as zeros" );
+		} else if( !dk.toldChanged ) {
+			dk.toldChanged = true;
+			this->note( out, name + " changed on disk" );
+		} else {
+			return;
+		}
+
+		this->placeCursor( out );
+
+	};
+
+	// confirmed if this is the C-x C-s straight after one that was asked to be repeated
+	void saveStart( ScreenBatch & out, bool confirmed ) {
+
+		Saving & sv = this->saving;
+		if( sv.path.empty( ) ) {
+			this->note( out, "No file to save to" );
+			return;
+		}
+
+		Disk & dk = this->disk;
+		bool changed = dk.file && dk.file->changed( );
+		if( changed && dk.file->truncated( ) && !confirmed ) {
+			dk.confirm = true;
+			dk.toldTruncated = true;
+			this->note( out, "C-x C-s again to save zeros over the text lost from " + sv.path );
+			return;
+		}
+
+		sv.save = this->saver.start( this->snapshot( ), sv.path, sv.durability );
+		sv.busy = true;
+		this->note( out, "Saving " + sv.path + ( changed ? " over changes on disk..." : "..." ) );
+
+	};
+
+	// Where the saves have got to -- Failures always show, progress only for the latest
+	void savePoll( ScreenBatch & out ) {
+
+		Saving & sv = this->saving;
+		SaveProgress progress;
+		bool any = false;
+
+		while( this->saver.poll( progress ) ) {
+
+			if( !progress.error.empty( ) ) {
+				this->note( out, "Saving " + sv.path + " failed: " + progress.error );
+			} else if( progress.save != sv.save ) {
+				continue;
+			} else if( progress.done ) {
+				this->disk.file.reset( );
+				this->note( out, "Wrote " + sv.path + " (" + std::to_string( progress.total ) + " bytes)" );
+			} else {
+				size_t percent = progress.total ? progress.written * 100 / progress.total : 100;
+				this->note( out, "Saving " + sv.path + "... " + std::to_string( percent ) + "%" );
+			}
+
+			sv.busy &= !( progress.done && progress.save == sv.save );
+			any = true;
+
+		}
+
+		if( any )
+			this->placeCursor( out );
+
+	};
+
+	// Goto line, M-g g or M-g M-g -- The number is read in the echo area, then the jump is one index lookup
+	struct GotoLine {
+		bool prefix = false;
+		bool active = false;
+		std::string digits;
+	} gotoLine;
+
+	void gotoShow( ScreenBatch & out ) {
+		this->showEcho( out, "Goto line: " + this->gotoLine.digits );
+	};
+
+	// A key while reading the line number -- False if it ended the prompt and should be handled as usual
+	bool gotoKey( KeyEvent & key, ScreenBatch & out ) {
+
+		GotoLine & gl = this->gotoLine;
+
+		if( key.type == KeyEventType::KET_CONTROL && std::get<KeyEventControl>( key.event ) == KeyEventControl::CK_BKSPC ) {
+			if( !gl.digits.empty( ) )
+				gl.digits.pop_back( );
+			this->gotoShow( out );
+			return true;
+		}
+
+		if( key.type != KeyEventType::KET_PRINT ) {
+			gl.active = false;
+			this->hideEcho( out );
+			return false;
+		}
+
+		KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+		bool plain = !prnt.ctrl && !prnt.alt && !prnt.os;
+
+		if( plain && prnt.ascii >= '0' && prnt.ascii <= '9' ) {
+			// Anything longer is past the end of any buffer anyway
+			if( gl.digits.length( ) < 18 )
+				gl.digits.push_back( prnt.ascii );
+			this->gotoShow( out );
+			return true;
+		}
+
+		if( plain && prnt.ascii == '\n' ) {
+			// Lines count from 1 out here
+			if( !gl.digits.empty( ) ) {
+				size_t line = std::stoull( gl.digits );
+				this->goalx = 0;
+				this->moveToLine( line > 0 ? line - 1 : 0 );
+			}
+			gl.active = false;
+			this->hideEcho( out );
+			return true;
+		}
+
+		// C-g gives up, other chords end the prompt and go through as usual -- Anything else typed is dropped
+		gl.active = false;
+		this->hideEcho( out );
+		return plain || ( prnt.ctrl && !prnt.alt && prnt.ascii == 'g' );
+
+	};
+
+	void argumentShow( ScreenBatch & out ) {
+		Argument & arg = this->argument;
+		this->showEcho( out, arg.typed ? "C-u " + std::to_string( arg.count ) + "-" : "C-u-" );
+	};
+
+	// A key after C-u -- Digits make up the count, C-u again multiplies it by four, anything else ends it
+	bool argumentKey( KeyEvent & key, ScreenBatch & out ) {
+
+		Argument & arg = this->argument;
+
+		if( key.type == KeyEventType::KET_PRINT ) {
+			KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+			bool plain = !prnt.ctrl && !prnt.alt && !prnt.os;
+
+			if( plain && prnt.ascii >= '0' && prnt.ascii <= '9' ) {
+				// Capped well before it overflows, nobody's waiting that long anyway
+				if( arg.count < 100000000 )
+					arg.count = ( arg.typed ? arg.count * 10 : 0 ) + ( prnt.ascii - '0' );
+				arg.typed = true;
+				this->argumentShow( out );
+				return true;
+			}
+
+			if( prnt.ctrl && !prnt.alt && prnt.ascii == 'u' && !arg.typed ) {
+				arg.count = std::min<size_t>( arg.count * 4, 100000000 );
+				this->argumentShow( out );
+				return true;
+			}
+		}
+
+		arg.reading = false;
+		this->hideEcho( out );
+		return false;
+
+	};
+
+	// C-x ( -- Keys are recorded as they're handled, so what gets kept is what they were, before any translating
+	void macroStart( ScreenBatch & out ) {
+		this->macro.recording = true;
+		this->macro.last = std::move( this->macro.keys );
+		this->macro.keys.clear( );
+		this->note( out, "Defining keyboard macro..." );
+	};
+
+	// C-x ) -- With nothing recorded, the macro from before stays
+	void macroEnd( ScreenBatch & out ) {
+		Macro & mc = this->macro;
+		mc.recording = false;
+		if( mc.keys.empty( ) )
+			mc.keys = std::move( mc.last );
+		mc.last.clear( );
+		this->note( out, "Keyboard macro defined" );
+	};
+
+	// C-x e, times times over
+	void macroPlay( ScreenBatch & out, size_t times ) {
+
+		Macro & mc = this->macro;
+		if( mc.keys.empty( ) ) {
+			this->note( out, "No keyboard macro defined" );
+			return;
+		}
+
+		mc.playing = true;
+		this->holdDrawing( );
+
+		// Each key is handled as it was, so copied -- The handlers are free to change what they're given
+		for( size_t run = 0; run < times; ++run ) {
+			for( const KeyEvent & recorded : mc.keys ) {
+				KeyEvent key = recorded;
+				this->doConsumeKey( key, out );
+			}
+		}
+
+		mc.playing = false;
+		this->releaseDrawing( out );
+
+	};
+
+public:
+
+	// Where C-x C-s saves to, and how safely
+	void setPath( const std::string & path ) { this->saving.path = path; };
+	void setDurability( Durability durability ) { this->saving.durability = durability; };
+
+	// Keep an eye on the file the text was mapped from
+	void watchFile( std::shared_ptr<MappedFile> file ) { this->disk = { std::move( file ) }; };
+
+protected:
+
+	// Translate the basic movement chords into the control keys the backend understands
+	KeyEventControl translate( KeyEventPrintable & prnt ) {
+
+		if( prnt.ctrl && !prnt.alt ) {
+			switch( prnt.ascii ) {
+			case 'f': return KeyEventControl::CK_RIGHT;
+			case 'b': return KeyEventControl::CK_LEFT;
+			case 'n': return KeyEventControl::CK_DOWN;
+			case 'p': return KeyEventControl::CK_UP;
+			case 'a': return KeyEventControl::CK_HOME;
+			case 'e': return KeyEventControl::CK_END;
+			case 'd': return KeyEventControl::CK_DEL;
+			case 'v': return KeyEventControl::CK_PGDN;
+			}
+		} else if( prnt.alt && !prnt.ctrl ) {
+			switch( prnt.ascii ) {
+			case 'v': return KeyEventControl::CK_PGUP;
+			}
+		}
+
+		return KeyEventControl::CK_ERROR;
+
+	};
 	
-	std::vector<ScreenCommand> doConsumeKey( KeyEvent & key ) { return E::doConsumeKey( key ); };
+	void doConsumeKey( KeyEvent & key, ScreenBatch & out ) {
+
+		// Resizes aren't anything the user did, so aren't part of a macro
+		if( this->macro.recording && !this->macro.playing && key.type != KeyEventType::KET_RESIZE ) {
+			this->macro.keys.push_back( key );
+			this->macro.keys.back( ).stamp = 0;
+		}
+
+		// A load's or a save's done message goes with the next key
+		if( this->noted && !this->saving.busy && !this->loading ) {
+			this->noted = false;
+			if( !this->prompting( ) )
+				this->hideEcho( out );
+		}
+
+		// Saving over lost text needs C-x C-s twice running, anything else in between calls it off
+		bool confirmed = this->disk.confirm;
+		if( key.type != KeyEventType::KET_RESIZE ) {
+			bool prefix = false;
+			if( key.type == KeyEventType::KET_PRINT ) {
+				KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+				prefix = prnt.ctrl && !prnt.alt && prnt.ascii == 'x';
+			}
+			this->disk.confirm &= prefix && !this->ctrlX;
+		}
+
+		if( this->rsearch.active ) {
+			bool handled = this->regexKey( key, out );
+			if( handled ) {
+				this->placeCursor( out );
+				return;
+			}
+		}
+
+		if( this->gotoLine.active ) {
+			bool handled = this->gotoKey( key, out );
+			if( handled ) {
+				this->placeCursor( out );
+				return;
+			}
+		}
+
+		if( this->argument.reading ) {
+			bool handled = this->argumentKey( key, out );
+			if( handled ) {
+				this->placeCursor( out );
+				return;
+			}
+		}
+
+		// The count goes to this key, or to the one after it if this is C-x
+		size_t count = this->argument.count;
+		this->argument.count = 0;
+
+		// Whatever follows M-g, the prefix is used up -- Only g means anything after it for now
+		if( this->gotoLine.prefix ) {
+			this->gotoLine.prefix = false;
+			if( key.type == KeyEventType::KET_PRINT ) {
+				KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+				if( !prnt.ctrl && prnt.ascii == 'g' ) {
+					this->history.command( );
+					this->gotoLine.active = true;
+					this->gotoLine.digits.clear( );
+					this->gotoShow( out );
+					this->placeCursor( out );
+				}
+			}
+			return;
+		}
+
+		// Same for C-x, only C-s and the macro keys mean anything after it for now
+		if( this->ctrlX ) {
+			this->ctrlX = false;
+			if( key.type != KeyEventType::KET_PRINT )
+				return;
+
+			KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+			if( prnt.ctrl && !prnt.alt && prnt.ascii == 's' ) {
+				this->saveStart( out, confirmed );
+				this->placeCursor( out );
+				return;
+			}
+
+			bool plain = !prnt.ctrl && !prnt.alt && !prnt.os;
+			if( !plain || ( prnt.ascii != '(' && prnt.ascii != ')' && prnt.ascii != 'e' ) )
+				return;
+
+			// Macro keys are never part of the macro -- Out comes this one and the C-x before it
+			Macro & mc = this->macro;
+			if( mc.recording )
+				mc.keys.resize( mc.keys.size( ) >= 2 ? mc.keys.size( ) - 2 : 0 );
+
+			if( prnt.ascii == '(' && !mc.recording )
+				this->macroStart( out );
+			else if( prnt.ascii == ')' && mc.recording )
+				this->macroEnd( out );
+			else if( prnt.ascii == 'e' && !mc.recording && !mc.playing )
+				this->macroPlay( out, std::max<size_t>( count, 1 ) );
+			else
+				this->note( out, mc.recording ? "Already defining a keyboard macro" : "Not defining a keyboard macro" );
+
+			this->placeCursor( out );
+			return;
+		}
+
+		if( this->isearch.active ) {
+			bool handled = this->searchKey( key, out );
+			if( handled ) {
+				this->placeCursor( out );
+				return;
+			}
+		}
+
+		if( key.type == KeyEventType::KET_PRINT ) {
+			KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+
+			if( prnt.alt && !prnt.ctrl && prnt.ascii == 'g' ) {
+				this->gotoLine.prefix = true;
+				return;
+			}
+
+			if( prnt.ctrl && !prnt.alt && prnt.ascii == 'x' ) {
+				this->ctrlX = true;
+				this->argument.count = count;
+				return;
+			}
+
+			if( prnt.ctrl && !prnt.alt && prnt.ascii == 'u' ) {
+				this->argument = { true, false, 4 };
+				this->argumentShow( out );
+				this->placeCursor( out );
+				return;
+			}
+
+			// M-n and M-p put another cursor on the line below the last one or above the first, C-g goes back to one
+			if( prnt.alt && !prnt.ctrl && ( prnt.ascii == 'n' || prnt.ascii == 'p' ) ) {
+				this->history.command( );
+				this->addCursorLine( prnt.ascii == 'n' );
+				this->drawAll( out );
+				this->placeCursor( out );
+				return;
+			}
+
+			if( prnt.ctrl && !prnt.alt && prnt.ascii == 'g' && !this->cursors.empty( ) ) {
+				this->dropCursors( );
+				this->drawAll( out );
+				this->placeCursor( out );
+				return;
+			}
+
+			// M-< and M-> -- The end waits for the whole file, its line number counts every newline before it
+			if( prnt.alt && !prnt.ctrl && ( prnt.ascii == '<' || prnt.ascii == '>' ) ) {
+				this->history.command( );
+				if( prnt.ascii == '>' )
+					this->awaitOffset( (size_t)-1 );
+				this->moveTo( prnt.ascii == '<' ? 0 : this->length( ) );
+				this->goalx = this->currx;
+				this->scrollView( out );
+				this->placeCursor( out );
+				return;
+			}
+
+			if( prnt.ctrl && prnt.alt && prnt.ascii == 's' ) {
+				this->regexStart( out );
+				this->placeCursor( out );
+				return;
+			}
+
+			if( prnt.ctrl && !prnt.alt && ( prnt.ascii == 's' || prnt.ascii == 'r' ) ) {
+				this->searchStart( out, prnt.ascii == 's' );
+				this->placeCursor( out );
+				return;
+			}
+
+			// C-/ and C-_ undo, with C-M- in front they're undo-redo -- Terminals send the same byte for both
+			if( prnt.ctrl && ( prnt.ascii == '_' || prnt.ascii == '/' ) ) {
+				if( prnt.alt )
+					this->redo( out );
+				else
+					this->undo( out );
+				return;
+			}
+
+			KeyEventControl ck = this->translate( prnt );
+			if( ck != KeyEventControl::CK_ERROR ) {
+				KeyEvent translated( ck );
+				return E::doConsumeKey( translated, out );
+			}
+		}
+
+		return E::doConsumeKey( key, out );
+
+	};
 
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "FileIndexer.h"
+#include "Search.h"
+#include "Utf8.h"
+
+#include <string_view>
+#include <algorithm>
+
+size_t FileIndexer::cut( const char * data, size_t start, size_t size, size_t want ) {
+
+	size_t end = start + std::min( want, size - start );
+	if( end == size )
+		return end;
+
+	size_t lf = std::string_view( data + start, end - start ).rfind( '\n' );
+	if( lf != std::string_view::npos )
+		return start + lf + 1;
+
+	// One long line -- Cut before the character that straddles the end, so both chunks still decode
+	size_t back = end;
+	while( back > start && end - back < 3 && ( (unsigned char)data[ back ] & 0xC0 ) == 0x80 )
+		--back;
+	return back > start ? back : end;
+
+};
+
+IndexedChunk FileIndexer::index( const char * data, size_t start, size_t len ) {
+
+	IndexedChunk chunk;
+	chunk.start = start;
+	chunk.len = len;
+
+	// Count first so the offsets are allocated once, both passes run at memory speed
+	chunk.lines.reserve( countNewlines( data + start, len ) );
+	findNewlines( data + start, len, start, chunk.lines );
+	chunk.invalid = utf8Invalid( data + start, len );
+
+	return chunk;
+
+};
+
+FileIndexer::FileIndexer( const char * data, size_t from, size_t size, std::shared_ptr<const void> owner, std::function<void( )> wake )
+	: owner( std::move( owner ) ), data( data ), from( from ), size( size ), wake( std::move( wake ) ) {
+
+	this->worker = std::thread( &FileIndexer::run, this );
+
+};
+
+FileIndexer::~FileIndexer( ) {
+
+	// Whatever the worker is part way through is dropped along with anything still queued
+	this->stopping.store( true, std::memory_order_relaxed );
+	this->chunks.close( );
+	if( this->worker.joinable( ) )
+		this->worker.join( );
+
+};
+
+bool FileIndexer::poll( IndexedChunk & out ) {
+	return this->chunks.pop( out );
+};
+
+bool FileIndexer::wait( IndexedChunk & out ) {
+
+	while( this->chunks.wait( ) )
+		if( this->chunks.pop( out ) )
+			return true;
+	return false;
+
+};
+
+void FileIndexer::run( ) {
+
+	size_t at = this->from;
+	while( at < this->size && !this->stopping.load( std::memory_order_relaxed ) ) {
+
+		IndexedChunk chunk = index( this->data, at, cut( this->data, at, this->size, chunkSize ) - at );
+		at += chunk.len;
+		chunk.done = at == this->size;
+
+		if( !this->chunks.push( std::move( chunk ) ) )
+			return;
+		if( this->wake )
+			this->wake( );
+
+	}
+
+	// Nothing more is coming, so a wait for it comes straight back
+	this->chunks.close( );
+
+};
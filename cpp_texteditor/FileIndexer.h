@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Channel.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// A stretch of a file that's been read through -- Where every newline in it is, and how much of it isn't UTF-8
+struct IndexedChunk {
+	size_t start = 0;
+	size_t len = 0;
+
+	// Offsets from the start of the file, in order
+	std::vector<size_t> lines;
+	size_t invalid = 0;
+
+	// Nothing comes after this one
+	bool done = false;
+};
+
+// Reads the rest of a file on a worker thread, once the editor has what it needs for the first screen
+// The text is handed over a chunk at a time, each ending just after a newline where there is one, so a line only
+//   ever splits across chunks if it's longer than a whole chunk, and a character never does
+// The editor can also block with wait( ) when a key needs text that isn't there yet -- Chunks it hasn't got to
+//   back up and hold the reading up, so however far ahead the disk is the index never takes more than a few
+//   chunks' memory on top of its own
+class FileIndexer {
+protected:
+
+	Channel<IndexedChunk> chunks = Channel<IndexedChunk>( 8 );
+
+	// Keeps the bytes there for as long as we're reading them
+	std::shared_ptr<const void> owner;
+	const char * data;
+	size_t from;
+	size_t size;
+
+	std::atomic<bool> stopping = false;
+
+	std::function<void( )> wake;
+	std::thread worker;
+
+	void run( );
+
+public:
+
+	// Each chunk the worker reads -- Big enough that a wakeup per chunk is nothing, small enough to show progress
+	static constexpr size_t chunkSize = 4 << 20;
+
+	// Where a chunk starting at start and wanting up to want bytes should end
+	static size_t cut( const char * data, size_t start, size_t size, size_t want );
+
+	// Read through [ start, start + len ) -- Here rather than on the worker for the part the first screen needs
+	static IndexedChunk index( const char * data, size_t start, size_t len );
+
+	// Read [ from, size ) of data, which owner keeps alive -- Starts reading straight away
+	FileIndexer( const char * data, size_t from, size_t size, std::shared_ptr<const void> owner, std::function<void( )> wake );
+	~FileIndexer( );
+
+	FileIndexer( const FileIndexer & ) = delete;
+	FileIndexer & operator=( const FileIndexer & ) = delete;
+
+	// Editor thread -- The next chunk if it's ready, false if not
+	bool poll( IndexedChunk & out );
+
+	// Editor thread -- The next chunk, waiting for it if need be, false if there are no more
+	bool wait( IndexedChunk & out );
+
+};
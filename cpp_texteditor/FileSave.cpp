@@ -0,0 +1,301 @@
+#include "FileSave.h"
+
+#include <system_error>
+#include <algorithm>
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+	// The new text, written next to the file it's going to replace so the rename stays on one filesystem
+	// Named for our process and the save, so two editors saving the same file don't write over each other's
+	class TempFile {
+
+		std::string temp;
+		bool open = false;
+		bool placed = false;
+
+#ifdef _WIN32
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+
+		[[noreturn]] static void fail( const char * what ) {
+			throw std::system_error( std::error_code( GetLastError( ), std::system_category( ) ), what );
+		};
+
+	public:
+
+		void create( const std::string & path, uint64_t save ) {
+			this->temp = path + ".save-" + std::to_string( GetCurrentProcessId( ) ) + "-" + std::to_string( save );
+			this->hFile = CreateFileA( this->temp.c_str( ), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+			if( this->hFile == INVALID_HANDLE_VALUE )
+				fail( "Failed to create the new file!" );
+			this->open = true;
+		};
+
+		void write( const char * data, size_t len ) {
+			while( len > 0 ) {
+				DWORD wrote;
+				if( !WriteFile( this->hFile, data, (DWORD)std::min<size_t>( len, 1 << 30 ), &wrote, NULL ) )
+					fail( "Failed to write the new file!" );
+				data += wrote;
+				len -= wrote;
+			}
+		};
+
+		void sync( ) {
+			if( !FlushFileBuffers( this->hFile ) )
+				fail( "Failed to flush the new file!" );
+		};
+
+		void close( ) {
+			this->open = false;
+			if( !CloseHandle( this->hFile ) )
+				fail( "Failed to close the new file!" );
+		};
+
+		// There's no flushing a directory here -- Write through has the move itself go to disk before it returns
+		void place( const std::string & path, Durability durability ) {
+			DWORD flags = MOVEFILE_REPLACE_EXISTING | ( durability == Durability::DU_DIRECTORY ? MOVEFILE_WRITE_THROUGH : 0 );
+			if( !MoveFileExA( this->temp.c_str( ), path.c_str( ), flags ) )
+				fail( "Failed to replace the file!" );
+			this->placed = true;
+		};
+
+		~TempFile( ) {
+			if( this->open )
+				CloseHandle( this->hFile );
+			if( !this->temp.empty( ) && !this->placed )
+				DeleteFileA( this->temp.c_str( ) );
+		};
+#else
+		int fd = -1;
+
+		[[noreturn]] static void fail( const char * what ) {
+			throw std::system_error( std::error_code( errno, std::system_category( ) ), what );
+		};
+
+	public:
+
+		void create( const std::string & path, uint64_t save ) {
+
+			this->temp = path + ".save-" + std::to_string( getpid( ) ) + "-" + std::to_string( save );
+			this->fd = ::open( this->temp.c_str( ), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666 );
+			if( this->fd < 0 )
+				fail( "Failed to create the new file!" );
+			this->open = true;
+
+			// Replacing a file keeps its permissions -- A new one gets the umask like anything else
+			struct stat st;
+			if( stat( path.c_str( ), &st ) == 0 && fchmod( this->fd, st.st_mode & 07777 ) != 0 )
+				fail( "Failed to set permissions on the new file!" );
+
+		};
+
+		void write( const char * data, size_t len ) {
+			while( len > 0 ) {
+				ssize_t wrote = ::write( this->fd, data, len );
+				if( wrote < 0 ) {
+					if( errno == EINTR )
+						continue;
+					fail( "Failed to write the new file!" );
+				}
+				data += wrote;
+				len -= (size_t)wrote;
+			}
+		};
+
+		void sync( ) {
+			if( fsync( this->fd ) != 0 )
+				fail( "Failed to flush the new file!" );
+		};
+
+		// NFS can hold write errors back until now
+		void close( ) {
+			this->open = false;
+			if( ::close( this->fd ) != 0 )
+				fail( "Failed to close the new file!" );
+		};
+
+		void place( const std::string & path, Durability durability ) {
+
+			if( rename( this->temp.c_str( ), path.c_str( ) ) != 0 )
+				fail( "Failed to replace the file!" );
+			this->placed = true;
+
+			if( durability != Durability::DU_DIRECTORY )
+				return;
+
+			size_t slash = path.find_last_of( '/' );
+			std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr( 0, slash );
+			int dirFd = ::open( dir.c_str( ), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+			if( dirFd < 0 )
+				fail( "Saved, but failed to open the directory to flush it!" );
+			int synced = fsync( dirFd );
+			int err = errno;
+			::close( dirFd );
+			errno = err;
+			if( synced != 0 )
+				fail( "Saved, but failed to flush the directory!" );
+
+		};
+
+		~TempFile( ) {
+			if( this->open )
+				::close( this->fd );
+			if( !this->temp.empty( ) && !this->placed )
+				unlink( this->temp.c_str( ) );
+		};
+#endif
+
+	};
+
+}
+
+FileSave::FileSave( std::function<void( )> wake ) : wake( std::move( wake ) ) { };
+
+FileSave::~FileSave( ) {
+
+	// Closing still lets the worker finish what's queued
+	this->jobs.close( );
+	if( this->worker.joinable( ) )
+		this->worker.join( );
+
+};
+
+uint64_t FileSave::start( std::shared_ptr<const Snapshot> text, const std::string & path, Durability durability ) {
+
+	// Nothing's written until somebody saves
+	if( !this->worker.joinable( ) )
+		this->worker = std::thread( &FileSave::run, this );
+
+	Job job;
+	job.save = ++this->started;
+	job.path = path;
+	job.text = std::move( text );
+	job.durability = durability;
+
+	uint64_t save = job.save;
+	this->jobs.push( std::move( job ) );
+	return save;
+
+};
+
+bool FileSave::poll( SaveProgress & out ) {
+
+	std::unique_lock<std::mutex> lock( this->progressMtx );
+
+	if( !this->finished.empty( ) ) {
+		out = std::move( this->finished.front( ) );
+		this->finished.erase( this->finished.begin( ) );
+		return true;
+	}
+
+	if( this->fresh ) {
+		out = this->running;
+		this->fresh = false;
+		return true;
+	}
+
+	return false;
+
+};
+
+void FileSave::report( SaveProgress & progress ) {
+
+	{
+		std::unique_lock<std::mutex> lock( this->progressMtx );
+		if( progress.done ) {
+			this->finished.push_back( progress );
+			this->fresh = false;
+		} else {
+			this->running = progress;
+			this->fresh = true;
+		}
+	}
+
+	if( this->wake )
+		this->wake( );
+
+};
+
+void FileSave::run( ) {
+
+	std::vector<Job> waiting;
+
+	while( this->jobs.wait( ) ) {
+
+		waiting.clear( );
+		this->jobs.pop_n( waiting );
+
+		for( auto job = waiting.begin( ); job != waiting.end( ); ++job ) {
+			// A newer save of the same file right behind it writes everything this one would
+			bool superseded = std::any_of( job + 1, waiting.end( ), [ & ]( const Job & later ) { return later.path == job->path; } );
+			if( !superseded )
+				this->write( *job );
+		}
+
+	}
+
+};
+
+void FileSave::write( Job & job ) {
+
+	SaveProgress progress;
+	progress.save = job.save;
+	progress.total = job.text->length;
+
+	try {
+
+		TempFile out;
+		out.create( job.path, job.save );
+
+		auto send = [ & ]( const char * data, size_t len ) {
+			out.write( data, len );
+			progress.written += len;
+			this->report( progress );
+		};
+
+		// Pieces of a much edited buffer can be a few bytes each, so they're gathered up first
+		std::string staged;
+		staged.reserve( writeSize );
+
+		for( std::string_view chunk : job.text->chunks ) {
+
+			if( !staged.empty( ) && staged.size( ) + chunk.length( ) > writeSize ) {
+				send( staged.data( ), staged.size( ) );
+				staged.clear( );
+			}
+
+			if( chunk.length( ) < writeSize ) {
+				staged.append( chunk );
+				continue;
+			}
+
+			for( size_t off = 0; off < chunk.length( ); off += writeSize )
+				send( chunk.data( ) + off, std::min( writeSize, chunk.length( ) - off ) );
+
+		}
+
+		if( !staged.empty( ) )
+			send( staged.data( ), staged.size( ) );
+
+		if( job.durability != Durability::DU_NONE )
+			out.sync( );
+		out.close( );
+		out.place( job.path, job.durability );
+
+	} catch( std::system_error & e ) {
+		progress.error = e.what( );
+	}
+
+	progress.done = true;
+	this->report( progress );
+
+};
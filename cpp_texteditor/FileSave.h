@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Snapshot.h"
+#include "Channel.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// How hard a save tries to be on disk before it counts as done -- Each step costs a round trip to the storage,
+//   which is nothing on a local SSD and can be a long wait on NFS
+enum class Durability : uint8_t {
+	// Write and rename, the OS flushes whenever it likes -- A crash can leave an empty or half written file in place
+	DU_NONE,
+	// The new file is flushed before it replaces the old one -- After a crash it's one or the other, but the
+	//   rename itself can still be lost and leave the old one
+	DU_FILE,
+	// And the directory is flushed after the rename, so once the save is done it survives a crash
+	DU_DIRECTORY,
+};
+
+// Where a save has got to -- Sent as it goes, and once more when it's done
+struct SaveProgress {
+	uint64_t save = 0;
+	size_t written = 0;
+	size_t total = 0;
+	bool done = false;
+
+	// Why it failed, empty if it didn't -- The file on disk is left as it was
+	std::string error;
+};
+
+// Saving on a worker thread, from a Snapshot, so the editor keeps taking keys however long the disk takes
+// The text goes to a new file next to the target in large sequential writes, is flushed as far as the durability
+//   asks, and is renamed over the target in one step -- Whatever happens part way, the target is either the old
+//   text or the new, never a mix, and a file we have mapped keeps its old bytes since the rename only unlinks it
+// Progress the editor hasn't polled for yet folds into the latest, so a slow editor never holds the writing up
+//
+// Saves run in the order they were started, bar one still queued behind a newer save to the same file, which is skipped
+// Anything queued when we're destroyed is still written, so quitting straight after a save doesn't lose it
+class FileSave {
+protected:
+
+	struct Job {
+		uint64_t save = 0;
+		std::string path;
+		std::shared_ptr<const Snapshot> text;
+		Durability durability = Durability::DU_FILE;
+	};
+
+	// Small chunks are gathered into writes this big, bigger ones go straight from where they are in slices this big
+	static constexpr size_t writeSize = 1 << 20;
+
+	Channel<Job> jobs = Channel<Job>( 16 );
+	std::atomic<uint64_t> started = 0;
+
+	// Worker -> editor -- Finished saves in order, and the latest from the one running
+	std::mutex progressMtx;
+	std::vector<SaveProgress> finished;
+	SaveProgress running;
+	bool fresh = false;
+
+	std::function<void( )> wake;
+	std::thread worker;
+
+	void run( );
+	void write( Job & job );
+	void report( SaveProgress & progress );
+
+public:
+
+	// No thread until the first save
+	FileSave( std::function<void( )> wake );
+	~FileSave( );
+
+	// Write text to path -- Returns the save's number
+	uint64_t start( std::shared_ptr<const Snapshot> text, const std::string & path, Durability durability );
+
+	// Editor thread -- The next save to finish, or else how the current one is going if that moved on, false if neither
+	bool poll( SaveProgress & out );
+
+};
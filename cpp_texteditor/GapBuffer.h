@@ -1,11 +1,212 @@
 #pragma once
 
-#include "Editor.h"
+#include "BufferEditor.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
 
 // Editor implementing a full on GapBuffer
-class GapBuffer : public Editor {
+// The text lives in one contiguous allocation, with a hole (the gap) sitting where the last edit happened
+// Typing or deleting at the gap is O(1), and the gap only moves when an edit lands somewhere else
+// Cursor movement never touches the storage, the gap catches up lazily on the next edit
+//
+// Newlines are indexed the same way, split at the gap: offsets of the ones before it, in order, and of the ones after it
+//   as distances from the end of the text, nearest the gap last -- Neither changes for an edit at the gap, moving the gap
+//   hands the newlines it passes from one list to the other, and a line lookup is a binary search on one of them
+class GapBuffer : public BufferEditor<GapBuffer> {
 protected:
 
-	// TODO
+	// Storage, gap is [gapStart, gapEnd)
+	std::vector<char> buf;
+	size_t gapStart = 0;
+	size_t gapEnd = 0;
+
+	// Never grow by less than this
+	static constexpr size_t minGap = 4096;
+
+	// Newlines before the gap, by offset, and after it, by length( ) - offset -- Both ascending
+	std::vector<size_t> linesBeforeGap;
+	std::vector<size_t> linesAfterGap;
+
+	size_t gapLength( ) const { return this->gapEnd - this->gapStart; };
+
+	// Slide the gap so it starts at off -- Only the bytes between the old and new position move
+	void moveGap( size_t off ) {
+
+		size_t len = this->length( );
+
+		if( off < this->gapStart ) {
+			size_t count = this->gapStart - off;
+			std::memmove( this->buf.data( ) + this->gapEnd - count, this->buf.data( ) + off, count );
+			this->gapStart -= count;
+			this->gapEnd -= count;
+
+			while( !this->linesBeforeGap.empty( ) && this->linesBeforeGap.back( ) >= off ) {
+				this->linesAfterGap.push_back( len - this->linesBeforeGap.back( ) );
+				this->linesBeforeGap.pop_back( );
+			}
+		} else if( off > this->gapStart ) {
+			size_t count = off - this->gapStart;
+			std::memmove( this->buf.data( ) + this->gapStart, this->buf.data( ) + this->gapEnd, count );
+			this->gapStart += count;
+			this->gapEnd += count;
+
+			while( !this->linesAfterGap.empty( ) && len - this->linesAfterGap.back( ) < off ) {
+				this->linesBeforeGap.push_back( len - this->linesAfterGap.back( ) );
+				this->linesAfterGap.pop_back( );
+			}
+		}
+
+	};
+
+	// Make sure the gap can take len more bytes
+	// Grow geometrically so a long run of inserts costs amortized O(1) each
+	void reserveGap( size_t len ) {
+
+		if( this->gapLength( ) >= len )
+			return;
+
+		size_t used = this->length( );
+		size_t capacity = std::max( { this->buf.size( ) * 2, used + len + minGap, minGap } );
+
+		std::vector<char> grown( capacity );
+		size_t tail = this->buf.size( ) - this->gapEnd;
+
+		std::copy_n( this->buf.begin( ), this->gapStart, grown.begin( ) );
+		std::copy_n( this->buf.begin( ) + this->gapEnd, tail, grown.begin( ) + ( capacity - tail ) );
+
+		this->gapEnd = capacity - tail;
+		this->buf.swap( grown );
+
+	};
+
+public:
+
+	// Storage primitives for BufferEditor
+
+	size_t length( ) const { return this->buf.size( ) - this->gapLength( ); };
+
+	char at( size_t off ) const { return this->buf[ off < this->gapStart ? off : off + this->gapLength( ) ]; };
+
+	void insert( size_t off, const char * str, size_t len ) {
+
+		// Nothing to copy, and an empty buffer has no storage to copy it to
+		if( len == 0 )
+			return;
+
+		this->moveGap( off );
+		this->reserveGap( len );
+
+		std::memcpy( this->buf.data( ) + this->gapStart, str, len );
+		findNewlines( str, len, this->gapStart, this->linesBeforeGap );
+		this->gapStart += len;
+
+	};
+
+	void erase( size_t off, size_t len ) {
+
+		// Deleting just widens the gap
+		this->moveGap( off );
+
+		size_t end = this->length( ) - off - len;
+		while( !this->linesAfterGap.empty( ) && this->linesAfterGap.back( ) > end )
+			this->linesAfterGap.pop_back( );
+
+		this->gapEnd += len;
+
+	};
+
+	// Line lookups straight off the index
+
+	size_t linesBefore( size_t off ) const {
+
+		if( off <= this->gapStart )
+			return std::lower_bound( this->linesBeforeGap.begin( ), this->linesBeforeGap.end( ), off ) - this->linesBeforeGap.begin( );
+
+		// After the gap, the newlines before off are the ones further than length( ) - off from the end
+		size_t fromEnd = this->length( ) - off;
+		return this->linesBeforeGap.size( )
+			+ ( this->linesAfterGap.end( ) - std::upper_bound( this->linesAfterGap.begin( ), this->linesAfterGap.end( ), fromEnd ) );
+
+	};
+
+	// Offset of the k-th newline, counting from 1 -- length if there aren't that many
+	size_t newlineAt( size_t k ) const {
+
+		if( k == 0 )
+			return this->length( );
+		if( k <= this->linesBeforeGap.size( ) )
+			return this->linesBeforeGap[ k - 1 ];
+
+		k -= this->linesBeforeGap.size( );
+		if( k > this->linesAfterGap.size( ) )
+			return this->length( );
+		return this->length( ) - this->linesAfterGap[ this->linesAfterGap.size( ) - k ];
+
+	};
+
+	size_t lineCount( ) const { return this->linesBeforeGap.size( ) + this->linesAfterGap.size( ) + 1; };
+	size_t offsetOfLine( size_t line ) const { return line == 0 ? 0 : std::min( this->newlineAt( line ) + 1, this->length( ) ); };
+
+	size_t lineStart( size_t off ) const {
+		size_t k = this->linesBefore( off );
+		return k == 0 ? 0 : this->newlineAt( k ) + 1;
+	};
+
+	size_t lineEnd( size_t off ) const {
+		return this->newlineAt( this->linesBefore( off ) + 1 );
+	};
+
+	// Searching sees the two sides of the gap as they are, BufferEditor::find takes care of matches across it
+
+	template<typename F>
+	bool forChunks( size_t from, size_t to, F && visit ) {
+
+		const char * data = this->buf.data( );
+
+		if( from < this->gapStart ) {
+			size_t end = std::min( to, this->gapStart );
+			if( visit( data + from, end - from, from ) )
+				return true;
+			from = end;
+		}
+
+		return from < to && visit( data + from + this->gapLength( ), to - from, from );
+
+	};
+
+	template<typename F>
+	bool forChunksBack( size_t from, size_t to, F && visit ) {
+
+		const char * data = this->buf.data( );
+
+		if( to > this->gapStart ) {
+			size_t start = std::max( from, this->gapStart );
+			if( visit( data + start + this->gapLength( ), to - start, start ) )
+				return true;
+			to = start;
+		}
+
+		return from < to && visit( data + from, to - from, from );
+
+	};
+
+	void extract( size_t off, size_t len, char * out ) {
+
+		const char * data = this->buf.data( );
+
+		if( off < this->gapStart ) {
+			size_t before = std::min( len, this->gapStart - off );
+			std::memcpy( out, data + off, before );
+			out += before;
+			off += before;
+			len -= before;
+		}
+
+		if( len > 0 )
+			std::memcpy( out, data + off + this->gapLength( ), len );
+
+	};
 
 };
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "GridScreen.h"
+#include "Utf8.h"
+#include <bit>
+#include <algorithm>
+
+void GridScreen::fitGrid( ) {
+
+	if( this->back.size( ) == this->rows * this->cols && this->rowListed.size( ) == this->rows )
+		return;
+
+	size_t cells = this->rows * this->cols;
+
+	this->front.assign( cells, '\0' );
+	this->back.assign( cells, ' ' );
+
+	// Everything is dirty after a resize
+	this->dirtyWords = ( this->cols + 63 ) / 64;
+	this->dirtyBits.assign( this->rows * this->dirtyWords, ~uint64_t( 0 ) );
+	this->rowListed.assign( this->rows, 1 );
+	this->dirtyRows.resize( this->rows );
+	for( size_t row = 0; row < this->rows; ++row )
+		this->dirtyRows[ row ] = row;
+
+	this->wantx = std::min( this->wantx, this->cols );
+	this->wanty = std::min( this->wanty, this->rows ? this->rows - 1 : 0 );
+
+	// The device gets repainted from scratch anyway
+	this->scrolls.clear( );
+
+};
+
+bool GridScreen::doClear( ) {
+
+	this->fitGrid( );
+
+	for( size_t y = 0; y < this->rows; ++y )
+		for( size_t x = 0; x < this->cols; ++x ) {
+			Cell & cell = this->back[ y * this->cols + x ];
+			if( cell != ' ' ) {
+				cell = ' ';
+				this->touch( x, y );
+			}
+		}
+
+	this->wantx = 0;
+	this->wanty = 0;
+
+	return true;
+
+};
+
+bool GridScreen::doSetSize( size_t cols, size_t rows ) {
+
+	// Size is already tracked by the base, just match the buffers to it
+	this->fitGrid( );
+	return true;
+
+};
+
+GridScreen::Cell GridScreen::cellFor( const char * str, size_t len ) {
+
+	char32_t cp;
+	size_t used = utf8Decode( str, len, cp );
+
+	// Control characters would move the device's cursor around
+	if( cp < 0x20 || ( cp >= 0x7f && cp < 0xa0 ) )
+		return ' ';
+
+	// A mark with nothing before it would land on whatever is in the cell to the left, give it a space to sit on
+	bool orphan = charWidth( cp ) == 0;
+	if( used == len && !orphan )
+		return cp;
+
+	std::string text;
+	if( orphan )
+		text.push_back( ' ' );
+	text.append( str, len );
+	std::unordered_map<std::string, Cell>::iterator found = this->clusterCells.find( text );
+	if( found != this->clusterCells.end( ) )
+		return found->second;
+
+	Cell cell = clusterCell + (Cell)this->clusters.size( );
+	this->clusters.push_back( text );
+	this->clusterCells.emplace( std::move( text ), cell );
+	return cell;
+
+};
+
+std::string_view GridScreen::sgrFor( Colour colour ) {
+
+	// Foreground only bar the cursors and selections, and each one resets whatever was set before
+	switch( colour ) {
+	case Colour::CL_KEYWORD:
+		return "\x1b[0;1;34m";
+	case Colour::CL_TYPE:
+		return "\x1b[0;36m";
+	case Colour::CL_NUMBER:
+		return "\x1b[0;35m";
+	case Colour::CL_STRING:
+		return "\x1b[0;32m";
+	case Colour::CL_COMMENT:
+		return "\x1b[0;90m";
+	case Colour::CL_PREPROCESSOR:
+		return "\x1b[0;33m";
+	case Colour::CL_CURSOR:
+		return "\x1b[0;7m";
+	case Colour::CL_SELECTION:
+		return "\x1b[0;44m";
+	default:
+		return "\x1b[0m";
+	}
+
+};
+
+void GridScreen::appendCell( std::string & out, Cell cell ) const {
+
+	cell = glyphOf( cell );
+	if( cell == wideTail )
+		return;
+
+	if( cell >= clusterCell ) {
+		out += this->clusters[ cell - clusterCell ];
+		return;
+	}
+
+	char bytes[ 4 ];
+	out.append( bytes, utf8Encode( cell, bytes ) );
+
+};
+
+size_t GridScreen::doPutString( std::string_view str, std::span<const ColourRun> runs, size_t x, size_t y, bool insert ) {
+
+	this->fitGrid( );
+
+	if( y >= this->rows || x > this->cols )
+		return 0;
+
+	Cell * row = this->back.data( ) + y * this->cols;
+	auto set = [ & ]( size_t at, Cell cell ) {
+		if( row[ at ] != cell ) {
+			row[ at ] = cell;
+			this->touch( at, y );
+		}
+	};
+
+	// Writing over either half of a wide cluster loses the other half too
+	if( x < this->cols && glyphOf( row[ x ] ) == wideTail )
+		set( x - 1, ' ' );
+
+	// Clip to the end of the line, don't wrap -- By columns, a cluster is however many bytes it takes
+	const char * data = str.data( );
+	size_t len = str.length( );
+	size_t used = 0;
+	size_t col = x;
+
+	// The colour run used is in, and where it ends -- Past the last run is default
+	size_t runIdx = 0;
+	size_t runEnd = runs.empty( ) ? len : runs[ 0 ].len;
+	Colour colour = runs.empty( ) ? Colour::CL_DEFAULT : runs[ 0 ].colour;
+	auto nextRun = [ & ]( ) {
+		while( used >= runEnd ) {
+			if( ++runIdx < runs.size( ) ) {
+				runEnd += runs[ runIdx ].len;
+				colour = runs[ runIdx ].colour;
+			} else {
+				runEnd = len;
+				colour = Colour::CL_DEFAULT;
+			}
+		}
+	};
+
+	while( used < len && col < this->cols ) {
+
+		nextRun( );
+
+		// Runs of ASCII with nothing joined on, nearly everything, go a byte a cell -- Bar the last before anything
+		//   that isn't ASCII, which could join onto it
+		size_t run = used;
+		size_t stop = std::min( { len, used + this->cols - col, runEnd } );
+		while( run < stop && (unsigned char)data[ run ] < 0x80 )
+			++run;
+		if( run > used && run < len && (unsigned char)data[ run ] >= 0x80 )
+			--run;
+
+		for( ; used < run; ++used, ++col ) {
+			unsigned char c = data[ used ];
+			set( col, coloured( c < 0x20 || c == 0x7f ? ' ' : c, colour ) );
+		}
+
+		if( used == len || col == this->cols )
+			break;
+		if( used == runEnd )
+			continue;
+
+		size_t width;
+		size_t bytes = clusterAt( data + used, len - used, width );
+		Cell cell = coloured( this->cellFor( data + used, bytes ), colour );
+
+		// Half of a wide cluster would hang off the end, leave a blank where it would have started
+		if( col + width > this->cols ) {
+			set( col++, ' ' );
+			break;
+		}
+
+		set( col, cell );
+		if( width == 2 )
+			set( col + 1, coloured( wideTail, colour ) );
+
+		col += width;
+		used += bytes;
+
+	}
+
+	if( col < this->cols && glyphOf( row[ col ] ) == wideTail )
+		set( col, ' ' );
+
+	this->wantx = col;
+	this->wanty = y;
+
+	return used;
+
+};
+
+void GridScreen::shiftRows( std::vector<Cell> & cells, size_t top, size_t bottom, ptrdiff_t lines, Cell fill ) {
+
+	size_t height = bottom - top;
+	size_t by = std::min<size_t>( lines < 0 ? -lines : lines, height );
+	Cell * first = cells.data( ) + top * this->cols;
+	Cell * last = cells.data( ) + bottom * this->cols;
+
+	if( lines > 0 ) {
+		std::copy( first + by * this->cols, last, first );
+		std::fill( last - by * this->cols, last, fill );
+	} else {
+		std::copy_backward( first, last - by * this->cols, last );
+		std::fill( first, first + by * this->cols, fill );
+	}
+
+};
+
+bool GridScreen::doScroll( size_t top, size_t bottom, ptrdiff_t lines ) {
+
+	this->fitGrid( );
+
+	bottom = std::min( bottom, this->rows );
+	if( top >= bottom || lines == 0 )
+		return true;
+
+	this->shiftRows( this->back, top, bottom, lines, ' ' );
+
+	// Dirty bits go along with their rows -- What scrolls in is blank on the device too, but is marked anyway
+	size_t height = bottom - top;
+	size_t by = std::min<size_t>( lines < 0 ? -lines : lines, height );
+	uint64_t * first = this->dirtyBits.data( ) + top * this->dirtyWords;
+	uint64_t * last = this->dirtyBits.data( ) + bottom * this->dirtyWords;
+	if( lines > 0 ) {
+		std::copy( first + by * this->dirtyWords, last, first );
+		std::fill( last - by * this->dirtyWords, last, ~uint64_t( 0 ) );
+	} else {
+		std::copy_backward( first, last - by * this->dirtyWords, last );
+		std::fill( first, first + by * this->dirtyWords, ~uint64_t( 0 ) );
+	}
+
+	for( size_t y = top; y < bottom; ++y ) {
+		const uint64_t * bits = this->dirtyBits.data( ) + y * this->dirtyWords;
+		if( !this->rowListed[ y ] && std::any_of( bits, bits + this->dirtyWords, [ ]( uint64_t word ) { return word != 0; } ) ) {
+			this->rowListed[ y ] = 1;
+			this->dirtyRows.push_back( y );
+		}
+	}
+
+	this->scrolls.push_back( { top, bottom, lines } );
+	return true;
+
+};
+
+bool GridScreen::doFlush( ) {
+
+	this->fitGrid( );
+
+	bool ok = true;
+
+	// Scrolls first, so front is what the device shows before the diff -- One the device can't do leaves front
+	//   as it was, and the diff repaints every row that should have moved
+	for( ScreenCommandScroll & scroll : this->scrolls ) {
+		if( this->doScrollRows( scroll.top, scroll.bottom, scroll.lines ) ) {
+			this->shiftRows( this->front, scroll.top, scroll.bottom, scroll.lines, ' ' );
+			continue;
+		}
+		for( size_t y = scroll.top; y < scroll.bottom; ++y ) {
+			std::fill( this->dirtyBits.data( ) + y * this->dirtyWords, this->dirtyBits.data( ) + ( y + 1 ) * this->dirtyWords, ~uint64_t( 0 ) );
+			if( !this->rowListed[ y ] ) {
+				this->rowListed[ y ] = 1;
+				this->dirtyRows.push_back( y );
+			}
+		}
+	}
+	this->scrolls.clear( );
+
+	// Rows top to bottom, so the device sees writes in a sensible order
+	std::sort( this->dirtyRows.begin( ), this->dirtyRows.end( ) );
+
+	for( size_t y : this->dirtyRows ) {
+
+		const Cell * back = this->back.data( ) + y * this->cols;
+		Cell * front = this->front.data( ) + y * this->cols;
+		uint64_t * bits = this->dirtyBits.data( ) + y * this->dirtyWords;
+
+		// Current run of changed cells, [ start, end )
+		size_t start = 0, end = 0;
+		bool open = false;
+
+		// Wide clusters go out whole, whichever half changed, and a colour at a time
+		auto write = [ & ]( ) {
+			if( start > 0 && glyphOf( back[ start ] ) == wideTail )
+				--start;
+			if( end < this->cols && glyphOf( back[ end ] ) == wideTail )
+				++end;
+
+			bool written = true;
+			for( size_t from = start; from < end; ) {
+				Colour colour = colourOf( back[ from ] );
+				size_t to = from;
+				this->runText.clear( );
+				for( ; to < end && colourOf( back[ to ] ) == colour; ++to )
+					this->appendCell( this->runText, back[ to ] );
+				written &= this->doWriteRun( this->runText.data( ), this->runText.length( ), from, y, to - from, colour );
+				from = to;
+			}
+			return written;
+		};
+
+		for( size_t word = 0; word < this->dirtyWords; ++word ) {
+
+			uint64_t set = bits[ word ];
+			bits[ word ] = 0;
+
+			while( set ) {
+				size_t x = word * 64 + std::countr_zero( set );
+				set &= set - 1;
+
+				if( x >= this->cols || back[ x ] == front[ x ] )
+					continue;
+
+				if( open && x - end <= mergeGap ) {
+					end = x + 1;
+					continue;
+				}
+
+				if( open ) {
+					ok &= write( );
+					open = false;
+					// The right half of what that run just finished off
+					if( x < end )
+						continue;
+				}
+
+				start = x;
+				end = x + 1;
+				open = true;
+			}
+
+		}
+
+		if( open )
+			ok &= write( );
+
+		// Merged runs may have swallowed a few unchanged cells, copying the whole row keeps it simple
+		std::copy( back, back + this->cols, front );
+
+		this->rowListed[ y ] = 0;
+
+	}
+
+	this->dirtyRows.clear( );
+
+	ok &= this->doMoveCursor( this->wantx, this->wanty );
+	ok &= this->doPresent( );
+
+	return ok;
+
+};
\ No newline at end of file
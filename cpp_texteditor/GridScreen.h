@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Screen.h"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+
+// Double buffered screen -- Commands only ever touch the back buffer, the device sees a diff once per frame
+// Every cell that changes gets its bit set in its row's dirty bitmap, and the row goes on a dirty list
+//   so flushing only looks at rows and columns that were actually written to, not the whole screen
+// Derive a concrete backend from this and implement the device hooks below, the rest comes for free
+//
+// A scroll moves the back buffer's rows and their dirty bits straight away, and is done on the device at the start of
+//   the next flush, with front moved to match -- So the diff after it only finds the rows that scrolled in, and
+//   whatever was drawn on top of them, and a device that can't scroll just gets the rows repainted
+//
+// Strings come in as UTF-8 and are laid out a grapheme cluster per cell, or two cells for a wide one
+// A cell holds its cluster's code point when it is a single one, and otherwise an index into a table of the longer
+//   clusters seen so far, with its colour in the top byte -- Either way comparing two cells is comparing two integers
+class GridScreen : public Screen {
+protected:
+
+	using Cell = char32_t;
+
+	// The right half of a wide cluster, drawn along with the left -- Past anything a code point can be
+	static constexpr Cell wideTail = 0x110000;
+
+	// Cells at or above this are clusters of more than one code point, by index into clusters
+	static constexpr Cell clusterCell = 0x200000;
+
+	// What's drawn in a cell, and in what colour
+	static constexpr unsigned colourShift = 24;
+	static constexpr Cell glyphMask = ( Cell( 1 ) << colourShift ) - 1;
+
+	static Cell glyphOf( Cell cell ) { return cell & glyphMask; };
+	static Colour colourOf( Cell cell ) { return Colour( cell >> colourShift ); };
+	static Cell coloured( Cell glyph, Colour colour ) { return glyph | Cell( colour ) << colourShift; };
+
+	// The escape sequence that switches a VT device to drawing in colour
+	static std::string_view sgrFor( Colour colour );
+
+	// Cells as the device currently shows them, and as they should look after the next flush
+	// Front starts out as NULs, which nothing draws, so the first frame paints everything
+	std::vector<Cell> front;
+	std::vector<Cell> back;
+
+	// Multi code point clusters, and where each is in the table -- Only ever added to, there are never many
+	std::vector<std::string> clusters;
+	std::unordered_map<std::string, Cell> clusterCells;
+
+	// Bytes of the run being written out, reused every flush
+	std::string runText;
+
+	// The cell for the cluster in [ str, str + len )
+	Cell cellFor( const char * str, size_t len );
+
+	// Append the UTF-8 a cell stands for
+	void appendCell( std::string & out, Cell cell ) const;
+
+	// One bit per cell, words per row rounded up
+	std::vector<uint64_t> dirtyBits;
+	size_t dirtyWords = 0;
+
+	// Rows with any bit set, and a flag so each row is only listed once
+	std::vector<size_t> dirtyRows;
+	std::vector<uint8_t> rowListed;
+
+	// Where the cursor should be left at the end of the frame
+	size_t wantx = 0;
+	size_t wanty = 0;
+
+	// Two changed runs closer together than this get written as one, it's cheaper than a cursor move
+	static constexpr size_t mergeGap = 8;
+
+	// Scrolls done to back since the last flush, still to be done on the device
+	std::vector<ScreenCommandScroll> scrolls;
+
+	// Move rows [ top, bottom ) of cells up by lines, or down when negative, filling in with fill
+	void shiftRows( std::vector<Cell> & cells, size_t top, size_t bottom, ptrdiff_t lines, Cell fill );
+
+	// Resize both buffers if the tracked size no longer matches them
+	void fitGrid( );
+
+	// Mark a single cell dirty
+	void touch( size_t x, size_t y ) {
+		if( !this->rowListed[ y ] ) {
+			this->rowListed[ y ] = 1;
+			this->dirtyRows.push_back( y );
+		}
+		this->dirtyBits[ y * this->dirtyWords + x / 64 ] |= uint64_t( 1 ) << ( x % 64 );
+	};
+
+	// Screen implementations -- These only touch the back buffer
+	bool doClear( );
+	bool doSetSize( size_t cols, size_t rows );
+	size_t doPutString( std::string_view str, std::span<const ColourRun> runs, size_t x, size_t y, bool insert = true );
+	bool doScroll( size_t top, size_t bottom, ptrdiff_t lines );
+
+	// Diff back against front, write out the changes through the hooks below
+	bool doFlush( );
+
+	// Device hooks
+
+	// Write len bytes of UTF-8 at x, y, taking up width cells, all in one colour -- These are guaranteed to fit on the row
+	virtual bool doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour ) = 0;
+
+	// Leave the visible cursor at x, y
+	virtual bool doMoveCursor( size_t x, size_t y ) = 0;
+
+	// Scroll rows [ top, bottom ) up by lines, or down when negative, blanking in the default colour what comes in
+	// Comes before any runs in the frame -- False if the device can't, and the rows are repainted instead
+	virtual bool doScrollRows( size_t top, size_t bottom, ptrdiff_t lines ) { return false; };
+
+	// Everything for this frame has been written
+	virtual bool doPresent( ) { return true; };
+
+public:
+
+	// Peek at what the screen is going to show, as UTF-8 -- Mostly for testing
+	// The right half of a wide cluster is empty, the whole cluster is on the left half
+	std::string cellAt( size_t x, size_t y ) const {
+		std::string out;
+		this->appendCell( out, this->back[ y * this->cols + x ] );
+		return out;
+	};
+
+};
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "Highlighter.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+	// Sorted, for binary search
+	constexpr std::string_view keywords[ ] = {
+		"alignas", "alignof", "asm", "auto", "break", "case", "catch", "class", "co_await", "co_return", "co_yield",
+		"concept", "const", "const_cast", "consteval", "constexpr", "constinit", "continue", "decltype", "default",
+		"delete", "do", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "final", "for",
+		"friend", "goto", "if", "inline", "mutable", "namespace", "new", "noexcept", "nullptr", "operator", "override",
+		"private", "protected", "public", "register", "reinterpret_cast", "requires", "return", "sizeof", "static",
+		"static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true", "try",
+		"typedef", "typeid", "typename", "union", "using", "virtual", "volatile", "while",
+	};
+
+	constexpr std::string_view types[ ] = {
+		"bool", "char", "char16_t", "char32_t", "char8_t", "double", "float", "int", "int16_t", "int32_t", "int64_t",
+		"int8_t", "long", "ptrdiff_t", "short", "signed", "size_t", "uint16_t", "uint32_t", "uint64_t", "uint8_t",
+		"unsigned", "void", "wchar_t",
+	};
+
+	constexpr std::string_view extensions[ ] = {
+		"c", "cc", "cpp", "cs", "cxx", "go", "h", "hh", "hpp", "hxx", "inl", "java", "js", "rs", "ts",
+	};
+
+	template<size_t N>
+	bool listed( const std::string_view ( &list )[ N ], std::string_view word ) {
+		return std::binary_search( std::begin( list ), std::end( list ), word );
+	};
+
+	bool identStart( unsigned char c ) { return c == '_' || (unsigned char)( ( c | 0x20 ) - 'a' ) < 26 || c >= 0x80; };
+	bool identChar( unsigned char c ) { return identStart( c ) || (unsigned char)( c - '0' ) < 10; };
+	bool digit( unsigned char c ) { return (unsigned char)( c - '0' ) < 10; };
+
+	// Appends runs a token at a time, joining up neighbours in the same colour
+	struct Painter {
+
+		std::vector<ColourRun> * runs;
+
+		void paint( size_t len, Colour colour ) {
+			if( !this->runs || len == 0 )
+				return;
+			if( !this->runs->empty( ) && this->runs->back( ).colour == colour )
+				this->runs->back( ).len += (uint32_t)len;
+			else
+				this->runs->push_back( { (uint32_t)len, colour } );
+		};
+
+	};
+
+}
+
+bool Highlighter::handles( std::string_view path ) {
+
+	size_t dot = path.find_last_of( "./\\" );
+	if( dot == std::string_view::npos || path[ dot ] != '.' )
+		return false;
+
+	std::string_view ext = path.substr( dot + 1 );
+	char lower[ 8 ];
+	if( ext.length( ) > sizeof( lower ) )
+		return false;
+	std::transform( ext.begin( ), ext.end( ), lower, [ ]( char c ) { return (char)( c >= 'A' && c <= 'Z' ? c | 0x20 : c ); } );
+	return listed( extensions, std::string_view( lower, ext.length( ) ) );
+
+};
+
+Highlighter::State Highlighter::lex( const char * text, size_t len, State state, std::vector<ColourRun> * runs ) {
+
+	Painter out = { runs };
+
+	if( len > maxLine ) {
+		out.paint( len, Colour::CL_DEFAULT );
+		return state;
+	}
+
+	// A backslash at the very end carries strings and directives on to the next line -- CRLF files have a \r after it
+	size_t end = len;
+	if( end > 0 && text[ end - 1 ] == '\r' )
+		--end;
+	bool continued = end > 0 && text[ end - 1 ] == '\\';
+
+	size_t at = 0;
+
+	// Picking up where the last line left off
+	if( state == blockComment ) {
+		std::string_view rest( text, len );
+		size_t close = rest.find( "*/" );
+		if( close == std::string_view::npos ) {
+			out.paint( len, Colour::CL_COMMENT );
+			return blockComment;
+		}
+		at = close + 2;
+		out.paint( at, Colour::CL_COMMENT );
+	}
+
+	bool directive = state == preprocessor;
+
+	if( state > preprocessor ) {
+		char quote = (char)state;
+		while( at < len && text[ at ] != quote )
+			at += text[ at ] == '\\' ? 2 : 1;
+		bool closed = at < len;
+		at = std::min( at + 1, len );
+		out.paint( at, Colour::CL_STRING );
+		if( !closed )
+			return continued ? state : normal;
+	}
+
+	// A # first thing on the line starts a directive, which colours everything but strings and comments
+	if( state == normal ) {
+		size_t first = at;
+		while( first < len && ( text[ first ] == ' ' || text[ first ] == '\t' ) )
+			++first;
+		directive = first < len && text[ first ] == '#';
+	}
+	Colour plain = directive ? Colour::CL_PREPROCESSOR : Colour::CL_DEFAULT;
+
+	while( at < len ) {
+
+		unsigned char c = text[ at ];
+		size_t from = at;
+
+		if( c == '/' && at + 1 < len && text[ at + 1 ] == '/' ) {
+			out.paint( len - at, Colour::CL_COMMENT );
+			return normal;
+		}
+
+		if( c == '/' && at + 1 < len && text[ at + 1 ] == '*' ) {
+			std::string_view rest( text + at + 2, len - at - 2 );
+			size_t close = rest.find( "*/" );
+			if( close == std::string_view::npos ) {
+				out.paint( len - at, Colour::CL_COMMENT );
+				return blockComment;
+			}
+			at += 2 + close + 2;
+			out.paint( at - from, Colour::CL_COMMENT );
+			continue;
+		}
+
+		if( c == '"' || c == '\'' ) {
+			++at;
+			while( at < len && text[ at ] != (char)c )
+				at += text[ at ] == '\\' ? 2 : 1;
+			bool closed = at < len;
+			at = std::min( at + 1, len );
+			out.paint( at - from, Colour::CL_STRING );
+			if( !closed && continued )
+				return (State)c;
+			continue;
+		}
+
+		if( digit( c ) || ( c == '.' && at + 1 < len && digit( text[ at + 1 ] ) ) ) {
+			// Close enough for every form going -- Hex, binary, separators, suffixes and signed exponents
+			++at;
+			while( at < len ) {
+				unsigned char d = text[ at ];
+				if( ( d == '+' || d == '-' ) && ( ( text[ at - 1 ] | 0x20 ) == 'e' || ( text[ at - 1 ] | 0x20 ) == 'p' ) )
+					++at;
+				else if( identChar( d ) || d == '.' || d == '\'' )
+					++at;
+				else
+					break;
+			}
+			out.paint( at - from, directive ? plain : Colour::CL_NUMBER );
+			continue;
+		}
+
+		if( identStart( c ) ) {
+			while( at < len && identChar( text[ at ] ) )
+				++at;
+			std::string_view word( text + from, at - from );
+			Colour colour = plain;
+			if( !directive && listed( keywords, word ) )
+				colour = Colour::CL_KEYWORD;
+			else if( !directive && listed( types, word ) )
+				colour = Colour::CL_TYPE;
+			out.paint( at - from, colour );
+			continue;
+		}
+
+		++at;
+		out.paint( 1, plain );
+
+	}
+
+	return directive && continued ? preprocessor : normal;
+
+};
+
+void Highlighter::lexed( State state ) {
+
+	size_t line = this->known;
+	if( line >= this->states.size( ) )
+		return;
+
+	bool converged = line >= this->savedStart && line < this->savedEnd && this->states[ line ] == state;
+
+	if( !converged ) {
+		this->changedFrom = std::min( this->changedFrom, line );
+		this->changedTo = std::max( this->changedTo, line + 1 );
+	}
+
+	this->states[ line ] = state;
+	this->known = line + 1;
+
+	if( converged ) {
+		this->known = this->savedEnd;
+		this->savedStart = this->savedEnd = 0;
+	}
+
+};
+
+void Highlighter::edited( size_t line, size_t removed, size_t added ) {
+
+	if( !this->enabled )
+		return;
+
+	// The first line whose start is in doubt -- Lines the edit joined up go, and ones it split off come in after it
+	size_t next = line + 1;
+	this->states.erase( this->states.begin( ) + next, this->states.begin( ) + next + removed );
+	this->states.insert( this->states.begin( ) + next, added, normal );
+
+	if( next < this->known ) {
+
+		// Everything after the edit was right before it, and is the saved run now
+		if( this->known > next + removed ) {
+			this->savedStart = next + added;
+			this->savedEnd = this->known - removed + added;
+		} else {
+			this->savedStart = this->savedEnd = 0;
+		}
+		this->known = next;
+
+	} else if( this->savedStart < this->savedEnd ) {
+
+		// Past what's known -- The saved run is good up to the edited line, and moves along after it
+		if( this->savedStart < next ) {
+			this->savedEnd = std::min( this->savedEnd, next );
+		} else if( this->savedEnd > next + removed ) {
+			this->savedStart = std::max( this->savedStart, next + removed ) - removed + added;
+			this->savedEnd = this->savedEnd - removed + added;
+		} else {
+			this->savedStart = this->savedEnd = 0;
+		}
+
+	}
+
+	// Whatever was waiting to be redrawn has moved, so redraw everything after it
+	if( this->changedFrom < this->changedTo ) {
+		this->changedFrom = std::min( this->changedFrom, next );
+		this->changedTo = (size_t)-1;
+	}
+
+};
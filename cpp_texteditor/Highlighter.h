@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Screen.h"
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Syntax highlighting for C-like source, incremental by line
+// A line lexes the same way every time it starts in the same state -- In the middle of a block comment, a string
+//   continued with a backslash, and so on -- so the state at the start of every line is kept, and a line's colours
+//   can be worked out on their own from its text and the state before it
+//
+// States are known for lines [ 0, valid( ) ), worked out a line at a time by whoever has the text ( see BufferEditor ),
+//   on screen first and the rest of the file in the background
+// An edit only puts the lines after the one it was on in doubt -- Their old states are kept, and once re-lexing
+//   reaches a line whose state comes out the same as before, everything from there to where the old states ran out
+//   is known again without looking at it, so typing re-lexes a line or two rather than the rest of the file
+class Highlighter {
+public:
+
+	// Where a line starts -- Anything past preprocessor is the quote a string was continued inside
+	using State = uint8_t;
+
+	static constexpr State normal = 0;
+	static constexpr State blockComment = 1;
+	static constexpr State preprocessor = 2;
+
+	// Lines longer than this aren't coloured, and leave the state as it was -- Minified files and the like
+	static constexpr size_t maxLine = 65536;
+
+	// Whether a file is one we know how to highlight, going by its name
+	static bool handles( std::string_view path );
+
+	// Lex the line [ text, text + len ) starting in state -- Returns the state the next line starts in
+	// If runs isn't null the line's colours are appended to it, covering every byte
+	static State lex( const char * text, size_t len, State state, std::vector<ColourRun> * runs );
+
+protected:
+
+	bool enabled = false;
+
+	// State at the start of every line -- Only the first valid are known to be right
+	std::vector<State> states;
+	size_t known = 0;
+
+	// Lines [ savedStart, savedEnd ) still hold the states they had before the last edits, each the one the line
+	//   before leads to -- A line reached with the state it had before means the rest of these are right as well
+	size_t savedStart = 0;
+	size_t savedEnd = 0;
+
+	// Lines whose state came out different since changes( ) was last asked
+	size_t changedFrom = (size_t)-1;
+	size_t changedTo = 0;
+
+public:
+
+	bool active( ) const { return this->enabled; };
+
+	// Start over on a document of lines lines, or stop highlighting
+	void reset( size_t lines, bool enable ) {
+		this->enabled = enable;
+		this->states.assign( enable ? lines : 0, normal );
+		this->known = enable && lines ? 1 : 0;
+		this->savedStart = this->savedEnd = 0;
+		this->changedFrom = (size_t)-1;
+		this->changedTo = 0;
+	};
+
+	size_t lines( ) const { return this->states.size( ); };
+
+	// Lines from the top whose start state is known
+	size_t valid( ) const { return this->known; };
+
+	bool done( ) const { return this->known == this->states.size( ); };
+
+	State stateOf( size_t line ) const { return this->states[ line ]; };
+
+	// The line valid( ) - 1 was lexed and leads to state
+	void lexed( State state );
+
+	// An edit on line line took out removed newlines and put in added
+	void edited( size_t line, size_t removed, size_t added );
+
+	// Lines [ from, to ) whose state changed since the last call, and forget them -- Empty if none did
+	std::pair<size_t, size_t> changes( ) {
+		std::pair<size_t, size_t> range = { this->changedFrom, this->changedTo };
+		this->changedFrom = (size_t)-1;
+		this->changedTo = 0;
+		return range.first < range.second ? range : std::pair<size_t, size_t>( 0, 0 );
+	};
+
+};
@@ -1,6 +1,13 @@
 #pragma once
 
 #include <variant>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "Latency.h"
+#include "Utf8.h"
 
 // This is a single key event within our program
 // This can be one of several types of key event
@@ -8,8 +15,11 @@ enum class KeyEventType {
 	KET_PRINT,
 	KET_CONTROL,
 	KET_RESIZE, // We need to be able to pass resizes through when they come from WinConsole for example
+	KET_PASTE,
 };
 
+// A character typed -- code is the whole character, ascii the same when it is ASCII and 0 when it isn't
+// Chords are only ever looked for on ascii, text is inserted from code
 struct KeyEventPrintable {
 	char ascii;
 
@@ -17,11 +27,21 @@ struct KeyEventPrintable {
 	bool ctrl;
 	bool alt;
 	bool os;
+
+	char32_t code;
+
+	// The character as UTF-8 -- out needs room for 4, returns the length
+	size_t utf8( char * out ) const { return utf8Encode( this->code, out ); };
 };
 struct KeyEventResize {
 	size_t cols;
 	size_t rows;
 };
+// Text pasted in, as one event however long it is -- Shared, so passing the event along never copies the text
+// Line breaks are '\n' whatever the terminal sent, the rest is the bytes as they came
+struct KeyEventPaste {
+	std::shared_ptr<const std::string> text;
+};
 // Control key events are specially handled
 // We don't really care about the values, but ERROR should be 0
 enum class KeyEventControl {
@@ -93,7 +113,10 @@ struct KeyEvent {
 
 	KeyEventType type;
 
-	std::variant<KeyEventPrintable, KeyEventControl, KeyEventResize> event;
+	std::variant<KeyEventPrintable, KeyEventControl, KeyEventResize, KeyEventPaste> event;
+
+	// When the key was read, in latencyNow( ) nanoseconds -- 0 for keys that didn't come from a Keyboard
+	uint64_t stamp = 0;
 
 	// Default constructor is an error
 	KeyEvent( ) : type( KeyEventType::KET_CONTROL ), event( KeyEventControl::CK_ERROR ) { };
@@ -101,14 +124,37 @@ struct KeyEvent {
 	// Constructors
 	// Printable
 	KeyEvent( char c, bool shft = false, bool ctrl = false, bool alt = false, bool os = false ) :
-		type( KeyEventType::KET_PRINT ), event( KeyEventPrintable( { c, shft, ctrl, alt, os } ) ) { };
+		type( KeyEventType::KET_PRINT ), event( KeyEventPrintable( { c, shft, ctrl, alt, os, (char32_t)(unsigned char)c } ) ) { };
 	// Control
 	KeyEvent( KeyEventControl ck ) : type( KeyEventType::KET_CONTROL ), event( ck ) { };
 	// Resize
 	KeyEvent( size_t cols, size_t rows ) : type( KeyEventType::KET_RESIZE ), event( KeyEventResize( { cols, rows } ) ) { };
 
+	// Printable, any character -- A named constructor, a char32_t overload would make every KeyEvent( int ) ambiguous
+	static KeyEvent character( char32_t code, bool shft = false, bool ctrl = false, bool alt = false, bool os = false ) {
+		KeyEvent key( code < 0x80 ? (char)code : '\0', shft, ctrl, alt, os );
+		std::get<KeyEventPrintable>( key.event ).code = code;
+		return key;
+	};
+
+	// Paste
+	static KeyEvent paste( std::string text ) {
+		KeyEvent key;
+		key.type = KeyEventType::KET_PASTE;
+		key.event = KeyEventPaste( { std::make_shared<const std::string>( std::move( text ) ) } );
+		return key;
+	};
+
 };
 
+// Ctrl-Q -- Quits from everywhere, whatever is reading the keys
+inline bool isQuitKey( const KeyEvent & key ) {
+	if( key.type != KeyEventType::KET_PRINT )
+		return false;
+	const KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+	return prnt.ascii == 'q' && !prnt.shft && prnt.ctrl && !prnt.alt;
+}
+
 // The abstract Keyboard class, defining everything a keyboard must be able to do
 class Keyboard {
 protected:
@@ -116,9 +162,31 @@ protected:
 	virtual KeyEvent doReadKey( ) = 0;
 	virtual bool doKeysReady( ) = 0;
 
+	// Block until keys are ready -- Return false if interrupted instead
+	virtual bool doWaitKeys( ) = 0;
+	// Make any current or future doWaitKeys return false, from any thread
+	virtual void doInterrupt( ) = 0;
+
+	// Bodies of the entry points below, calling the hooks through Self
+	//   Self = Keyboard is the usual virtual call, a Sealed<T> ( Pipeline.h ) gets T's hooks bound at compile time
+	template<typename Self>
+	static KeyEvent readKeyOf( Self & kb ) {
+		KeyEvent key = kb.doReadKey( );
+		key.stamp = latencyNow( );
+		return key;
+	};
+	template<typename Self>
+	static bool keysReadyOf( Self & kb ) { return kb.doKeysReady( ); };
+	template<typename Self>
+	static bool waitKeysOf( Self & kb ) { return kb.doWaitKeys( ); };
+
 public:
 
-	KeyEvent readKey( ) { return this->doReadKey( ); };
-	bool keysReady( ) { return this->doKeysReady( ); };
+	// Stamp every key on the way out, this is where latency measurements start
+	KeyEvent readKey( ) { return readKeyOf( *this ); };
+	bool keysReady( ) { return keysReadyOf( *this ); };
+
+	bool waitKeys( ) { return waitKeysOf( *this ); };
+	void interrupt( ) { this->doInterrupt( ); };
 
 };
\ No newline at end of file
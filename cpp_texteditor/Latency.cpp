@@ -0,0 +1,39 @@
+#include "Latency.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+std::string latencyReport( ) {
+
+	static const char * names[ ] = { "input queue", "edit", "screen queue", "render", "key to paint" };
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision( 1 );
+	out << std::left << std::setw( 14 ) << "stage" << std::right
+		<< std::setw( 10 ) << "count"
+		<< std::setw( 12 ) << "p50 us"
+		<< std::setw( 12 ) << "p99 us"
+		<< std::setw( 12 ) << "p999 us"
+		<< std::setw( 12 ) << "max us" << '\n';
+
+	for( size_t stage = 0; stage < (size_t)LatencyStage::LS_COUNT; ++stage ) {
+		const LatencyHistogram & hist = latency( (LatencyStage)stage );
+		out << std::left << std::setw( 14 ) << names[ stage ] << std::right
+			<< std::setw( 10 ) << hist.count( )
+			<< std::setw( 12 ) << hist.percentile( 0.50 ) / 1000.0
+			<< std::setw( 12 ) << hist.percentile( 0.99 ) / 1000.0
+			<< std::setw( 12 ) << hist.percentile( 0.999 ) / 1000.0
+			<< std::setw( 12 ) << hist.max( ) / 1000.0 << '\n';
+	}
+
+	return out.str( );
+
+};
+
+bool latencyDump( const std::string & path ) {
+
+	std::ofstream out( path, std::ios::trunc );
+	out << latencyReport( );
+	return (bool)out;
+
+};
\ No newline at end of file
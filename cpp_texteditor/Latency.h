@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <bit>
+#include <algorithm>
+
+// Keystroke latency tracking
+// Every KeyEvent is stamped when it is read, the stamp rides along on the ScreenCommands it turns into,
+//   and each stage records how long its part took into a histogram
+// Histograms are HDR style: 16 linear sub buckets per power of two, so ~6% precision over the whole range,
+//   and recording is a single relaxed fetch_add, so any thread can record without locking
+
+// Monotonic nanoseconds
+inline uint64_t latencyNow( ) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+enum class LatencyStage {
+	LS_INPUT_QUEUE,  // Read from the keyboard -> picked up by the editor
+	LS_EDIT,         // Editor consuming the key
+	LS_SCREEN_QUEUE, // Emitted by the editor -> picked up by the screen
+	LS_RENDER,       // Picked up by the screen -> flushed to the device
+	LS_TOTAL,        // Read from the keyboard -> flushed to the device
+
+	LS_COUNT,
+};
+
+class LatencyHistogram {
+
+	static constexpr size_t subBits = 4;
+	static constexpr size_t subBuckets = 1 << subBits;
+	static constexpr size_t bucketCount = ( 64 - subBits + 1 ) * subBuckets;
+
+	std::atomic<uint64_t> buckets[ bucketCount ] = { };
+	std::atomic<uint64_t> total = 0;
+	std::atomic<uint64_t> maximum = 0;
+
+	static size_t bucketOf( uint64_t ns ) {
+		if( ns < subBuckets )
+			return (size_t)ns;
+		size_t exp = std::bit_width( ns ) - 1;
+		return ( exp - subBits + 1 ) * subBuckets + ( ( ns >> ( exp - subBits ) ) & ( subBuckets - 1 ) );
+	};
+
+	// Largest value that lands in a bucket
+	static uint64_t bucketTop( size_t bucket ) {
+		if( bucket < subBuckets )
+			return bucket;
+		size_t exp = bucket / subBuckets + subBits - 1;
+		uint64_t sub = bucket % subBuckets;
+		return ( ( ( subBuckets + sub + 1 ) << ( exp - subBits ) ) ) - 1;
+	};
+
+public:
+
+	void record( uint64_t ns ) {
+		this->buckets[ bucketOf( ns ) ].fetch_add( 1, std::memory_order_relaxed );
+		this->total.fetch_add( 1, std::memory_order_relaxed );
+
+		uint64_t seen = this->maximum.load( std::memory_order_relaxed );
+		while( ns > seen && !this->maximum.compare_exchange_weak( seen, ns, std::memory_order_relaxed ) )
+			;
+	};
+
+	uint64_t count( ) const { return this->total.load( std::memory_order_relaxed ); };
+	uint64_t max( ) const { return this->maximum.load( std::memory_order_relaxed ); };
+
+	// Value at quantile q (0 - 1), to bucket precision
+	uint64_t percentile( double q ) const {
+
+		uint64_t want = (uint64_t)( q * this->count( ) );
+		if( want == 0 )
+			want = 1;
+
+		uint64_t seen = 0;
+		for( size_t bucket = 0; bucket < bucketCount; ++bucket ) {
+			seen += this->buckets[ bucket ].load( std::memory_order_relaxed );
+			if( seen >= want )
+				return std::min( bucketTop( bucket ), this->max( ) );
+		}
+
+		return this->max( );
+
+	};
+
+};
+
+// One histogram per stage, for the whole process
+inline LatencyHistogram & latency( LatencyStage stage ) {
+	static LatencyHistogram stages[ (size_t)LatencyStage::LS_COUNT ];
+	return stages[ (size_t)stage ];
+}
+
+// Human readable p50 / p99 / p999 / max per stage
+std::string latencyReport( );
+
+// Write the report to a file, replacing whatever was there -- Returns false on failure
+bool latencyDump( const std::string & path );
\ No newline at end of file
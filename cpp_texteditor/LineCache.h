@@ -0,0 +1,217 @@
+#pragma once
+
+#include "Utf8.h"
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Where the grapheme clusters of recently used lines fall, in bytes and in display columns
+// Cursor movement and drawing ask the same few lines the same questions over and over, so each line is laid out once
+//   and kept until an edit touches it -- A line is mostly clusters one byte long and one column wide, so only the
+//   ones that aren't are stored, and everything between two of them is worked out by counting
+//
+// Lines are keyed by the offset they start at -- Edits move the starts of the lines after them along, and a plain
+//   ASCII edit clear of anything wide or combined is applied to its line in place, so typing never lays a line out again
+class LineCache {
+public:
+
+	// A cluster that isn't one byte and one column -- Offsets from the start of the line
+	struct Odd {
+		size_t byte;
+		size_t col;
+		size_t bytes;
+		size_t cols;
+	};
+
+	struct Layout {
+
+		size_t start = 0;
+
+		// Bytes up to the newline, and columns they take
+		size_t length = 0;
+		size_t width = 0;
+
+		// In order
+		std::vector<Odd> odd;
+
+		// Column the cluster holding byte starts at -- length gives width
+		size_t column( size_t byte ) const {
+			auto it = std::upper_bound( this->odd.begin( ), this->odd.end( ), byte, [ ]( size_t b, const Odd & o ) { return b < o.byte; } );
+			if( it == this->odd.begin( ) )
+				return byte;
+			--it;
+			if( byte < it->byte + it->bytes )
+				return it->col;
+			return it->col + it->cols + ( byte - it->byte - it->bytes );
+		};
+
+		// Byte the cluster covering col starts at -- length for anything past the end
+		size_t byteAt( size_t col ) const {
+			if( col >= this->width )
+				return this->length;
+			auto it = std::upper_bound( this->odd.begin( ), this->odd.end( ), col, [ ]( size_t c, const Odd & o ) { return c < o.col; } );
+			if( it == this->odd.begin( ) )
+				return col;
+			--it;
+			if( col < it->col + it->cols )
+				return it->byte;
+			return it->byte + it->bytes + ( col - it->col - it->cols );
+		};
+
+		// Start of the cluster holding byte
+		size_t clusterStart( size_t byte ) const {
+			const Odd * o = this->covering( byte );
+			return o ? o->byte : byte;
+		};
+
+		// Start of the cluster after the one holding byte
+		size_t clusterEnd( size_t byte ) const {
+			const Odd * o = this->covering( byte );
+			return std::min( o ? o->byte + o->bytes : byte + 1, this->length );
+		};
+
+		const Odd * covering( size_t byte ) const {
+			auto it = std::upper_bound( this->odd.begin( ), this->odd.end( ), byte, [ ]( size_t b, const Odd & o ) { return b < o.byte; } );
+			if( it == this->odd.begin( ) )
+				return nullptr;
+			--it;
+			return byte < it->byte + it->bytes ? &*it : nullptr;
+		};
+
+	};
+
+	static constexpr size_t slots = 64;
+
+protected:
+
+	struct Slot {
+		Layout layout;
+		uint64_t used = 0;
+		bool valid = false;
+	};
+
+	std::array<Slot, slots> cache;
+	uint64_t tick = 0;
+
+public:
+
+	// The line starting at start, if it's here
+	const Layout * find( size_t start ) {
+		for( Slot & slot : this->cache ) {
+			if( slot.valid && slot.layout.start == start ) {
+				slot.used = ++this->tick;
+				return &slot.layout;
+			}
+		}
+		return nullptr;
+	};
+
+	// Lay out the line starting at start, [ text, text + len ) up to its newline, in place of the least recently used
+	const Layout & build( size_t start, const char * text, size_t len ) {
+
+		Slot * slot = &this->cache[ 0 ];
+		for( Slot & each : this->cache ) {
+			if( !each.valid ) {
+				slot = &each;
+				break;
+			}
+			if( each.used < slot->used )
+				slot = &each;
+		}
+
+		Layout & layout = slot->layout;
+		layout.start = start;
+		layout.length = len;
+		layout.odd.clear( );
+
+		size_t col = 0;
+		for( size_t at = 0; at < len; ) {
+			size_t cols;
+			size_t bytes = clusterAt( text + at, len - at, cols );
+			if( bytes != 1 || cols != 1 )
+				layout.odd.push_back( { at, col, bytes, cols } );
+			at += bytes;
+			col += cols;
+		}
+		layout.width = col;
+
+		slot->used = ++this->tick;
+		slot->valid = true;
+		return layout;
+
+	};
+
+	// [ off, off + removed ) was replaced with [ text, text + added ) -- text can be null if it isn't to hand,
+	//   and the lines it went into are laid out again
+	void edited( size_t off, size_t removed, const char * text, size_t added ) {
+
+		// Plain ASCII, no newlines, can't join onto anything or change how wide anything else is
+		bool plain = text || added == 0;
+		for( size_t idx = 0; idx < added && plain; ++idx )
+			plain = (unsigned char)text[ idx ] < 0x80 && text[ idx ] != '\n';
+
+		ptrdiff_t delta = (ptrdiff_t)added - (ptrdiff_t)removed;
+
+		for( Slot & slot : this->cache ) {
+
+			if( !slot.valid )
+				continue;
+			Layout & layout = slot.layout;
+
+			// Wholly after the edit
+			if( layout.start > off + removed ) {
+				layout.start += delta;
+				continue;
+			}
+
+			// Wholly before it
+			if( layout.start + layout.length < off )
+				continue;
+
+			// Anything starting before the line takes the newline in front of it too
+			slot.valid = plain && off >= layout.start && patch( layout, off - layout.start, removed, delta );
+
+		}
+
+	};
+
+	void clear( ) {
+		for( Slot & slot : this->cache )
+			slot.valid = false;
+	};
+
+protected:
+
+	// Apply a plain edit at byte off in layout -- False if it could change a cluster and the line has to be laid out again
+	static bool patch( Layout & layout, size_t off, size_t removed, ptrdiff_t delta ) {
+
+		// Takes the newline
+		if( off + removed > layout.length )
+			return false;
+
+		for( const Odd & o : layout.odd ) {
+			// Erasing next to a cluster can join it to what's on the other side, inserting in front of one
+			//   can give a mark something to attach to
+			if( removed ? o.byte <= off + removed && o.byte + o.bytes >= off : o.byte <= off && off < o.byte + o.bytes )
+				return false;
+			if( o.byte > off + removed )
+				break;
+		}
+
+		// Only in-line bytes went, so they took a column each
+		for( Odd & o : layout.odd ) {
+			if( o.byte > off ) {
+				o.byte += delta;
+				o.col += delta;
+			}
+		}
+		layout.length += delta;
+		layout.width += delta;
+		return true;
+
+	};
+
+};
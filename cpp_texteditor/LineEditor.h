@@ -7,6 +7,12 @@
 class LineEditor : public Editor {
 protected:
 	
-	std::vector<ScreenCommand> doConsumeKey( KeyEvent & key ) { return std::vector<ScreenCommand>( ); };
+	void doConsumeKey( KeyEvent & key, ScreenBatch & out ) { };
+
+public:
+
+	// Nothing is edited yet, so there is nothing to take back -- An UndoLog is all it will need once there is
+	void undo( ScreenBatch & out ) { };
+	void redo( ScreenBatch & out ) { };
 
 };
\ No newline at end of file
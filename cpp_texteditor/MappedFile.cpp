@@ -0,0 +1,226 @@
+#include "MappedFile.h"
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile( const std::string & path ) {
+
+	this->hFile = CreateFileA(
+		path.c_str( ),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL );
+	if( this->hFile == INVALID_HANDLE_VALUE )
+		throw std::system_error(
+			std::error_code(
+				GetLastError( ),
+				std::system_category( )
+			), "Failed to open file!" );
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( this->hFile, &size ) || !GetFileTime( this->hFile, NULL, NULL, &this->savedWrite ) ) {
+		DWORD err = GetLastError( );
+		CloseHandle( this->hFile );
+		throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to stat file!" );
+	}
+
+	this->len = (size_t)size.QuadPart;
+
+	// Zero length files can't be mapped, but there's nothing to map anyways
+	if( this->len == 0 )
+		return;
+
+	// Windows won't let the file shrink while this mapping exists, so no hole handling needed here
+	this->hMapping = CreateFileMapping( this->hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( this->hMapping != NULL )
+		this->base = (const char *)MapViewOfFile( this->hMapping, FILE_MAP_READ, 0, 0, 0 );
+
+	if( this->base == nullptr ) {
+		DWORD err = GetLastError( );
+		if( this->hMapping != NULL )
+			CloseHandle( this->hMapping );
+		CloseHandle( this->hFile );
+		throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to map file!" );
+	}
+
+};
+
+MappedFile::~MappedFile( ) {
+
+	if( this->base )
+		UnmapViewOfFile( this->base );
+	if( this->hMapping != NULL )
+		CloseHandle( this->hMapping );
+	CloseHandle( this->hFile );
+
+};
+
+bool MappedFile::changed( ) {
+
+	LARGE_INTEGER size;
+	FILETIME write;
+	if( !GetFileSizeEx( this->hFile, &size ) || !GetFileTime( this->hFile, NULL, NULL, &write ) )
+		return true;
+
+	return (size_t)size.QuadPart != this->len || CompareFileTime( &write, &this->savedWrite ) != 0;
+
+};
+
+#else
+
+// Every live mapping gets a slot here so the SIGBUS handler can tell our faults from anybody else's
+// Plain atomics only, the handler can't take locks
+namespace {
+
+	struct MappingSlot {
+		std::atomic<const char *> base = nullptr;
+		std::atomic<size_t> len = 0;
+		std::atomic<std::atomic<bool> *> hole = nullptr;
+	};
+
+	constexpr size_t maxMappings = 16;
+	MappingSlot mappings[ maxMappings ];
+
+	size_t pageSize = 0;
+	struct sigaction previousAction;
+
+	void onSigbus( int sig, siginfo_t * info, void * ctx ) {
+
+		const char * addr = (const char *)info->si_addr;
+
+		for( MappingSlot & slot : mappings ) {
+			const char * base = slot.base.load( std::memory_order_acquire );
+			std::atomic<bool> * hole = slot.hole.load( std::memory_order_acquire );
+			if( base == nullptr || hole == nullptr || addr < base || addr >= base + slot.len.load( std::memory_order_relaxed ) )
+				continue;
+
+			// One of ours -- The file shrank under us
+			// Put a zero page where the file data used to be, and retry the access
+			void * page = (void *)( (uintptr_t)addr & ~( pageSize - 1 ) );
+			if( mmap( page, pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0 ) == MAP_FAILED )
+				break;
+
+			hole->store( true, std::memory_order_relaxed );
+			return;
+		}
+
+		// Not a mapping we know about, let whoever was there before deal with it
+		sigaction( SIGBUS, &previousAction, nullptr );
+		raise( SIGBUS );
+
+	};
+
+	void installHandler( ) {
+
+		static std::once_flag installed;
+		std::call_once( installed, [ ]( ) {
+			pageSize = (size_t)sysconf( _SC_PAGESIZE );
+
+			struct sigaction action = { };
+			action.sa_sigaction = onSigbus;
+			action.sa_flags = SA_SIGINFO;
+			sigemptyset( &action.sa_mask );
+			sigaction( SIGBUS, &action, &previousAction );
+		} );
+
+	};
+
+	long long mtimeOf( const struct stat & st ) {
+		return (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	};
+
+}
+
+MappedFile::MappedFile( const std::string & path ) {
+
+	this->fd = open( path.c_str( ), O_RDONLY | O_CLOEXEC );
+	if( this->fd < 0 )
+		throw std::system_error( std::error_code( errno, std::system_category( ) ), "Failed to open file!" );
+
+	struct stat st;
+	if( fstat( this->fd, &st ) != 0 ) {
+		int err = errno;
+		close( this->fd );
+		throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to stat file!" );
+	}
+
+	this->len = (size_t)st.st_size;
+	this->savedMtime = mtimeOf( st );
+
+	// Zero length files can't be mapped, but there's nothing to map anyways
+	if( this->len == 0 )
+		return;
+
+	installHandler( );
+
+	void * mapped = mmap( nullptr, this->len, PROT_READ, MAP_PRIVATE, this->fd, 0 );
+	if( mapped == MAP_FAILED ) {
+		int err = errno;
+		close( this->fd );
+		throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to map file!" );
+	}
+
+	this->base = (const char *)mapped;
+
+	// We'll be reading front to back far more often than not
+	madvise( mapped, this->len, MADV_SEQUENTIAL );
+
+	// Register with the SIGBUS handler
+	// Nothing can touch the mapping until we return, so filling in the slot after claiming it is fine
+	for( MappingSlot & slot : mappings ) {
+		const char * expected = nullptr;
+		if( slot.base.compare_exchange_strong( expected, this->base, std::memory_order_acq_rel ) ) {
+			slot.len.store( this->len, std::memory_order_relaxed );
+			slot.hole.store( &this->hole, std::memory_order_release );
+			return;
+		}
+	}
+
+	munmap( mapped, this->len );
+	close( this->fd );
+	throw std::system_error( std::make_error_code( std::errc::too_many_files_open ), "Too many mapped files!" );
+
+};
+
+MappedFile::~MappedFile( ) {
+
+	if( this->base ) {
+		for( MappingSlot & slot : mappings ) {
+			if( slot.base.load( std::memory_order_relaxed ) != this->base )
+				continue;
+			slot.hole.store( nullptr, std::memory_order_relaxed );
+			slot.base.store( nullptr, std::memory_order_release );
+			break;
+		}
+		munmap( (void *)this->base, this->len );
+	}
+
+	close( this->fd );
+
+};
+
+bool MappedFile::changed( ) {
+
+	struct stat st;
+	if( fstat( this->fd, &st ) != 0 )
+		return true;
+
+	return (size_t)st.st_size != this->len || mtimeOf( st ) != this->savedMtime || this->hole;
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+
+#ifdef _WIN32
+#include "Windows.h"
+#endif
+
+// RAII wrapper around a read-only memory mapping of a whole file
+// Opening only sets up page tables, bytes get faulted in from the page cache as they are first touched
+// Hand data( ) straight to a text backend as its original buffer, nothing gets copied
+//
+// If somebody else truncates the file under us, touching the missing pages would normally SIGBUS
+//   We catch that, map zero pages over the hole, and flag the file as truncated instead of dying
+class MappedFile {
+protected:
+
+	const char * base = nullptr;
+	size_t len = 0;
+
+	// Set from the SIGBUS handler when we had to patch over a hole
+	std::atomic<bool> hole = false;
+
+#ifdef _WIN32
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = NULL;
+	FILETIME savedWrite = { };
+#else
+	int fd = -1;
+	long long savedMtime = 0;
+#endif
+
+public:
+	// Map the file, throw a system_error if we can't
+	MappedFile( const std::string & path );
+
+	// Unmap and close
+	~MappedFile( );
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile & operator=( const MappedFile & ) = delete;
+
+	const char * data( ) const { return this->base; };
+	size_t size( ) const { return this->len; };
+
+	// Has the file on disk been modified or resized since we mapped it?
+	bool changed( );
+
+	// Did we have to paper over pages lost to a truncation?
+	bool truncated( ) const { return this->hole; };
+
+};
\ No newline at end of file
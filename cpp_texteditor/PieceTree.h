@@ -0,0 +1,675 @@
+#pragma once
+
+#include "BufferEditor.h"
+#include "FileIndexer.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+
+// Editor implementing a piece tree
+// The text is never copied around: the original file sits untouched in one buffer, everything typed is appended to a second one,
+//   and the document is a sequence of pieces pointing into either of them
+// Pieces live in a treap keyed implicitly by byte offset, every node caching the byte and newline totals of its subtree
+// That makes offset lookup, line lookup, insert and delete all O(log n) no matter how far apart the edits are
+//
+// A big file is indexed as far as the first screen needs when it's loaded, and a FileIndexer reads the rest in the
+//   background -- Each chunk goes on the end of the document as it arrives, so the part that's loaded is always the
+//   front of the file, bar whatever's been edited, and a key that needs more than that waits for just enough of it
+class PieceTree : public BufferEditor<PieceTree> {
+protected:
+
+	// A single node -- One piece, plus its subtree totals
+	// Index 0 is the nil node, all zeros, so the totals never need null checks
+	struct Node {
+		size_t left = 0;
+		size_t right = 0;
+		uint32_t prio = 0;
+
+		// The piece itself
+		bool add = false;
+		size_t start = 0;
+		size_t len = 0;
+		size_t lf = 0;
+
+		// Totals over the subtree
+		size_t sumLen = 0;
+		size_t sumLf = 0;
+	};
+
+	std::vector<Node> nodes = std::vector<Node>( 1 );
+	std::vector<size_t> freeNodes;
+	size_t root = 0;
+
+	// Original buffer -- Read only, and usually memory we don't own (a file mapping)
+	// origOwner keeps whatever backs it alive for as long as we point into it
+	std::shared_ptr<const void> origOwner;
+	const char * orig = nullptr;
+	size_t origLen = 0;
+
+	// How much of the original buffer is in the document yet, the rest is still being read
+	// Declared after origOwner so the reading stops before the bytes go
+	static constexpr size_t leadSize = 1 << 20;
+	size_t origLoaded = 0;
+	size_t origInvalid = 0;
+	std::unique_ptr<FileIndexer> indexer;
+
+	// First line the last chunks went onto, for doPoll to draw from if it's on screen
+	size_t grewLine = (size_t)-1;
+
+	// Add buffer -- Append only, in fixed size blocks that never move once allocated, so a Snapshot can keep reading them
+	// Offsets run on from one block to the next, block k holding [ k * addBlock, ( k + 1 ) * addBlock ),
+	//   and no piece ever crosses from one block into the next
+	static constexpr size_t addBlock = 1 << 20;
+	std::vector<std::shared_ptr<char[ ]>> addBlocks;
+	size_t addLen = 0;
+
+	// Offsets of every newline in each buffer, so counting them over a piece is a pair of binary searches
+	std::vector<size_t> origLines;
+	std::vector<size_t> addLines;
+
+	// Scratch path for extending the last piece in place
+	std::vector<size_t> path;
+
+	// Treap priorities, xorshift is plenty
+	uint32_t seed = 0x9E3779B9;
+
+	uint32_t nextPrio( ) {
+		this->seed ^= this->seed << 13;
+		this->seed ^= this->seed >> 17;
+		this->seed ^= this->seed << 5;
+		return this->seed;
+	};
+
+	// Undo log spans pointing straight at either buffer -- Neither is ever overwritten, so erased text never needs copying
+	static constexpr uint32_t origSpan = 1;
+	static constexpr uint32_t addSpan = 2;
+
+	// First byte of a piece
+	const char * pieceData( const Node & n ) const {
+		return n.add ? this->addBlocks[ n.start / addBlock ].get( ) + n.start % addBlock : this->orig + n.start;
+	};
+	const std::vector<size_t> & linesOf( bool add ) const { return add ? this->addLines : this->origLines; };
+
+	// Number of newlines in [start, start + len) of one of the buffers
+	size_t countLines( bool add, size_t start, size_t len ) const {
+		const std::vector<size_t> & lines = this->linesOf( add );
+		return std::lower_bound( lines.begin( ), lines.end( ), start + len ) - std::lower_bound( lines.begin( ), lines.end( ), start );
+	};
+
+	// Node management -- Reserve up front so references stay valid through a whole split / merge
+	void reserveNodes( size_t count ) {
+		if( this->freeNodes.size( ) < count && this->nodes.capacity( ) < this->nodes.size( ) + count )
+			this->nodes.reserve( std::max( this->nodes.size( ) * 2, this->nodes.size( ) + count ) );
+	};
+
+	size_t makeNode( bool add, size_t start, size_t len ) {
+
+		size_t idx;
+		if( !this->freeNodes.empty( ) ) {
+			idx = this->freeNodes.back( );
+			this->freeNodes.pop_back( );
+		} else {
+			idx = this->nodes.size( );
+			this->nodes.emplace_back( );
+		}
+
+		Node & n = this->nodes[ idx ];
+		n = Node( );
+		n.prio = this->nextPrio( );
+		n.add = add;
+		n.start = start;
+		n.len = len;
+		n.lf = this->countLines( add, start, len );
+		n.sumLen = n.len;
+		n.sumLf = n.lf;
+
+		return idx;
+
+	};
+
+	void freeTree( size_t t ) {
+		if( !t )
+			return;
+		this->freeTree( this->nodes[ t ].left );
+		this->freeTree( this->nodes[ t ].right );
+		this->freeNodes.push_back( t );
+	};
+
+	void update( size_t t ) {
+		Node & n = this->nodes[ t ];
+		n.sumLen = n.len + this->nodes[ n.left ].sumLen + this->nodes[ n.right ].sumLen;
+		n.sumLf = n.lf + this->nodes[ n.left ].sumLf + this->nodes[ n.right ].sumLf;
+	};
+
+	size_t merge( size_t a, size_t b ) {
+
+		if( !a )
+			return b;
+		if( !b )
+			return a;
+
+		if( this->nodes[ a ].prio > this->nodes[ b ].prio ) {
+			this->nodes[ a ].right = this->merge( this->nodes[ a ].right, b );
+			this->update( a );
+			return a;
+		}
+
+		this->nodes[ b ].left = this->merge( a, this->nodes[ b ].left );
+		this->update( b );
+		return b;
+
+	};
+
+	// Split t so that l holds the first off bytes and r the rest
+	// A piece straddling off is cut in two -- This allocates at most one node
+	void split( size_t t, size_t off, size_t & l, size_t & r ) {
+
+		if( !t ) {
+			l = r = 0;
+			return;
+		}
+
+		Node & n = this->nodes[ t ];
+		size_t leftLen = this->nodes[ n.left ].sumLen;
+
+		if( off <= leftLen ) {
+			this->split( n.left, off, l, n.left );
+			r = t;
+		} else if( off >= leftLen + n.len ) {
+			this->split( n.right, off - leftLen - n.len, n.right, r );
+			l = t;
+		} else {
+			size_t cut = off - leftLen;
+			size_t tail = this->makeNode( n.add, n.start + cut, n.len - cut );
+
+			n.len = cut;
+			n.lf -= this->nodes[ tail ].lf;
+
+			r = this->merge( tail, n.right );
+			n.right = 0;
+			l = t;
+		}
+
+		this->update( t );
+
+	};
+
+	// Append onto the piece ending at off, if it is the piece that ends at the tail of the add buffer
+	// This is what typing looks like, and it keeps a long run of keystrokes down to a single piece
+	bool extendAt( size_t off, size_t addStart, size_t len, size_t lf ) {
+
+		if( off == 0 )
+			return false;
+
+		this->path.clear( );
+
+		size_t t = this->root;
+		size_t pos = off - 1;
+		while( t ) {
+			this->path.push_back( t );
+			Node & n = this->nodes[ t ];
+			size_t leftLen = this->nodes[ n.left ].sumLen;
+
+			if( pos < leftLen ) {
+				t = n.left;
+			} else if( pos < leftLen + n.len ) {
+				if( !n.add || pos - leftLen != n.len - 1 || n.start + n.len != addStart || addStart % addBlock == 0 )
+					return false;
+
+				n.len += len;
+				n.lf += lf;
+				for( size_t idx : this->path ) {
+					this->nodes[ idx ].sumLen += len;
+					this->nodes[ idx ].sumLf += lf;
+				}
+				return true;
+			} else {
+				pos -= leftLen + n.len;
+				t = n.right;
+			}
+		}
+
+		return false;
+
+	};
+
+	// The next stretch of the original buffer goes on the end, onto the last piece if it carries straight on from it
+	void appendOrig( size_t start, size_t len, size_t lf ) {
+
+		this->path.clear( );
+
+		size_t t = this->root;
+		while( t && this->nodes[ t ].right ) {
+			this->path.push_back( t );
+			t = this->nodes[ t ].right;
+		}
+
+		if( t && !this->nodes[ t ].add && this->nodes[ t ].start + this->nodes[ t ].len == start ) {
+			this->path.push_back( t );
+			this->nodes[ t ].len += len;
+			this->nodes[ t ].lf += lf;
+			for( size_t idx : this->path ) {
+				this->nodes[ idx ].sumLen += len;
+				this->nodes[ idx ].sumLf += lf;
+			}
+			return;
+		}
+
+		this->reserveNodes( 1 );
+		this->root = this->merge( this->root, this->makeNode( false, start, len ) );
+
+	};
+
+	// Only once something polls or waits, whoever drives us sets up how we wake it after loading
+	void startIndexing( ) {
+		if( this->origLoaded < this->origLen && !this->indexer )
+			this->indexer = std::make_unique<FileIndexer>( this->orig, this->origLoaded, this->origLen, this->origOwner, [ this ]( ) {
+				if( this->wake )
+					this->wake( );
+			} );
+	};
+
+	// Put a chunk from the indexer on the end -- Same as an insert there as far as the layouts and colours go,
+	//   but there's nothing to undo
+	void absorb( IndexedChunk & chunk ) {
+
+		size_t end = this->length( );
+		size_t line = this->lineCount( ) - 1;
+		size_t lf = chunk.lines.size( );
+
+		this->origLines.insert( this->origLines.end( ), chunk.lines.begin( ), chunk.lines.end( ) );
+		this->appendOrig( chunk.start, chunk.len, lf );
+		this->origLoaded = chunk.start + chunk.len;
+		this->origInvalid += chunk.invalid;
+
+		this->layouts.edited( end, 0, nullptr, chunk.len );
+		if( this->highlight.active( ) )
+			this->recolour( line, 0, lf );
+		this->grewLine = std::min( this->grewLine, line );
+
+	};
+
+	// Take chunks until done says stop, waiting for them if wait is set
+	template<typename F>
+	void absorbWhile( bool wait, F done ) {
+
+		if( this->origLoaded == this->origLen )
+			return;
+
+		this->startIndexing( );
+		IndexedChunk chunk;
+		while( this->origLoaded < this->origLen && !done( ) && ( wait ? this->indexer->wait( chunk ) : this->indexer->poll( chunk ) ) )
+			this->absorb( chunk );
+
+		if( this->origLoaded == this->origLen )
+			this->indexer.reset( );
+
+	};
+
+	// Same walk again, handing each piece to visit in place -- Stops as soon as visit returns true
+	template<typename F>
+	bool chunksFrom( size_t t, size_t base, size_t off, size_t end, F & visit ) {
+
+		if( !t )
+			return false;
+
+		const Node & n = this->nodes[ t ];
+		size_t pieceStart = base + this->nodes[ n.left ].sumLen;
+		size_t pieceEnd = pieceStart + n.len;
+
+		if( off < pieceStart && this->chunksFrom( n.left, base, off, end, visit ) )
+			return true;
+
+		size_t from = std::max( off, pieceStart );
+		size_t to = std::min( end, pieceEnd );
+		if( from < to && visit( this->pieceData( n ) + ( from - pieceStart ), to - from, from ) )
+			return true;
+
+		return end > pieceEnd && this->chunksFrom( n.right, pieceEnd, off, end, visit );
+
+	};
+
+	template<typename F>
+	bool chunksBackFrom( size_t t, size_t base, size_t off, size_t end, F & visit ) {
+
+		if( !t )
+			return false;
+
+		const Node & n = this->nodes[ t ];
+		size_t pieceStart = base + this->nodes[ n.left ].sumLen;
+		size_t pieceEnd = pieceStart + n.len;
+
+		if( end > pieceEnd && this->chunksBackFrom( n.right, pieceEnd, off, end, visit ) )
+			return true;
+
+		size_t from = std::max( off, pieceStart );
+		size_t to = std::min( end, pieceEnd );
+		if( from < to && visit( this->pieceData( n ) + ( from - pieceStart ), to - from, from ) )
+			return true;
+
+		return off < pieceStart && this->chunksBackFrom( n.left, base, off, end, visit );
+
+	};
+
+	// Same walk as extractFrom, but handing the undo log the pieces instead of their bytes
+	void saveFrom( size_t t, size_t base, size_t off, size_t end, UndoLog & log ) {
+
+		if( !t )
+			return;
+
+		const Node & n = this->nodes[ t ];
+		size_t pieceStart = base + this->nodes[ n.left ].sumLen;
+		size_t pieceEnd = pieceStart + n.len;
+
+		if( off < pieceStart )
+			this->saveFrom( n.left, base, off, end, log );
+
+		size_t from = std::max( off, pieceStart );
+		size_t to = std::min( end, pieceEnd );
+		if( from < to )
+			log.reference( n.add ? addSpan : origSpan, n.start + ( from - pieceStart ), to - from );
+
+		if( end > pieceEnd )
+			this->saveFrom( n.right, pieceEnd, off, end, log );
+
+	};
+
+	void extractFrom( size_t t, size_t base, size_t off, size_t end, char * & out ) {
+
+		if( !t )
+			return;
+
+		const Node & n = this->nodes[ t ];
+		size_t pieceStart = base + this->nodes[ n.left ].sumLen;
+		size_t pieceEnd = pieceStart + n.len;
+
+		if( off < pieceStart )
+			this->extractFrom( n.left, base, off, end, out );
+
+		size_t from = std::max( off, pieceStart );
+		size_t to = std::min( end, pieceEnd );
+		if( from < to ) {
+			std::memcpy( out, this->pieceData( n ) + ( from - pieceStart ), to - from );
+			out += to - from;
+		}
+
+		if( end > pieceEnd )
+			this->extractFrom( n.right, pieceEnd, off, end, out );
+
+	};
+
+public:
+
+	// Replace the whole document -- The bytes are used in place as the original buffer, never copied
+	void load( const char * data, size_t len, std::shared_ptr<const void> owner ) {
+
+		// The history points into the buffers we're about to replace, and the layouts are of lines that are going
+		// Anything still reading the old file stops first
+		this->indexer.reset( );
+		this->history.clear( );
+		this->layouts.clear( );
+
+		this->origOwner = std::move( owner );
+		this->orig = data;
+		this->origLen = len;
+
+		// Enough for the first screen now, the rest comes in from the indexer
+		IndexedChunk lead = FileIndexer::index( data, 0, FileIndexer::cut( data, 0, len, leadSize ) );
+		this->origLines = std::move( lead.lines );
+		this->origLoaded = lead.len;
+		this->origInvalid = lead.invalid;
+		this->grewLine = (size_t)-1;
+
+		this->addBlocks.clear( );
+		this->addLen = 0;
+		this->addLines.clear( );
+
+		this->nodes.resize( 1 );
+		this->freeNodes.clear( );
+		this->root = this->origLoaded ? this->makeNode( false, 0, this->origLoaded ) : 0;
+
+		this->curr = this->currx = this->curry = this->goalx = this->top = 0;
+		this->dropCursors( );
+
+		// Colours start over on the new text, if it had them
+		this->setHighlighting( this->highlight.active( ) );
+
+	};
+
+	// Block until the byte at off is loaded, or all of it is -- Past the end waits for the whole file
+	void awaitOffset( size_t off ) {
+		this->absorbWhile( true, [ & ]( ) { return off < this->length( ); } );
+	};
+
+	// Block until line and the newline ending it are loaded, or all of it is
+	void awaitLine( size_t line ) {
+		this->absorbWhile( true, [ & ]( ) { return line + 1 < this->lineCount( ); } );
+	};
+
+	BufferEditor<PieceTree>::LoadStatus loadStatus( ) const {
+		return { this->origLoaded < this->origLen, this->origLoaded, this->origLen, this->lineCount( ), this->origInvalid };
+	};
+
+	// Same, but we take ownership of the string
+	void load( std::string && text ) {
+		std::shared_ptr<std::string> owned = std::make_shared<std::string>( std::move( text ) );
+		this->load( owned->data( ), owned->length( ), owned );
+	};
+
+	// Number of newlines before off
+	size_t linesBefore( size_t off ) const {
+
+		size_t count = 0;
+		size_t t = this->root;
+		while( t ) {
+			const Node & n = this->nodes[ t ];
+			size_t leftLen = this->nodes[ n.left ].sumLen;
+
+			if( off <= leftLen ) {
+				t = n.left;
+			} else if( off <= leftLen + n.len ) {
+				return count + this->nodes[ n.left ].sumLf + this->countLines( n.add, n.start, off - leftLen );
+			} else {
+				count += this->nodes[ n.left ].sumLf + n.lf;
+				off -= leftLen + n.len;
+				t = n.right;
+			}
+		}
+
+		return count;
+
+	};
+
+	// Offset of the k-th newline, counting from 1 -- length if there aren't that many
+	size_t newlineAt( size_t k ) const {
+
+		size_t base = 0;
+		size_t t = this->root;
+		while( t ) {
+			const Node & n = this->nodes[ t ];
+			size_t leftLf = this->nodes[ n.left ].sumLf;
+
+			if( k <= leftLf ) {
+				t = n.left;
+			} else if( k <= leftLf + n.lf ) {
+				const std::vector<size_t> & lines = this->linesOf( n.add );
+				size_t first = std::lower_bound( lines.begin( ), lines.end( ), n.start ) - lines.begin( );
+				return base + this->nodes[ n.left ].sumLen + ( lines[ first + k - leftLf - 1 ] - n.start );
+			} else {
+				k -= leftLf + n.lf;
+				base += this->nodes[ n.left ].sumLen + n.len;
+				t = n.right;
+			}
+		}
+
+		return this->length( );
+
+	};
+
+	// Line helpers
+	size_t lineCount( ) const { return this->nodes[ this->root ].sumLf + 1; };
+	size_t offsetOfLine( size_t line ) const { return line == 0 ? 0 : std::min( this->newlineAt( line ) + 1, this->length( ) ); };
+
+	// Storage primitives for BufferEditor
+
+	size_t length( ) const { return this->nodes[ this->root ].sumLen; };
+
+	char at( size_t off ) const {
+
+		size_t t = this->root;
+		while( t ) {
+			const Node & n = this->nodes[ t ];
+			size_t leftLen = this->nodes[ n.left ].sumLen;
+
+			if( off < leftLen ) {
+				t = n.left;
+			} else if( off < leftLen + n.len ) {
+				return this->pieceData( n )[ off - leftLen ];
+			} else {
+				off -= leftLen + n.len;
+				t = n.right;
+			}
+		}
+
+		return '\0';
+
+	};
+
+	void insert( size_t off, const char * str, size_t len ) {
+
+		// A piece can't run from one add block into the next, so a long insert goes in a block's worth at a time
+		while( len > 0 ) {
+
+			if( this->addLen == this->addBlocks.size( ) * addBlock )
+				this->addBlocks.push_back( std::make_shared<char[ ]>( addBlock ) );
+
+			size_t addStart = this->addLen;
+			size_t part = std::min( len, addBlock - addStart % addBlock );
+			std::memcpy( this->addBlocks.back( ).get( ) + addStart % addBlock, str, part );
+			this->addLen += part;
+
+			size_t before = this->addLines.size( );
+			findNewlines( str, part, addStart, this->addLines );
+			size_t lf = this->addLines.size( ) - before;
+
+			if( !this->extendAt( off, addStart, part, lf ) ) {
+				this->reserveNodes( 2 );
+
+				size_t l, r;
+				this->split( this->root, off, l, r );
+				this->root = this->merge( this->merge( l, this->makeNode( true, addStart, part ) ), r );
+			}
+
+			off += part;
+			str += part;
+			len -= part;
+
+		}
+
+	};
+
+	void erase( size_t off, size_t len ) {
+
+		if( len == 0 )
+			return;
+
+		this->reserveNodes( 2 );
+
+		size_t l, m, r;
+		this->split( this->root, off, l, m );
+		this->split( m, len, m, r );
+
+		this->freeTree( m );
+		this->root = this->merge( l, r );
+
+	};
+
+	// Line scans straight off the newline counts
+
+	size_t lineStart( size_t off ) {
+		size_t k = this->linesBefore( off );
+		return k == 0 ? 0 : this->newlineAt( k ) + 1;
+	};
+
+	size_t lineEnd( size_t off ) {
+		return this->newlineAt( this->linesBefore( off ) + 1 );
+	};
+
+	void extract( size_t off, size_t len, char * out ) {
+		this->extractFrom( this->root, 0, off, off + len, out );
+	};
+
+	// Searching goes piece by piece, straight out of the two buffers
+	template<typename F>
+	bool forChunks( size_t from, size_t to, F && visit ) {
+		return this->chunksFrom( this->root, 0, from, to, visit );
+	};
+
+	template<typename F>
+	bool forChunksBack( size_t from, size_t to, F && visit ) {
+		return this->chunksBackFrom( this->root, 0, from, to, visit );
+	};
+
+	// Every piece as it stands, pointing into the buffers -- Neither buffer ever changes under a piece, so nothing is copied
+	std::shared_ptr<const Snapshot> snapshot( ) {
+
+		std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>( );
+		this->forChunks( 0, this->length( ), [ & ]( const char * data, size_t len, size_t off ) {
+			snap->add( data, len );
+			return false;
+		} );
+
+		// What's still to be read goes on the end, where it's going to be
+		if( this->origLoaded < this->origLen )
+			snap->add( this->orig + this->origLoaded, this->origLen - this->origLoaded );
+
+		snap->owners.push_back( this->origOwner );
+		snap->owners.insert( snap->owners.end( ), this->addBlocks.begin( ), this->addBlocks.end( ) );
+		return snap;
+
+	};
+
+	// Undo keeps erased text as pieces, so taking back even a huge erase is a split and a merge
+	void save( size_t off, size_t len, UndoLog & log ) {
+		this->saveFrom( this->root, 0, off, off + len, log );
+	};
+
+	void restore( size_t off, const UndoLog::Span & span, UndoLog & log ) {
+
+		if( span.source == UndoLog::ownText ) {
+			this->insert( off, log.text( span ), span.len );
+			return;
+		}
+
+		this->reserveNodes( 2 );
+
+		size_t l, r;
+		this->split( this->root, off, l, r );
+		this->root = this->merge( this->merge( l, this->makeNode( span.source == addSpan, span.start, span.len ) ), r );
+
+	};
+
+protected:
+
+	// Whatever's come in since last time goes on the end, and gets drawn if it's on screen
+	void doPoll( ScreenBatch & out ) {
+
+		this->absorbWhile( false, [ ]( ) { return false; } );
+
+		if( this->grewLine != (size_t)-1 ) {
+			if( this->grewLine < this->top + this->textRows( ) ) {
+				size_t line = std::max( this->grewLine, this->top );
+				this->drawFrom( out, this->offsetOfLine( line ), line - this->top );
+				this->placeCursor( out );
+			}
+			this->grewLine = (size_t)-1;
+		}
+
+		BufferEditor<PieceTree>::doPoll( out );
+
+	};
+
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Keyboard.h"
+#include "Editor.h"
+#include "Screen.h"
+#include "ScreenBatch.h"
+
+#include <concepts>
+#include <vector>
+
+// Keyboard -> Editor -> Screen on a single thread, with the three ends as template parameters
+// Instantiated over the abstract classes this is the usual virtual pipeline, and anything can be plugged in at runtime
+// Instantiated over Sealed concrete classes the compiler knows the exact type behind every call,
+//   so the do* hooks stop being virtual calls and the whole per-key path can inline into run( )
+
+// What each end has to provide -- The abstract classes satisfy these, and so does everything derived from them
+template<typename K>
+concept KeySource = requires( K & kb ) {
+	{ kb.readKey( ) } -> std::same_as<KeyEvent>;
+	{ kb.keysReady( ) } -> std::same_as<bool>;
+	{ kb.waitKeys( ) } -> std::same_as<bool>;
+};
+
+template<typename E>
+concept KeyConsumer = requires( E & editor, KeyEvent & key, ScreenBatch & out ) {
+	editor.consumeKey( key, out );
+	editor.poll( out );
+};
+
+template<typename S>
+concept CommandSink = requires( S & screen, ScreenCommand & sc ) {
+	{ screen.consumeCommand( sc ) } -> std::same_as<bool>;
+	{ screen.flush( ) } -> std::same_as<bool>;
+};
+
+// Nothing can derive from this, so a call through a Sealed<T> can only ever land in T's overrides
+// The entry points are shadowed with ones that call the hooks through Sealed<T>, which the compiler binds directly
+//   Through a Keyboard / Editor / Screen reference the same object still works the usual virtual way
+template<typename T>
+class Sealed final : public T {
+
+	// The bases call our hooks on our behalf
+	friend class Keyboard;
+	friend class Editor;
+	friend class Screen;
+
+public:
+	using T::T;
+
+	KeyEvent readKey( ) requires std::derived_from<T, Keyboard> { return Keyboard::readKeyOf( *this ); };
+	bool keysReady( ) requires std::derived_from<T, Keyboard> { return Keyboard::keysReadyOf( *this ); };
+	bool waitKeys( ) requires std::derived_from<T, Keyboard> { return Keyboard::waitKeysOf( *this ); };
+
+	void consumeKey( KeyEvent & key, ScreenBatch & out ) requires std::derived_from<T, Editor> { Editor::consumeKeyOf( *this, key, out ); };
+
+	bool consumeCommand( ScreenCommand & sc ) requires std::derived_from<T, Screen> { return Screen::consumeCommandOf( *this, sc ); };
+	bool flush( ) requires std::derived_from<T, Screen> { return Screen::flushOf( *this ); };
+
+};
+
+template<KeySource K, KeyConsumer E, CommandSink S>
+class Pipeline {
+protected:
+
+	K & kb;
+	E & editor;
+	S & screen;
+
+	// Reused for every key
+	ScreenBatch batch;
+
+public:
+	Pipeline( K & kb, E & editor, S & screen ) : kb( kb ), editor( editor ), screen( screen ) { };
+
+	// One key all the way through to the screen's back buffer
+	void step( KeyEvent & key ) {
+		this->editor.consumeKey( key, this->batch );
+		for( ScreenCommand & sc : this->batch.commands( ) )
+			this->screen.consumeCommand( sc );
+		this->batch.clear( );
+	};
+
+	// Until the keyboard runs dry or Ctrl-Q, one frame per batch of ready keys -- Returns how many keys went through
+	size_t run( ) {
+
+		size_t events = 0;
+
+		while( this->kb.waitKeys( ) ) {
+
+			bool quit = false;
+			while( !quit && this->kb.keysReady( ) ) {
+				KeyEvent key = this->kb.readKey( );
+				quit = isQuitKey( key );
+				if( !quit ) {
+					this->step( key );
+					++events;
+				}
+			}
+
+			// And whatever background work finished meanwhile
+			this->editor.poll( this->batch );
+			for( ScreenCommand & sc : this->batch.commands( ) )
+				this->screen.consumeCommand( sc );
+			this->batch.clear( );
+
+			this->screen.flush( );
+			if( quit )
+				break;
+
+		}
+
+		return events;
+
+	};
+
+};
+
+// The type-erased form, for when the ends are only known at runtime
+using DynamicPipeline = Pipeline<Keyboard, Editor, Screen>;
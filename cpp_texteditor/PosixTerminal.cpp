@@ -0,0 +1,382 @@
+// Only built where there's a POSIX terminal -- WinConsole covers Windows
+#ifndef _WIN32
+
+#include "PosixTerminal.h"
+#include <system_error>
+#include <charconv>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+// The SIGWINCH handler can only reach statics, so the wake pipe lives out here
+namespace {
+
+	int wakePipe[ 2 ] = { -1, -1 };
+
+	// Set by SIGWINCH, picked up by the next readKey
+	std::atomic<bool> resized = false;
+
+	void wake( ) {
+		char byte = 0;
+		// Full pipe is fine, there's a wakeup pending already
+		ssize_t ignored = write( wakePipe[ 1 ], &byte, 1 );
+		(void)ignored;
+	};
+
+	// Whoever wrote to the pipe set their flag first, so all that's left is to empty it
+	void drainWake( ) {
+		char drain[ 64 ];
+		while( read( wakePipe[ 0 ], drain, sizeof( drain ) ) > 0 )
+			;
+	};
+
+	void onWinch( int sig ) {
+		int saved = errno;
+		resized.store( true, std::memory_order_relaxed );
+		wake( );
+		errno = saved;
+	};
+
+	// Biggest single read from the terminal
+	constexpr size_t readChunk = 65536;
+
+	// How long to wait for the rest of an escape sequence
+	constexpr int escTimeout = 25;
+
+	void appendNumber( std::string & out, size_t num ) {
+		char digits[ 24 ];
+		std::to_chars_result res = std::to_chars( digits, digits + sizeof( digits ), num );
+		out.append( digits, res.ptr );
+	};
+
+}
+
+PosixTerminal::PosixTerminal( ) {
+
+	if( !isatty( STDIN_FILENO ) || !isatty( STDOUT_FILENO ) )
+		throw std::system_error( std::make_error_code( std::errc::inappropriate_io_control_operation ), "Not a terminal!" );
+
+	// Save the current mode
+	if( tcgetattr( STDIN_FILENO, &this->savedMode ) != 0 )
+		throw std::system_error( std::error_code( errno, std::system_category( ) ), "tcgetattr failed!" );
+
+	// Raw mode -- No echo, no line buffering, no signals from ^C / ^Z, no flow control eating ^Q / ^S
+	struct termios raw = this->savedMode;
+	raw.c_iflag &= ~( BRKINT | ICRNL | INPCK | ISTRIP | IXON );
+	raw.c_oflag &= ~( OPOST );
+	raw.c_cflag |= CS8;
+	raw.c_lflag &= ~( ECHO | ICANON | IEXTEN | ISIG );
+	raw.c_cc[ VMIN ] = 1;
+	raw.c_cc[ VTIME ] = 0;
+	if( tcsetattr( STDIN_FILENO, TCSAFLUSH, &raw ) != 0 )
+		throw std::system_error( std::error_code( errno, std::system_category( ) ), "tcsetattr failed!" );
+
+	// Wake pipe for SIGWINCH and interrupts -- Non blocking both ends so the handler can never stall
+	if( wakePipe[ 0 ] < 0 ) {
+		if( pipe( wakePipe ) != 0 ) {
+			int err = errno;
+			tcsetattr( STDIN_FILENO, TCSAFLUSH, &this->savedMode );
+			throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to create wake pipe!" );
+		}
+		for( int fd : wakePipe ) {
+			fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+			fcntl( fd, F_SETFD, FD_CLOEXEC );
+		}
+	}
+
+	struct sigaction action = { };
+	action.sa_handler = onWinch;
+	action.sa_flags = SA_RESTART;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGWINCH, &action, nullptr );
+
+	// Switch to alternate screen buffer, and have pastes bracketed so they come in as one key
+	// VTESC [ ? 1 0 4 9 h VTESC [ ? 2 0 0 4 h
+	if( !this->writeAll( "\x1b[?1049h\x1b[?2004h", 16 ) ) {
+		int err = errno;
+		tcsetattr( STDIN_FILENO, TCSAFLUSH, &this->savedMode );
+		throw std::system_error( std::error_code( err, std::system_category( ) ), "Failed to switch to alternative buffer!" );
+	}
+
+	this->querySize( this->cols, this->rows );
+
+};
+
+PosixTerminal::~PosixTerminal( ) {
+
+	// Pastes back to plain typing, then the standard screen buffer, drawing in the default colour
+	// If these fail there's not much we can do about it
+	// VTESC [ ? 2 0 0 4 l VTESC [ 0 m VTESC [ ? 1 0 4 9 l
+	this->writeAll( "\x1b[?2004l\x1b[0m\x1b[?1049l", 20 );
+
+	signal( SIGWINCH, SIG_DFL );
+	tcsetattr( STDIN_FILENO, TCSAFLUSH, &this->savedMode );
+
+};
+
+void PosixTerminal::querySize( size_t & cols, size_t & rows ) {
+
+	struct winsize ws;
+	if( ioctl( STDOUT_FILENO, TIOCGWINSZ, &ws ) != 0 || ws.ws_col == 0 )
+		throw std::system_error( std::error_code( errno, std::system_category( ) ), "Failed to get window size!" );
+
+	cols = ws.ws_col;
+	rows = ws.ws_row;
+
+};
+
+bool PosixTerminal::doInit( ) {
+
+	// All init done in the constructor
+	return true;
+
+};
+
+void PosixTerminal::appendMove( size_t x, size_t y ) {
+
+	// VT positions are 1 based
+	this->outBuf += "\x1b[";
+	appendNumber( this->outBuf, y + 1 );
+	this->outBuf += ';';
+	appendNumber( this->outBuf, x + 1 );
+	this->outBuf += 'H';
+
+	this->curx = x;
+	this->cury = y;
+
+};
+
+bool PosixTerminal::writeAll( const char * data, size_t len ) {
+
+	while( len > 0 ) {
+
+		ssize_t written = write( STDOUT_FILENO, data, len );
+		++this->frameSyscalls;
+
+		if( written < 0 ) {
+			if( errno == EINTR || errno == EAGAIN )
+				continue;
+			return false;
+		}
+
+		data += written;
+		len -= written;
+
+	}
+
+	return true;
+
+};
+
+bool PosixTerminal::doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour ) {
+
+	// Hide the cursor while the frame is going out, so it doesn't dance around the screen
+	if( this->outBuf.empty( ) )
+		this->outBuf += "\x1b[?25l";
+
+	if( x != this->curx || y != this->cury )
+		this->appendMove( x, y );
+
+	if( colour != this->colour ) {
+		this->outBuf += sgrFor( colour );
+		this->colour = colour;
+	}
+
+	this->outBuf.append( str, len );
+	this->curx = x + width;
+
+	return true;
+
+};
+
+bool PosixTerminal::doMoveCursor( size_t x, size_t y ) {
+
+	x = std::min( x, this->cols - 1 );
+
+	if( x != this->curx || y != this->cury )
+		this->appendMove( x, y );
+
+	return true;
+
+};
+
+bool PosixTerminal::doScrollRows( size_t top, size_t bottom, ptrdiff_t lines ) {
+
+	if( this->outBuf.empty( ) )
+		this->outBuf += "\x1b[?25l";
+
+	// Rows scroll in blank in whatever colour is set
+	if( this->colour != Colour::CL_DEFAULT ) {
+		this->outBuf += sgrFor( Colour::CL_DEFAULT );
+		this->colour = Colour::CL_DEFAULT;
+	}
+
+	// Set the region, scroll it, and put the region back to the whole screen
+	// VTESC [ top ; bottom r VTESC [ n S ( or T for down ) VTESC [ r
+	this->outBuf += "\x1b[";
+	appendNumber( this->outBuf, top + 1 );
+	this->outBuf += ';';
+	appendNumber( this->outBuf, bottom );
+	this->outBuf += "r\x1b[";
+	appendNumber( this->outBuf, lines < 0 ? -lines : lines );
+	this->outBuf += lines < 0 ? 'T' : 'S';
+	this->outBuf += "\x1b[r";
+
+	// Setting the region sends the cursor home
+	this->curx = 0;
+	this->cury = 0;
+
+	return true;
+
+};
+
+bool PosixTerminal::doPresent( ) {
+
+	if( this->outBuf.empty( ) )
+		return true;
+
+	// Only had to hide the cursor if we drew something
+	if( this->outBuf.compare( 0, 6, "\x1b[?25l" ) == 0 )
+		this->outBuf += "\x1b[?25h";
+
+	this->frameSyscalls = 0;
+	bool ok = this->writeAll( this->outBuf.data( ), this->outBuf.length( ) );
+
+	++this->frames;
+	this->syscalls += this->frameSyscalls;
+
+	this->outBuf.clear( );
+
+	return ok;
+
+};
+
+bool PosixTerminal::fill( int timeout ) {
+
+	// The wake pipe too, so an interrupt or a resize gets a blocked read back out to look at them
+	struct pollfd pfds[ 2 ] = {
+		{ STDIN_FILENO, POLLIN, 0 },
+		{ wakePipe[ 0 ], POLLIN, 0 },
+	};
+	if( poll( pfds, 2, timeout ) <= 0 )
+		return false;
+
+	if( pfds[ 1 ].revents & POLLIN )
+		drainWake( );
+	if( pfds[ 0 ].revents == 0 )
+		return false;
+
+	// Drop what's already been consumed before growing
+	if( this->inPos > 0 ) {
+		this->inBuf.erase( 0, this->inPos );
+		this->inPos = 0;
+	}
+
+	// Read straight onto the end of the buffer, big enough that a paste comes in with one call
+	size_t had = this->inBuf.length( );
+	this->inBuf.resize( had + readChunk );
+	ssize_t got = read( STDIN_FILENO, this->inBuf.data( ) + had, readChunk );
+	this->inBuf.resize( had + ( got > 0 ? got : 0 ) );
+
+	if( got < 0 ) {
+		if( errno == EINTR || errno == EAGAIN )
+			return false;
+		throw std::system_error( std::error_code( errno, std::system_category( ) ), "Failed to read from terminal" );
+	}
+
+	return got > 0;
+
+};
+
+bool PosixTerminal::decodeMore( int timeout ) {
+
+	if( !this->fill( timeout ) )
+		return false;
+
+	if( this->keyPos == this->keys.size( ) ) {
+		this->keys.clear( );
+		this->keyPos = 0;
+	}
+
+	while( true ) {
+
+		this->inPos += this->decoder.decode( this->inBuf.data( ) + this->inPos, this->inBuf.length( ) - this->inPos, this->keys );
+		if( this->inPos == this->inBuf.length( ) )
+			return true;
+
+		// A sequence was split across reads -- Give the rest of it a moment to arrive, otherwise take it as it is
+		//   This is also how a lone Esc is told apart from the start of a sequence
+		if( !this->fill( escTimeout ) ) {
+			this->inPos += this->decoder.decode( this->inBuf.data( ) + this->inPos, this->inBuf.length( ) - this->inPos, this->keys, true );
+			return true;
+		}
+
+	}
+
+};
+
+KeyEvent PosixTerminal::doReadKey( ) {
+
+	// Resizes jump the queue, the editor wants to redraw at the new size as soon as it can
+	if( resized.exchange( false, std::memory_order_relaxed ) ) {
+		size_t cols, rows;
+		this->querySize( cols, rows );
+		return KeyEvent( cols, rows );
+	}
+
+	// Bytes that decode to nothing ( unknown sequences ) mean going around again
+	// Nothing read at all means we were woken, and the caller has to see to whatever it was
+	while( this->keyPos == this->keys.size( ) )
+		if( !this->decodeMore( -1 ) )
+			return KeyEvent( );
+
+	return this->keys[ this->keyPos++ ];
+
+};
+
+bool PosixTerminal::doKeysReady( ) {
+
+	if( resized.load( std::memory_order_relaxed ) || this->keyPos < this->keys.size( ) || this->inPos < this->inBuf.length( ) )
+		return true;
+
+	struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+	return poll( &pfd, 1, 0 ) > 0;
+
+};
+
+bool PosixTerminal::doWaitKeys( ) {
+
+	while( !this->interrupted.load( std::memory_order_acquire ) ) {
+
+		if( this->doKeysReady( ) )
+			return true;
+
+		struct pollfd pfds[ 2 ] = {
+			{ STDIN_FILENO, POLLIN, 0 },
+			{ wakePipe[ 0 ], POLLIN, 0 },
+		};
+
+		if( poll( pfds, 2, -1 ) < 0 && errno != EINTR )
+			throw std::system_error( std::error_code( errno, std::system_category( ) ), "Failed to wait for input!" );
+
+		if( pfds[ 1 ].revents & POLLIN )
+			drainWake( );
+
+	}
+
+	return false;
+
+};
+
+void PosixTerminal::doInterrupt( ) {
+
+	this->interrupted.store( true, std::memory_order_release );
+	wake( );
+
+};
+
+#endif
\ No newline at end of file
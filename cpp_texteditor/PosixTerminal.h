@@ -0,0 +1,93 @@
+#pragma once
+
+#include "GridScreen.h"
+#include "Keyboard.h"
+#include "VtDecoder.h"
+
+#include <string>
+#include <atomic>
+#include <vector>
+
+#include <termios.h>
+
+// RAII wrapper around a VT compatible terminal on stdin / stdout, for everything that isn't Windows
+// Same split as WinConsole -- We are both the Screen and the Keyboard, and the Screen side sits on GridScreen
+// Output for a whole frame is accumulated in user space and handed to the kernel in a single write
+class PosixTerminal : public GridScreen, public Keyboard {
+protected:
+
+	// Terminal settings from before we went raw, restored on destruction
+	struct termios savedMode;
+
+	// Screen operations!
+
+	// Everything written this frame, flushed in doPresent
+	std::string outBuf;
+
+	// Where the terminal cursor is -- Unknown until the first move
+	size_t curx = (size_t)-1, cury = (size_t)-1;
+
+	// What the terminal is drawing text in
+	Colour colour = Colour::CL_DEFAULT;
+
+	// write( ) calls made, in total and during the last frame
+	size_t frames = 0;
+	size_t syscalls = 0;
+	size_t frameSyscalls = 0;
+
+	// Append a cursor move to outBuf
+	void appendMove( size_t x, size_t y );
+
+	// Push a buffer all the way out to the terminal, counting the writes it takes
+	bool writeAll( const char * data, size_t len );
+
+	bool doInit( );
+
+	bool doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour );
+	bool doMoveCursor( size_t x, size_t y );
+	bool doScrollRows( size_t top, size_t bottom, ptrdiff_t lines );
+	bool doPresent( );
+
+	// Keyboard operations!
+
+	// Bytes read from the terminal but not yet turned into KeyEvents -- Only ever the tail of a split sequence
+	std::string inBuf;
+	size_t inPos = 0;
+
+	// Keys decoded but not handed out yet
+	VtDecoder decoder;
+	std::vector<KeyEvent> keys;
+	size_t keyPos = 0;
+
+	// Set by interrupt, and announced through the wake pipe like SIGWINCH is
+	std::atomic<bool> interrupted = false;
+
+	// Read whatever is available right now onto inBuf, in one read -- Waits up to timeout ms for the first byte
+	bool fill( int timeout );
+
+	// Fill, then decode everything that came in onto keys -- False if nothing arrived
+	bool decodeMore( int timeout );
+
+	// Query the kernel for the window size
+	void querySize( size_t & cols, size_t & rows );
+
+	KeyEvent doReadKey( );
+	bool doKeysReady( );
+
+	// Sleep on stdin and the wake pipe together
+	bool doWaitKeys( );
+	void doInterrupt( );
+
+public:
+	// Put the terminal in raw mode on the alternate screen
+	PosixTerminal( );
+
+	// Put everything back the way we found it
+	~PosixTerminal( );
+
+	// Stats -- write( ) calls for the most recent frame, and averaged over all of them
+	size_t lastFrameSyscalls( ) const { return this->frameSyscalls; };
+	size_t frameCount( ) const { return this->frames; };
+	double syscallsPerFrame( ) const { return this->frames ? (double)this->syscalls / this->frames : 0.0; };
+
+};
\ No newline at end of file
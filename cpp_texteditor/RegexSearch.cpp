@@ -0,0 +1,203 @@
+#include "RegexSearch.h"
+
+#include <regex>
+#include <cstring>
+#include <algorithm>
+
+RegexSearch::RegexSearch( std::function<void( )> wake ) : wake( std::move( wake ) ) { };
+
+RegexSearch::~RegexSearch( ) {
+
+	this->cancel( );
+	this->jobs.close( );
+	this->results.close( );
+	if( this->worker.joinable( ) )
+		this->worker.join( );
+
+};
+
+uint64_t RegexSearch::start( std::shared_ptr<const Snapshot> text, const std::string & pattern, size_t from ) {
+
+	// Nobody searches until somebody asks to
+	if( !this->worker.joinable( ) )
+		this->worker = std::thread( &RegexSearch::run, this );
+
+	uint64_t scan = this->current.fetch_add( 1, std::memory_order_acq_rel ) + 1;
+
+	Job job;
+	job.scan = scan;
+	job.pattern = pattern;
+	job.text = std::move( text );
+	job.from = std::min( from, job.text->length );
+
+	// The worker takes jobs as fast as they come, skipping to the newest, so this only waits if it's stuck mid-push
+	this->jobs.push( std::move( job ) );
+	return scan;
+
+};
+
+void RegexSearch::cancel( ) {
+	this->current.fetch_add( 1, std::memory_order_acq_rel );
+};
+
+bool RegexSearch::poll( RegexResults & out ) {
+
+	uint64_t wanted = this->current.load( std::memory_order_relaxed );
+
+	// Batches from scans we've moved on from are just dropped
+	while( this->results.pop( out ) )
+		if( out.scan == wanted )
+			return true;
+
+	return false;
+
+};
+
+void RegexSearch::run( ) {
+
+	std::vector<Job> waiting;
+
+	while( this->jobs.wait( ) ) {
+
+		waiting.clear( );
+		this->jobs.pop_n( waiting );
+
+		// Only the newest can still be wanted
+		if( waiting.empty( ) || waiting.back( ).scan != this->current.load( std::memory_order_acquire ) )
+			continue;
+
+		this->scan( waiting.back( ) );
+
+	}
+
+};
+
+void RegexSearch::scan( Job & job ) {
+
+	RegexResults batch;
+	batch.scan = job.scan;
+
+	auto flush = [ this, &batch ]( ) {
+		RegexResults sent = std::move( batch );
+		batch = RegexResults( );
+		batch.scan = sent.scan;
+		batch.scanned = sent.scanned;
+		if( !this->results.push( std::move( sent ) ) )
+			return false;
+		if( this->wake )
+			this->wake( );
+		return true;
+	};
+
+	std::regex re;
+	try {
+		re = std::regex( job.pattern, std::regex::ECMAScript | std::regex::optimize );
+	} catch( std::regex_error & ) {
+		batch.invalid = true;
+		batch.done = true;
+		flush( );
+		return;
+	}
+
+	const Snapshot & text = *job.text;
+
+	// Where each chunk starts, to find the one holding an offset
+	std::vector<size_t> starts;
+	starts.reserve( text.chunks.size( ) );
+	size_t total = 0;
+	for( std::string_view chunk : text.chunks ) {
+		starts.push_back( total );
+		total += chunk.length( );
+	}
+
+	// A line that runs across chunks is put back together in here
+	std::string stitched;
+	size_t lastFlush = 0;
+
+	// The first match goes back on its own, that's the one the editor is waiting to jump to
+	bool sentMatch = false;
+
+	// Search one line ( or window of one ) starting at off
+	auto searchLine = [ & ]( const char * line, size_t len, size_t off ) {
+		for( std::cregex_iterator it( line, line + len, re ), end; it != end; ++it ) {
+			// Empty matches are everywhere for some patterns, and there's nothing there to show
+			if( it->length( 0 ) == 0 )
+				continue;
+			batch.matches.push_back( { off + (size_t)it->position( 0 ), (size_t)it->length( 0 ) } );
+		}
+	};
+
+	// Scan lines in [ begin, end ) -- begin is a line start, end is a line start or the end of the text
+	// False once the scan isn't wanted any more
+	auto scanRange = [ & ]( size_t begin, size_t end ) {
+
+		size_t chunk = std::upper_bound( starts.begin( ), starts.end( ), begin ) - starts.begin( ) - 1;
+		size_t at = begin;
+
+		while( at < end ) {
+
+			if( this->current.load( std::memory_order_relaxed ) != job.scan )
+				return false;
+
+			size_t lineOff = at;
+			stitched.clear( );
+			const char * line = nullptr;
+			size_t len = 0;
+
+			// Out to the newline, the window limit or the end, whichever comes first
+			while( at < end && len < maxLine ) {
+
+				while( at >= starts[ chunk ] + text.chunks[ chunk ].length( ) )
+					++chunk;
+
+				std::string_view piece = text.chunks[ chunk ];
+				size_t in = at - starts[ chunk ];
+				size_t avail = std::min( { piece.length( ) - in, end - at, maxLine - len } );
+				const char * from = piece.data( ) + in;
+				const char * nl = (const char *)std::memchr( from, '\n', avail );
+				size_t take = nl ? nl - from : avail;
+
+				if( len == 0 && stitched.empty( ) ) {
+					line = from;
+				} else {
+					if( stitched.empty( ) )
+						stitched.assign( line, len );
+					stitched.append( from, take );
+					line = stitched.data( );
+				}
+
+				len += take;
+				at += take;
+
+				if( nl ) {
+					// Step over the newline, it isn't part of the line
+					++at;
+					break;
+				}
+
+			}
+
+			if( len > 0 )
+				searchLine( line, len, lineOff );
+
+			batch.scanned += at - lineOff;
+			bool first = !sentMatch && !batch.matches.empty( );
+			if( first || batch.matches.size( ) >= batchMatches || batch.scanned - lastFlush >= batchBytes ) {
+				lastFlush = batch.scanned;
+				sentMatch |= first;
+				if( !flush( ) )
+					return false;
+			}
+
+		}
+
+		return true;
+
+	};
+
+	if( total == 0 || ( scanRange( job.from, total ) && scanRange( 0, job.from ) ) ) {
+		batch.done = true;
+		flush( );
+	}
+
+};
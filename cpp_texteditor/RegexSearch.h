@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Snapshot.h"
+#include "Channel.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+struct RegexMatch {
+	size_t off;
+	size_t len;
+};
+
+// A batch of matches streamed back from a scan, in the order they were found
+struct RegexResults {
+	uint64_t scan = 0;
+	std::vector<RegexMatch> matches;
+
+	// How far through the text the scan has got, and whether this is the last batch
+	size_t scanned = 0;
+	bool done = false;
+
+	// The pattern didn't compile -- Nothing else is coming for this scan
+	bool invalid = false;
+};
+
+// Regex search on a worker thread, over a Snapshot, so the editor keeps taking keys however long the scan runs
+// Matches are looked for a line at a time, starting from a line start and wrapping round to it, and come back in
+//   batches as they're found
+// Starting a new scan cancels the one in flight: the worker checks between lines and drops out as soon as it notices,
+//   and any of its batches still queued are recognised by their scan number and skipped
+//
+// Lines longer than maxLine are searched in maxLine windows, std::regex recurses per character on some patterns
+//   and a gigabyte with no newlines would take the worker's stack with it
+class RegexSearch {
+protected:
+
+	struct Job {
+		uint64_t scan = 0;
+		std::string pattern;
+		std::shared_ptr<const Snapshot> text;
+		size_t from = 0;
+	};
+
+	static constexpr size_t maxLine = 65536;
+
+	// Flush a batch once it holds this many matches, or the scan has moved this far since the last one
+	static constexpr size_t batchMatches = 256;
+	static constexpr size_t batchBytes = 4 << 20;
+
+	// Editor -> worker, and back
+	Channel<Job> jobs = Channel<Job>( 16 );
+	Channel<RegexResults> results = Channel<RegexResults>( 256 );
+
+	// The scan that's wanted -- Anything else still running gives up
+	std::atomic<uint64_t> current = 0;
+
+	std::function<void( )> wake;
+	std::thread worker;
+
+	void run( );
+	void scan( Job & job );
+
+public:
+
+	// No thread until the first scan
+	RegexSearch( std::function<void( )> wake );
+	~RegexSearch( );
+
+	// Search text for pattern, starting at the line beginning at from and wrapping round to it -- Returns the scan's number
+	uint64_t start( std::shared_ptr<const Snapshot> text, const std::string & pattern, size_t from );
+
+	// Stop the scan in flight, if any
+	void cancel( );
+
+	// Editor thread -- Next batch for the current scan, false if there isn't one yet
+	bool poll( RegexResults & out );
+
+};
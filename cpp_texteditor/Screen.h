@@ -2,7 +2,14 @@
 
 #include <utility>
 #include <string>
+#include <string_view>
+#include <span>
 #include <variant>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Latency.h"
 
 // The screen command class, documenting everything that we might tell the screen to do
 // These will be emitted by an Editor or Keyboard to update the screen
@@ -11,33 +18,84 @@ enum class ScreenCommandType {
 	SC_RESIZE,
 	SC_CLEAR,
 	SC_PUTSTRING,
+	SC_SCROLL,
 };
 
 struct ScreenCommandResize {
 	size_t cols;
 	size_t rows;
 };
+
+// Rows [ top, bottom ) move up by lines, or down when it's negative -- What's scrolled out is gone, what's scrolled
+//   in is blank, and nothing outside the rows moves
+struct ScreenCommandScroll {
+	size_t top;
+	size_t bottom;
+	ptrdiff_t lines;
+};
+
+// What text can be drawn as -- How each one looks is up to the screen
+enum class Colour : uint8_t {
+	CL_DEFAULT,
+	CL_KEYWORD,
+	CL_TYPE,
+	CL_NUMBER,
+	CL_STRING,
+	CL_COMMENT,
+	CL_PREPROCESSOR,
+
+	// Cursors other than the terminal's own, and the text they have selected
+	CL_CURSOR,
+	CL_SELECTION,
+};
+
+// The next len bytes of a PUTSTRING's text are drawn in colour
+struct ColourRun {
+	uint32_t len;
+	Colour colour;
+};
+
+// The text isn't owned -- It lives in the ScreenBatch the command came in, and so do its colour runs
+// No runs is all default, and so is anything past the end of them
 struct ScreenCommandPutStr {
-	std::string msg;
+	std::string_view msg;
 	size_t x;
 	size_t y;
 	bool insert;
+	std::span<ColourRun> runs = { };
+
+	// Columns the text covers -- Worked out by the ScreenBatch as it's added, the screen has no use for it
+	size_t width = 0;
 };
 
 struct ScreenCommand {
 
 	ScreenCommandType type;
 
-	std::variant<ScreenCommandResize, ScreenCommandPutStr> cmd;
+	std::variant<ScreenCommandResize, ScreenCommandPutStr, ScreenCommandScroll> cmd;
+
+	// Stamp of the key this came from, and when the editor finished with it -- 0 if not from a key
+	uint64_t keyStamp = 0;
+	uint64_t editStamp = 0;
 
 	ScreenCommand( ) : type( ScreenCommandType::SC_NOP ) { };
 	ScreenCommand( ScreenCommandType & sc ) : type( sc ) { };
 	ScreenCommand( size_t cols, size_t rows ) :
 		type( ScreenCommandType::SC_RESIZE ),
 		cmd( ScreenCommandResize( { cols, rows } ) ) { }
-	ScreenCommand( std::string && msg, size_t x, size_t y, bool insert = true ) :
+	ScreenCommand( std::string_view msg, size_t x, size_t y, bool insert = true ) :
 		type( ScreenCommandType::SC_PUTSTRING ),
-		cmd( ScreenCommandPutStr( { std::move( msg ), x, y, insert } ) ) { };
+		cmd( ScreenCommandPutStr( { msg, x, y, insert } ) ) { };
+	ScreenCommand( std::string_view msg, std::span<ColourRun> runs, size_t x, size_t y, bool insert = true ) :
+		type( ScreenCommandType::SC_PUTSTRING ),
+		cmd( ScreenCommandPutStr( { msg, x, y, insert, runs } ) ) { };
+	// Scroll -- A named constructor, it would clash with the resize one
+	static ScreenCommand scroll( size_t top, size_t bottom, ptrdiff_t lines ) {
+		ScreenCommand sc;
+		sc.type = ScreenCommandType::SC_SCROLL;
+		sc.cmd = ScreenCommandScroll( { top, bottom, lines } );
+		return sc;
+	};
 
 };
 
@@ -49,6 +107,10 @@ protected:
 	size_t rows = 0;
 	size_t cols = 0;
 
+	// Keys with commands consumed since the last flush, and when we first saw each
+	std::vector<std::pair<uint64_t, uint64_t>> pendingKeys;
+	uint64_t lastKey = 0;
+
 	// Do any initialization needed
 	virtual bool doInit( ) = 0;
 
@@ -57,44 +119,89 @@ protected:
 
 	// Set the size, realloc any buffers if needed
 	virtual bool doSetSize( size_t cols, size_t rows ) = 0;
-	// Put a string
-	virtual size_t doPutString( std::string & str, size_t x, size_t y, bool insert = true ) = 0;
-
-public:
-	// Public non-virtual init function
-	bool init( ) { return this->doInit( ) && this->clear( ); };
+	// Put a string, in the colours runs gives it -- Returns the bytes used
+	virtual size_t doPutString( std::string_view str, std::span<const ColourRun> runs, size_t x, size_t y, bool insert = true ) = 0;
+	// Scroll rows [ top, bottom ) up by lines, or down if negative, blanking what comes in
+	virtual bool doScroll( size_t top, size_t bottom, ptrdiff_t lines ) = 0;
+
+	// End of a frame -- Screens that buffer output push it to the device here
+	virtual bool doFlush( ) { return true; };
+
+	// Bodies of the entry points below, calling the hooks through Self -- See Keyboard::readKeyOf
+	template<typename Self>
+	static bool consumeCommandOf( Self & screen, ScreenCommand & sc ) {
+
+		// A key's commands arrive together, so only the first of them counts
+		if( sc.keyStamp && sc.keyStamp != screen.lastKey ) {
+			uint64_t now = latencyNow( );
+			screen.lastKey = sc.keyStamp;
+			latency( LatencyStage::LS_SCREEN_QUEUE ).record( now - sc.editStamp );
+			screen.pendingKeys.push_back( { sc.keyStamp, now } );
+		}
 
-	// Consume a screen command -- Call public funcs as needed
-	// Define this in the base, not the derived
-	bool consumeCommand( ScreenCommand & sc ) {
 		switch( sc.type ) {
 		case ScreenCommandType::SC_NOP:
 			return true;
 		case ScreenCommandType::SC_RESIZE:
 		{
 			ScreenCommandResize & size = std::get<ScreenCommandResize>( sc.cmd );
-			return this->setSize( size.cols, size.rows );
+			screen.rows = size.rows;
+			screen.cols = size.cols;
+			return screen.doSetSize( size.cols, size.rows );
 		}
 		case ScreenCommandType::SC_CLEAR:
-			return this->clear( );
+			return screen.doClear( );
 		case ScreenCommandType::SC_PUTSTRING:
 		{
 			ScreenCommandPutStr & message = std::get<ScreenCommandPutStr>( sc.cmd );
-			return this->putString( message.msg, message.x, message.y, message.insert ) == message.msg.length( );
+			return screen.doPutString( message.msg, message.runs, message.x, message.y, message.insert ) == message.msg.length( );
+		}
+		case ScreenCommandType::SC_SCROLL:
+		{
+			ScreenCommandScroll & scroll = std::get<ScreenCommandScroll>( sc.cmd );
+			return screen.doScroll( scroll.top, scroll.bottom, scroll.lines );
 		}
 		}
 
 		return false;
 	};
 
+	template<typename Self>
+	static bool flushOf( Self & screen ) {
+
+		bool ok = screen.doFlush( );
+
+		uint64_t now = latencyNow( );
+		for( std::pair<uint64_t, uint64_t> & key : screen.pendingKeys ) {
+			latency( LatencyStage::LS_RENDER ).record( now - key.second );
+			latency( LatencyStage::LS_TOTAL ).record( now - key.first );
+		}
+		screen.pendingKeys.clear( );
+
+		return ok;
+
+	};
+
+public:
+	// Public non-virtual init function
+	bool init( ) { return this->doInit( ) && this->clear( ); };
+
+	// Consume a screen command -- Call public funcs as needed
+	// Define this in the base, not the derived
+	bool consumeCommand( ScreenCommand & sc ) { return consumeCommandOf( *this, sc ); };
+
 	bool clear( ) { return this->doClear( ); }
 
+	// Called once the current batch of commands has been consumed
+	// This is where latency measurements end
+	bool flush( ) { return flushOf( *this ); };
+
 	// Get current size
 	std::pair<size_t, size_t> getSize( ) { return { this->rows, this->cols }; };
 	// Set size -- update the tracked size here
 	bool setSize( size_t cols, size_t rows ) { this->rows = rows; this->cols = cols; return this->doSetSize( cols, rows ); };
 
 	// Put a string on screen -- Trim if end of line reached
-	size_t putString( std::string & str, size_t x, size_t y, bool insert = true ) { return this->doPutString( str, x, y, insert ); }
+	size_t putString( std::string_view str, size_t x, size_t y, bool insert = true ) { return this->doPutString( str, { }, x, y, insert ); }
 
 };
\ No newline at end of file
@@ -0,0 +1,440 @@
+#pragma once
+
+#include "Screen.h"
+#include "Latency.h"
+#include "Utf8.h"
+
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// A frame's worth of ScreenCommands, handed from the editor to the screen as one unit
+// PUTSTRING text and colour runs live in the batch's own arena and the commands only view them, and batches are cleared and
+//   sent back to the editor to be refilled, so once the arenas have grown to fit a frame nothing here touches the heap
+//
+// While the screen is behind, the editor keeps adding to the same batch, and newer commands collapse the ones they supersede:
+//   A PUTSTRING trims or drops earlier PUTSTRINGs to the same cells (GridScreen overwrites, insert isn't honoured)
+//     Cells are columns, not bytes -- One that would have to be cut through a wide cluster is left whole, what comes
+//     after it lands on top anyway
+//   The cursor is wherever the last PUTSTRING left it, so an empty PUTSTRING is dropped by any later one
+//   A CLEAR drops every earlier PUTSTRING and CLEAR
+//   Consecutive RESIZEs collapse to the last one
+//   A SCROLL the same way over the same rows as the last one joins onto it, moving the PUTSTRINGs since then along
+//     with it and dropping those it scrolls off -- Any other is a wall no later PUTSTRING trims anything across
+// Dropped commands become SC_NOP, and their text is left behind in the arena until there's enough of it to compact,
+//   so what a batch holds is bounded by the screen size rather than by how far behind the screen is
+// Keys whose commands were all superseded never reach the screen, so they only show up in the input and edit latencies
+class ScreenBatch {
+
+	// Bump allocator over fixed blocks -- Growing never moves text a view already points at
+	class Arena {
+
+		static constexpr size_t blockSize = 16384;
+
+		struct Block {
+			std::unique_ptr<char[ ]> data;
+			size_t size;
+		};
+
+		std::vector<Block> blocks;
+		size_t current = 0;
+		size_t used = 0;
+
+	public:
+
+		// Bytes handed out since the last reset
+		size_t allocated = 0;
+
+		// align has to be a power of two, and no more than new[ ] gives blocks
+		char * alloc( size_t len, size_t align = 1 ) {
+
+			size_t pad = ( align - this->used % align ) % align;
+			while( this->current < this->blocks.size( ) && this->used + pad + len > this->blocks[ this->current ].size ) {
+				++this->current;
+				this->used = 0;
+				pad = 0;
+			}
+
+			if( this->current == this->blocks.size( ) ) {
+				size_t size = std::max( blockSize, len );
+				this->blocks.push_back( { std::make_unique<char[ ]>( size ), size } );
+				this->used = 0;
+				pad = 0;
+			}
+
+			char * at = this->blocks[ this->current ].data.get( ) + this->used + pad;
+			this->used += pad + len;
+			this->allocated += pad + len;
+			return at;
+
+		};
+
+		// Keep the blocks, start again from the first
+		void reset( ) {
+			this->current = 0;
+			this->used = 0;
+			this->allocated = 0;
+		};
+
+	};
+
+	static constexpr size_t none = (size_t)-1;
+
+	// Below this much garbage, compacting isn't worth it
+	static constexpr size_t compactSlack = 65536;
+
+	// Commands in order -- Superseded ones become SC_NOP
+	std::vector<ScreenCommand> cmds;
+
+	// Text goes in one arena, compacting copies what's still live into the other and swaps
+	Arena arenas[ 2 ];
+	size_t arena = 0;
+
+	// Live commands, and the bytes of text they view
+	size_t liveCmds = 0;
+	size_t liveText = 0;
+
+	// Live non-empty PUTSTRINGs on each row, as indices into cmds
+	std::vector<std::vector<size_t>> rowPuts;
+
+	// Last empty PUTSTRING, and last command of any kind
+	size_t lastCursor = none;
+	size_t lastLive = none;
+
+	// Last SCROLL, while nothing but PUTSTRINGs has come after it
+	size_t lastScroll = none;
+
+	// Key the commands being added came from -- 0 if none
+	uint64_t stamp = 0;
+
+	bool live( size_t idx ) const { return idx != none && this->cmds[ idx ].type != ScreenCommandType::SC_NOP; };
+
+	// Arena bytes a PUTSTRING is using
+	static size_t footprint( const ScreenCommandPutStr & put ) { return put.msg.length( ) + put.runs.size_bytes( ); };
+
+	void drop( size_t idx ) {
+		ScreenCommand & sc = this->cmds[ idx ];
+		if( sc.type == ScreenCommandType::SC_PUTSTRING )
+			this->liveText -= footprint( std::get<ScreenCommandPutStr>( sc.cmd ) );
+		sc.type = ScreenCommandType::SC_NOP;
+		--this->liveCmds;
+	};
+
+	// Cut the first cols columns off put, or all but the first cols -- False if that would cut a cluster in two
+	bool trimFront( ScreenCommandPutStr & put, size_t cols ) {
+
+		size_t used;
+		size_t bytes = clustersFitting( put.msg.data( ), put.msg.length( ), cols, used );
+		if( used != cols )
+			return false;
+
+		size_t before = footprint( put );
+		put.msg.remove_prefix( bytes );
+		put.x += cols;
+		put.width -= cols;
+
+		// Whole runs that went, then what's left of the one the cut went through
+		size_t run = 0;
+		while( run < put.runs.size( ) && bytes >= put.runs[ run ].len )
+			bytes -= put.runs[ run++ ].len;
+		put.runs = put.runs.subspan( run );
+		if( !put.runs.empty( ) )
+			put.runs[ 0 ].len -= (uint32_t)bytes;
+
+		this->liveText -= before - footprint( put );
+		return true;
+
+	};
+
+	bool trimBack( ScreenCommandPutStr & put, size_t cols ) {
+
+		size_t used;
+		size_t bytes = clustersFitting( put.msg.data( ), put.msg.length( ), cols, used );
+		if( used != cols )
+			return false;
+
+		size_t before = footprint( put );
+		put.msg = put.msg.substr( 0, bytes );
+		put.width = cols;
+
+		size_t run = 0, total = 0;
+		while( run < put.runs.size( ) && total < bytes )
+			total += put.runs[ run++ ].len;
+		put.runs = put.runs.first( run );
+		if( total > bytes )
+			put.runs[ run - 1 ].len -= (uint32_t)( total - bytes );
+
+		this->liveText -= before - footprint( put );
+		return true;
+
+	};
+
+	void push( ScreenCommand && sc ) {
+		if( this->stamp ) {
+			sc.keyStamp = this->stamp;
+			sc.editStamp = latencyNow( );
+		}
+		this->lastLive = this->cmds.size( );
+		this->cmds.push_back( std::move( sc ) );
+		++this->liveCmds;
+	};
+
+	void addPut( ScreenCommand && sc ) {
+
+		if( this->live( this->lastCursor ) )
+			this->drop( this->lastCursor );
+
+		ScreenCommandPutStr & put = std::get<ScreenCommandPutStr>( sc.cmd );
+		if( put.msg.empty( ) ) {
+			this->lastCursor = this->cmds.size( );
+			this->push( std::move( sc ) );
+			return;
+		}
+
+		clustersFitting( put.msg.data( ), put.msg.length( ), (size_t)-1, put.width );
+
+		if( put.y >= this->rowPuts.size( ) )
+			this->rowPuts.resize( put.y + 1 );
+		std::vector<size_t> & row = this->rowPuts[ put.y ];
+
+		// New write covers columns [ start, end ), cut it out of everything already on the row
+		size_t start = put.x, end = put.x + put.width;
+		size_t kept = 0;
+		for( size_t idx : row ) {
+
+			if( !this->live( idx ) )
+				continue;
+
+			ScreenCommandPutStr & old = std::get<ScreenCommandPutStr>( this->cmds[ idx ].cmd );
+			size_t oldStart = old.x, oldEnd = old.x + old.width;
+
+			if( oldStart >= start && oldEnd <= end ) {
+				this->drop( idx );
+				continue;
+			}
+
+			if( oldStart >= start && oldStart < end )
+				this->trimFront( old, end - oldStart );
+			else if( oldEnd > start && oldEnd <= end )
+				this->trimBack( old, start - oldStart );
+			// Covered in the middle -- Leave it, the new write lands on top of it anyway
+
+			row[ kept++ ] = idx;
+
+		}
+		row.resize( kept );
+
+		row.push_back( this->cmds.size( ) );
+		this->liveText += footprint( put );
+		this->push( std::move( sc ) );
+
+	};
+
+	void addClear( ScreenCommand && sc ) {
+
+		for( size_t idx = 0; idx < this->cmds.size( ); ++idx ) {
+			ScreenCommandType type = this->cmds[ idx ].type;
+			if( type == ScreenCommandType::SC_PUTSTRING || type == ScreenCommandType::SC_CLEAR || type == ScreenCommandType::SC_SCROLL )
+				this->drop( idx );
+		}
+		for( std::vector<size_t> & row : this->rowPuts )
+			row.clear( );
+
+		this->push( std::move( sc ) );
+
+	};
+
+	// Rows [ top, bottom ) of what's been drawn since the last scroll, moved up by lines or down if negative
+	void shiftPuts( size_t top, size_t bottom, ptrdiff_t lines ) {
+
+		if( this->rowPuts.size( ) < bottom )
+			this->rowPuts.resize( bottom );
+
+		size_t by = std::min<size_t>( lines < 0 ? -lines : lines, bottom - top );
+		auto first = this->rowPuts.begin( ) + top;
+		auto last = this->rowPuts.begin( ) + bottom;
+
+		// Rows scrolled off go, then the empty lists they leave come round to where rows scroll in
+		for( auto row = lines > 0 ? first : last - by; row != ( lines > 0 ? first + by : last ); ++row ) {
+			for( size_t idx : *row )
+				if( this->live( idx ) )
+					this->drop( idx );
+			row->clear( );
+		}
+		std::rotate( first, lines > 0 ? first + by : last - by, last );
+
+		for( size_t y = top; y < bottom; ++y )
+			for( size_t idx : this->rowPuts[ y ] )
+				if( this->live( idx ) )
+					std::get<ScreenCommandPutStr>( this->cmds[ idx ].cmd ).y = y;
+
+		if( this->live( this->lastCursor ) && this->lastCursor > this->lastScroll ) {
+			ScreenCommandPutStr & cursor = std::get<ScreenCommandPutStr>( this->cmds[ this->lastCursor ].cmd );
+			if( cursor.y >= top && cursor.y < bottom ) {
+				ptrdiff_t y = (ptrdiff_t)cursor.y - lines;
+				if( y >= (ptrdiff_t)top && y < (ptrdiff_t)bottom )
+					cursor.y = (size_t)y;
+				else
+					this->drop( this->lastCursor );
+			}
+		}
+
+	};
+
+	void addScroll( ScreenCommand && sc ) {
+
+		ScreenCommandScroll & scroll = std::get<ScreenCommandScroll>( sc.cmd );
+		if( scroll.lines == 0 || scroll.top >= scroll.bottom )
+			return;
+
+		if( this->live( this->lastScroll ) ) {
+			ScreenCommandScroll & last = std::get<ScreenCommandScroll>( this->cmds[ this->lastScroll ].cmd );
+			if( last.top == scroll.top && last.bottom == scroll.bottom && ( last.lines > 0 ) == ( scroll.lines > 0 ) ) {
+				last.lines += scroll.lines;
+				this->shiftPuts( scroll.top, scroll.bottom, scroll.lines );
+				return;
+			}
+		}
+
+		// Rows before and after don't line up, so nothing after trims anything before
+		for( std::vector<size_t> & row : this->rowPuts )
+			row.clear( );
+
+		this->lastScroll = this->cmds.size( );
+		this->push( std::move( sc ) );
+
+	};
+
+	void addResize( ScreenCommand && sc ) {
+
+		this->lastScroll = none;
+
+		if( this->live( this->lastLive ) && this->cmds[ this->lastLive ].type == ScreenCommandType::SC_RESIZE ) {
+			this->cmds[ this->lastLive ] = std::move( sc );
+			return;
+		}
+
+		this->push( std::move( sc ) );
+
+	};
+
+	// Squeeze out dropped commands and dead text once they outweigh what's live
+	void compact( ) {
+
+		if( this->cmds.size( ) < 2 * this->liveCmds + 1024 && this->arenas[ this->arena ].allocated < 2 * this->liveText + compactSlack )
+			return;
+
+		Arena & to = this->arenas[ this->arena ^ 1 ];
+		to.reset( );
+
+		for( std::vector<size_t> & row : this->rowPuts )
+			row.clear( );
+		this->lastCursor = none;
+		this->lastLive = none;
+		this->lastScroll = none;
+
+		size_t kept = 0;
+		for( size_t idx = 0; idx < this->cmds.size( ); ++idx ) {
+
+			ScreenCommand & sc = this->cmds[ idx ];
+			if( sc.type == ScreenCommandType::SC_NOP )
+				continue;
+
+			if( sc.type == ScreenCommandType::SC_PUTSTRING ) {
+				ScreenCommandPutStr & put = std::get<ScreenCommandPutStr>( sc.cmd );
+				if( put.msg.empty( ) ) {
+					this->lastCursor = kept;
+				} else {
+					char * text = to.alloc( put.msg.length( ) );
+					std::copy( put.msg.begin( ), put.msg.end( ), text );
+					put.msg = std::string_view( text, put.msg.length( ) );
+					if( !put.runs.empty( ) ) {
+						ColourRun * runs = (ColourRun *)to.alloc( put.runs.size_bytes( ), alignof( ColourRun ) );
+						std::copy( put.runs.begin( ), put.runs.end( ), runs );
+						put.runs = std::span<ColourRun>( runs, put.runs.size( ) );
+					}
+					this->rowPuts[ put.y ].push_back( kept );
+				}
+			} else if( sc.type == ScreenCommandType::SC_SCROLL ) {
+				for( std::vector<size_t> & row : this->rowPuts )
+					row.clear( );
+				this->lastScroll = kept;
+			} else {
+				this->lastScroll = none;
+			}
+
+			this->lastLive = kept;
+			if( kept != idx )
+				this->cmds[ kept ] = std::move( sc );
+			++kept;
+
+		}
+		this->cmds.resize( kept );
+
+		this->arenas[ this->arena ].reset( );
+		this->arena ^= 1;
+
+	};
+
+public:
+
+	// Room for len bytes of text, valid until the batch is cleared -- Fill it in, then add a PUTSTRING viewing it
+	char * text( size_t len ) { return this->arenas[ this->arena ].alloc( len ); };
+
+	// Same, for count colour runs to go with the text
+	ColourRun * runs( size_t count ) { return (ColourRun *)this->arenas[ this->arena ].alloc( count * sizeof( ColourRun ), alignof( ColourRun ) ); };
+
+	// Add a command, collapsing whatever it supersedes
+	void add( ScreenCommand && sc ) {
+
+		switch( sc.type ) {
+		case ScreenCommandType::SC_NOP:
+			return;
+		case ScreenCommandType::SC_PUTSTRING:
+			this->addPut( std::move( sc ) );
+			break;
+		case ScreenCommandType::SC_CLEAR:
+			this->addClear( std::move( sc ) );
+			break;
+		case ScreenCommandType::SC_RESIZE:
+			this->addResize( std::move( sc ) );
+			break;
+		case ScreenCommandType::SC_SCROLL:
+			this->addScroll( std::move( sc ) );
+			break;
+		}
+
+		this->compact( );
+
+	};
+
+	// Stamp everything added from here on as coming from this key, for latency tracking -- 0 to stop
+	void stampWith( uint64_t key ) { this->stamp = key; };
+
+	// Everything added, in order -- Superseded commands are left in as SC_NOP
+	std::vector<ScreenCommand> & commands( ) { return this->cmds; };
+
+	bool empty( ) const { return this->liveCmds == 0; };
+
+	// Ready to be refilled -- Everything keeps its storage
+	void clear( ) {
+
+		this->cmds.clear( );
+		this->arenas[ 0 ].reset( );
+		this->arenas[ 1 ].reset( );
+		for( std::vector<size_t> & row : this->rowPuts )
+			row.clear( );
+
+		this->liveCmds = 0;
+		this->liveText = 0;
+		this->lastCursor = none;
+		this->lastLive = none;
+		this->lastScroll = none;
+		this->stamp = 0;
+
+	};
+
+};
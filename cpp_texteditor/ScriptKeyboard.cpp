@@ -0,0 +1,203 @@
+#include "ScriptKeyboard.h"
+#include <system_error>
+#include <sstream>
+
+namespace {
+
+	int hexDigit( char c ) {
+		if( c >= '0' && c <= '9' )
+			return c - '0';
+		if( c >= 'a' && c <= 'f' )
+			return c - 'a' + 10;
+		if( c >= 'A' && c <= 'F' )
+			return c - 'A' + 10;
+		return -1;
+	};
+
+}
+
+std::string formatTraceLine( const TimedKeyEvent & ev ) {
+
+	std::ostringstream line;
+	line << ev.micros << ' ';
+
+	switch( ev.key.type ) {
+	case KeyEventType::KET_PRINT:
+	{
+		const KeyEventPrintable & prnt = std::get<KeyEventPrintable>( ev.key.event );
+		line << "P " << (uint32_t)prnt.code << ' '
+			<< ( ( prnt.shft ? 1 : 0 ) | ( prnt.ctrl ? 2 : 0 ) | ( prnt.alt ? 4 : 0 ) | ( prnt.os ? 8 : 0 ) );
+		break;
+	}
+	case KeyEventType::KET_CONTROL:
+		line << "C " << (int)std::get<KeyEventControl>( ev.key.event );
+		break;
+	case KeyEventType::KET_RESIZE:
+	{
+		const KeyEventResize & size = std::get<KeyEventResize>( ev.key.event );
+		line << "R " << size.cols << ' ' << size.rows;
+		break;
+	}
+	case KeyEventType::KET_PASTE:
+	{
+		static const char digits[ ] = "0123456789abcdef";
+		const std::string & text = *std::get<KeyEventPaste>( ev.key.event ).text;
+		std::string hex( text.length( ) * 2, '0' );
+		for( size_t idx = 0; idx < text.length( ); ++idx ) {
+			hex[ idx * 2 ] = digits[ (unsigned char)text[ idx ] >> 4 ];
+			hex[ idx * 2 + 1 ] = digits[ (unsigned char)text[ idx ] & 0xf ];
+		}
+		line << "V " << hex;
+		break;
+	}
+	}
+
+	return line.str( );
+
+};
+
+bool parseTraceLine( const std::string & line, TimedKeyEvent & ev ) {
+
+	std::istringstream in( line );
+	char kind;
+	if( !( in >> ev.micros >> kind ) )
+		return false;
+
+	switch( kind ) {
+	case 'P':
+	{
+		uint32_t code;
+		int mods;
+		if( !( in >> code >> mods ) )
+			return false;
+		ev.key = KeyEvent::character( code, mods & 1, mods & 2, mods & 4, mods & 8 );
+		return true;
+	}
+	case 'C':
+	{
+		int code;
+		if( !( in >> code ) )
+			return false;
+		ev.key = KeyEvent( (KeyEventControl)code );
+		return true;
+	}
+	case 'R':
+	{
+		size_t cols, rows;
+		if( !( in >> cols >> rows ) )
+			return false;
+		ev.key = KeyEvent( cols, rows );
+		return true;
+	}
+	case 'V':
+	{
+		// An empty paste has nothing after the V at all
+		std::string hex, text;
+		in >> hex;
+		if( hex.length( ) % 2 != 0 )
+			return false;
+		text.reserve( hex.length( ) / 2 );
+		for( size_t idx = 0; idx < hex.length( ); idx += 2 ) {
+			int hi = hexDigit( hex[ idx ] ), lo = hexDigit( hex[ idx + 1 ] );
+			if( hi < 0 || lo < 0 )
+				return false;
+			text.push_back( (char)( hi << 4 | lo ) );
+		}
+		ev.key = KeyEvent::paste( std::move( text ) );
+		return true;
+	}
+	}
+
+	return false;
+
+};
+
+ScriptKeyboard::ScriptKeyboard( const std::string & path, bool realtime ) : realtime( realtime ) {
+
+	std::ifstream in( path );
+	if( !in )
+		throw std::system_error( std::make_error_code( std::errc::no_such_file_or_directory ), "Failed to open key trace!" );
+
+	std::string line;
+	TimedKeyEvent ev;
+	while( std::getline( in, line ) ) {
+		if( line.empty( ) )
+			continue;
+		if( !parseTraceLine( line, ev ) )
+			throw std::system_error( std::make_error_code( std::errc::invalid_argument ), "Malformed key trace line: " + line );
+		this->events.push_back( ev );
+	}
+
+	this->started = std::chrono::steady_clock::now( );
+
+};
+
+KeyEvent ScriptKeyboard::doReadKey( ) {
+
+	if( this->next == this->events.size( ) )
+		return KeyEvent( );
+
+	return this->events[ this->next++ ].key;
+
+};
+
+bool ScriptKeyboard::doKeysReady( ) {
+
+	if( this->next == this->events.size( ) )
+		return false;
+
+	if( !this->realtime )
+		return true;
+
+	return std::chrono::steady_clock::now( ) - this->started >= std::chrono::microseconds( this->events[ this->next ].micros );
+
+};
+
+bool ScriptKeyboard::doWaitKeys( ) {
+
+	std::unique_lock<std::mutex> lock( this->wait_mtx );
+
+	if( this->interrupted || this->next == this->events.size( ) )
+		return false;
+
+	if( this->realtime ) {
+		std::chrono::steady_clock::time_point due = this->started + std::chrono::microseconds( this->events[ this->next ].micros );
+		this->wait_cv.wait_until( lock, due, [ this ]( ) { return this->interrupted; } );
+	}
+
+	return !this->interrupted;
+
+};
+
+void ScriptKeyboard::doInterrupt( ) {
+
+	std::unique_lock<std::mutex> lock( this->wait_mtx );
+	this->interrupted = true;
+	this->wait_cv.notify_all( );
+
+};
+
+RecordingKeyboard::RecordingKeyboard( std::shared_ptr<Keyboard> inner, const std::string & path ) :
+	inner( std::move( inner ) ), out( path ) {
+
+	if( !this->out )
+		throw std::system_error( std::make_error_code( std::errc::permission_denied ), "Failed to open key trace for writing!" );
+
+};
+
+KeyEvent RecordingKeyboard::doReadKey( ) {
+
+	KeyEvent key = this->inner->readKey( );
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+	if( this->first ) {
+		this->started = now;
+		this->first = false;
+	}
+
+	uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>( now - this->started ).count( );
+	this->out << formatTraceLine( { micros, key } ) << '\n';
+
+	return key;
+
+};
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Keyboard.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+
+// KeyEvent traces -- One event per line, microseconds since the first event up front:
+//   <us> P <code point> <modifier bits: shft 1, ctrl 2, alt 4, os 8>
+//   <us> C <KeyEventControl value>
+//   <us> R <cols> <rows>
+//   <us> V <pasted bytes, as hex>
+struct TimedKeyEvent {
+	uint64_t micros;
+	KeyEvent key;
+};
+
+// Format / parse one line of a trace -- Parse returns false on a malformed line
+std::string formatTraceLine( const TimedKeyEvent & ev );
+bool parseTraceLine( const std::string & line, TimedKeyEvent & ev );
+
+// Keyboard replaying a recorded trace
+// Flat out, every event is ready immediately, or with the original gaps between events
+// Once the trace runs out waitKeys returns false, same as when interrupted
+class ScriptKeyboard : public Keyboard {
+protected:
+
+	std::vector<TimedKeyEvent> events;
+	size_t next = 0;
+
+	bool realtime;
+	std::chrono::steady_clock::time_point started;
+
+	// Realtime waits sleep on this so interrupt can cut them short
+	std::mutex wait_mtx;
+	std::condition_variable wait_cv;
+	bool interrupted = false;
+
+	KeyEvent doReadKey( );
+	bool doKeysReady( );
+
+	bool doWaitKeys( );
+	void doInterrupt( );
+
+public:
+	// Load the whole trace up front, so file parsing never shows up in the replay
+	ScriptKeyboard( const std::string & path, bool realtime = false );
+
+	size_t eventCount( ) const { return this->events.size( ); };
+
+};
+
+// Keyboard wrapping another one, writing every key that goes through it to a trace file
+class RecordingKeyboard : public Keyboard {
+protected:
+
+	std::shared_ptr<Keyboard> inner;
+	std::ofstream out;
+	std::chrono::steady_clock::time_point started;
+	bool first = true;
+
+	KeyEvent doReadKey( );
+	bool doKeysReady( ) { return this->inner->keysReady( ); };
+
+	bool doWaitKeys( ) { return this->inner->waitKeys( ); };
+	void doInterrupt( ) { this->inner->interrupt( ); };
+
+public:
+	RecordingKeyboard( std::shared_ptr<Keyboard> inner, const std::string & path );
+
+};
\ No newline at end of file
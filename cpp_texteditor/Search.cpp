@@ -0,0 +1,315 @@
+#include "Search.h"
+
+#include <bit>
+#include <cstring>
+#include <cstdint>
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define SEARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC emits any intrinsic we ask for
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+#endif
+
+namespace {
+
+	// Whether the candidate at hay matches in full -- First and last byte are already known to
+	bool middleMatches( const char * hay, const std::string & needle ) {
+		return needle.length( ) <= 2 || std::memcmp( hay + 1, needle.data( ) + 1, needle.length( ) - 2 ) == 0;
+	};
+
+#ifdef SEARCH_X86
+
+	bool hasAvx2( ) {
+#ifdef _MSC_VER
+		int info[ 4 ];
+		__cpuid( info, 0 );
+		if( info[ 0 ] < 7 )
+			return false;
+		__cpuid( info, 1 );
+		if( !( info[ 2 ] & ( 1 << 27 ) ) || ( _xgetbv( 0 ) & 6 ) != 6 )
+			return false;
+		__cpuidex( info, 7, 0 );
+		return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+#else
+		return __builtin_cpu_supports( "avx2" );
+#endif
+	};
+
+	const bool avx2 = hasAvx2( );
+
+	// The kernels -- Each returns the offset of a match, or none, and sets scanned to how much of the range it got through
+	//   Forward that's the candidate starts it looked at, [ 0, scanned ), backward the ones in [ scanned, len - m + 1 )
+
+	size_t sse2Forward( const char * hay, size_t len, const std::string & needle, size_t & scanned ) {
+
+		size_t m = needle.length( );
+		const __m128i first = _mm_set1_epi8( needle[ 0 ] );
+		const __m128i last = _mm_set1_epi8( needle[ m - 1 ] );
+
+		size_t at = 0;
+		for( ; at + m - 1 + 16 <= len; at += 16 ) {
+			__m128i a = _mm_loadu_si128( (const __m128i *)( hay + at ) );
+			__m128i b = _mm_loadu_si128( (const __m128i *)( hay + at + m - 1 ) );
+			unsigned mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( a, first ), _mm_cmpeq_epi8( b, last ) ) );
+			for( ; mask; mask &= mask - 1 ) {
+				size_t cand = at + std::countr_zero( mask );
+				if( middleMatches( hay + cand, needle ) )
+					return cand;
+			}
+		}
+
+		scanned = at;
+		return Searcher::none;
+
+	};
+
+	size_t sse2Backward( const char * hay, size_t len, const std::string & needle, size_t & scanned ) {
+
+		size_t m = needle.length( );
+		const __m128i first = _mm_set1_epi8( needle[ 0 ] );
+		const __m128i last = _mm_set1_epi8( needle[ m - 1 ] );
+
+		size_t end = len - m + 1;
+		for( ; end >= 16; end -= 16 ) {
+			size_t at = end - 16;
+			__m128i a = _mm_loadu_si128( (const __m128i *)( hay + at ) );
+			__m128i b = _mm_loadu_si128( (const __m128i *)( hay + at + m - 1 ) );
+			unsigned mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( a, first ), _mm_cmpeq_epi8( b, last ) ) );
+			for( ; mask; mask &= ~( 1u << ( std::bit_width( mask ) - 1 ) ) ) {
+				size_t cand = at + std::bit_width( mask ) - 1;
+				if( middleMatches( hay + cand, needle ) )
+					return cand;
+			}
+		}
+
+		scanned = end;
+		return Searcher::none;
+
+	};
+
+	TARGET_AVX2 size_t avx2Forward( const char * hay, size_t len, const std::string & needle, size_t & scanned ) {
+
+		size_t m = needle.length( );
+		const __m256i first = _mm256_set1_epi8( needle[ 0 ] );
+		const __m256i last = _mm256_set1_epi8( needle[ m - 1 ] );
+
+		size_t at = 0;
+		for( ; at + m - 1 + 32 <= len; at += 32 ) {
+			__m256i a = _mm256_loadu_si256( (const __m256i *)( hay + at ) );
+			__m256i b = _mm256_loadu_si256( (const __m256i *)( hay + at + m - 1 ) );
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( a, first ), _mm256_cmpeq_epi8( b, last ) ) );
+			for( ; mask; mask &= mask - 1 ) {
+				size_t cand = at + std::countr_zero( mask );
+				if( middleMatches( hay + cand, needle ) )
+					return cand;
+			}
+		}
+
+		scanned = at;
+		return Searcher::none;
+
+	};
+
+	TARGET_AVX2 size_t avx2Backward( const char * hay, size_t len, const std::string & needle, size_t & scanned ) {
+
+		size_t m = needle.length( );
+		const __m256i first = _mm256_set1_epi8( needle[ 0 ] );
+		const __m256i last = _mm256_set1_epi8( needle[ m - 1 ] );
+
+		size_t end = len - m + 1;
+		for( ; end >= 32; end -= 32 ) {
+			size_t at = end - 32;
+			__m256i a = _mm256_loadu_si256( (const __m256i *)( hay + at ) );
+			__m256i b = _mm256_loadu_si256( (const __m256i *)( hay + at + m - 1 ) );
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( a, first ), _mm256_cmpeq_epi8( b, last ) ) );
+			for( ; mask; mask &= ~( 1u << ( std::bit_width( mask ) - 1 ) ) ) {
+				size_t cand = at + std::bit_width( mask ) - 1;
+				if( middleMatches( hay + cand, needle ) )
+					return cand;
+			}
+		}
+
+		scanned = end;
+		return Searcher::none;
+
+	};
+
+	// Newlines a vector at a time -- Each returns how far it got, the caller does the rest a byte at a time
+
+	size_t sse2Count( const char * data, size_t len, size_t & count ) {
+		const __m128i nl = _mm_set1_epi8( '\n' );
+		size_t at = 0;
+		for( ; at + 16 <= len; at += 16 ) {
+			__m128i v = _mm_loadu_si128( (const __m128i *)( data + at ) );
+			count += std::popcount( (unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( v, nl ) ) );
+		}
+		return at;
+	};
+
+	size_t sse2Find( const char * data, size_t len, size_t base, std::vector<size_t> & lines ) {
+		const __m128i nl = _mm_set1_epi8( '\n' );
+		size_t at = 0;
+		for( ; at + 16 <= len; at += 16 ) {
+			__m128i v = _mm_loadu_si128( (const __m128i *)( data + at ) );
+			for( unsigned mask = _mm_movemask_epi8( _mm_cmpeq_epi8( v, nl ) ); mask; mask &= mask - 1 )
+				lines.push_back( base + at + std::countr_zero( mask ) );
+		}
+		return at;
+	};
+
+	TARGET_AVX2 size_t avx2Count( const char * data, size_t len, size_t & count ) {
+		const __m256i nl = _mm256_set1_epi8( '\n' );
+		size_t at = 0;
+		for( ; at + 32 <= len; at += 32 ) {
+			__m256i v = _mm256_loadu_si256( (const __m256i *)( data + at ) );
+			count += std::popcount( (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( v, nl ) ) );
+		}
+		return at;
+	};
+
+	TARGET_AVX2 size_t avx2Find( const char * data, size_t len, size_t base, std::vector<size_t> & lines ) {
+		const __m256i nl = _mm256_set1_epi8( '\n' );
+		size_t at = 0;
+		for( ; at + 32 <= len; at += 32 ) {
+			__m256i v = _mm256_loadu_si256( (const __m256i *)( data + at ) );
+			for( uint32_t mask = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( v, nl ) ); mask; mask &= mask - 1 )
+				lines.push_back( base + at + std::countr_zero( mask ) );
+		}
+		return at;
+	};
+
+#endif
+
+}
+
+size_t countNewlines( const char * data, size_t len ) {
+
+	size_t count = 0;
+	size_t at = 0;
+
+#ifdef SEARCH_X86
+	at = avx2 ? avx2Count( data, len, count ) : sse2Count( data, len, count );
+#endif
+
+	for( ; at < len; ++at )
+		count += data[ at ] == '\n';
+	return count;
+
+};
+
+void findNewlines( const char * data, size_t len, size_t base, std::vector<size_t> & lines ) {
+
+	size_t at = 0;
+
+#ifdef SEARCH_X86
+	at = avx2 ? avx2Find( data, len, base, lines ) : sse2Find( data, len, base, lines );
+#endif
+
+	for( ; at < len; ++at )
+		if( data[ at ] == '\n' )
+			lines.push_back( base + at );
+
+};
+
+Searcher::Searcher( std::string_view needle ) : needle( needle ) {
+
+	size_t m = this->needle.length( );
+	const unsigned char * n = (const unsigned char *)this->needle.data( );
+
+	for( size_t c = 0; c < 256; ++c )
+		this->skipForward[ c ] = this->skipBackward[ c ] = m;
+
+	// Distance from each byte's last occurrence to the end, and from its first occurrence to the start, the ends left out
+	for( size_t idx = 0; idx + 1 < m; ++idx )
+		this->skipForward[ n[ idx ] ] = m - 1 - idx;
+	for( size_t idx = m - 1; idx > 0; --idx )
+		this->skipBackward[ n[ idx ] ] = idx;
+
+};
+
+size_t Searcher::horspoolForward( const char * hay, size_t len ) const {
+
+	size_t m = this->needle.length( );
+	const unsigned char * h = (const unsigned char *)hay;
+
+	for( size_t at = 0; at + m <= len; at += this->skipForward[ h[ at + m - 1 ] ] )
+		if( h[ at + m - 1 ] == (unsigned char)this->needle[ m - 1 ] && std::memcmp( hay + at, this->needle.data( ), m - 1 ) == 0 )
+			return at;
+
+	return none;
+
+};
+
+size_t Searcher::horspoolBackward( const char * hay, size_t len ) const {
+
+	size_t m = this->needle.length( );
+	const unsigned char * h = (const unsigned char *)hay;
+
+	if( len < m )
+		return none;
+
+	for( size_t at = len - m; ; ) {
+		if( h[ at ] == (unsigned char)this->needle[ 0 ] && std::memcmp( hay + at + 1, this->needle.data( ) + 1, m - 1 ) == 0 )
+			return at;
+
+		size_t skip = this->skipBackward[ h[ at ] ];
+		if( skip > at )
+			return none;
+		at -= skip;
+	}
+
+};
+
+size_t Searcher::forward( const char * hay, size_t len ) const {
+
+	size_t m = this->needle.length( );
+	if( m == 0 )
+		return 0;
+	if( len < m )
+		return none;
+
+	// One byte is memchr, which the C library already vectorizes
+	if( m == 1 ) {
+		const void * found = std::memchr( hay, this->needle[ 0 ], len );
+		return found ? (const char *)found - hay : none;
+	}
+
+	size_t start = 0;
+
+#ifdef SEARCH_X86
+	size_t found = avx2 ? avx2Forward( hay, len, this->needle, start ) : sse2Forward( hay, len, this->needle, start );
+	if( found != none )
+		return found;
+#endif
+
+	size_t tail = this->horspoolForward( hay + start, len - start );
+	return tail == none ? none : start + tail;
+
+};
+
+size_t Searcher::backward( const char * hay, size_t len ) const {
+
+	size_t m = this->needle.length( );
+	if( m == 0 )
+		return len;
+	if( len < m )
+		return none;
+
+	// Candidates in [ 0, end ) are left for the scalar pass, so it gets the bytes they can reach
+	size_t end = len - m + 1;
+
+#ifdef SEARCH_X86
+	size_t found = avx2 ? avx2Backward( hay, len, this->needle, end ) : sse2Backward( hay, len, this->needle, end );
+	if( found != none )
+		return found;
+#endif
+
+	return this->horspoolBackward( hay, end + m - 1 );
+
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Exact substring search over flat byte ranges, built once per query and reused for every range searched
+// On x86 candidates are found 16 or 32 bytes at a time by matching the query's first and last byte at once,
+//   and only positions where both line up are compared in full -- AVX2 is used when the CPU has it, SSE2 otherwise
+// What's left over at the edges, and everything on other targets, goes through Boyer-Moore-Horspool
+//
+// Texts that aren't one flat range are searched chunk by chunk, see BufferEditor::find -- A match straddling two chunks
+//   is caught by searching the seam, the last length - 1 bytes of one chunk joined to the first of the next
+class Searcher {
+protected:
+
+	std::string needle;
+
+	// Horspool shifts -- Forward by the byte under the window's last position, backward by the byte under its first
+	size_t skipForward[ 256 ];
+	size_t skipBackward[ 256 ];
+
+	size_t horspoolForward( const char * hay, size_t len ) const;
+	size_t horspoolBackward( const char * hay, size_t len ) const;
+
+public:
+
+	static constexpr size_t none = (size_t)-1;
+
+	explicit Searcher( std::string_view needle );
+
+	size_t length( ) const { return this->needle.length( ); };
+	std::string_view query( ) const { return this->needle; };
+
+	// Offset of the first / last occurrence in [ hay, hay + len ), or none
+	size_t forward( const char * hay, size_t len ) const;
+	size_t backward( const char * hay, size_t len ) const;
+
+};
+
+// Newline scanning for building line indexes, on the same kernels -- A whole file goes through these on load,
+//   so they compare a vector of bytes at a time and only stop on the newlines themselves
+size_t countNewlines( const char * data, size_t len );
+
+// Append base + the offset of every newline in [ data, data + len ) to lines, in order
+void findNewlines( const char * data, size_t len, size_t base, std::vector<size_t> & lines );
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string_view>
+#include <cstddef>
+
+// The text of a buffer as it was at one moment, for reading on another thread while the editor carries on
+// Only views of the bytes, in order, plus whatever keeps those bytes alive -- Nothing in it changes once it's made,
+//   so any number of threads can read it without locking
+class Snapshot {
+public:
+
+	std::vector<std::string_view> chunks;
+	std::vector<std::shared_ptr<const void>> owners;
+	size_t length = 0;
+
+	void add( const char * data, size_t len ) {
+		if( len == 0 )
+			return;
+		this->chunks.emplace_back( data, len );
+		this->length += len;
+	};
+
+};
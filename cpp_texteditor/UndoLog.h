@@ -0,0 +1,417 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Undo history for any editor, independent of how the text is stored
+// Edits are recorded the Emacs way, as just enough to reverse them:
+//   An insert is an offset and a length -- The text is still in the buffer when it comes time to take it out
+//   An erase is an offset, a length, and where the erased text can be found again, as a run of Spans
+// A Span either points at bytes copied into the log's own append only store, or at a backend's own storage,
+//   which only works for backends that never overwrite text (PieceTree's original and add buffers),
+//   so for those a deletion of any size costs a handful of Span records and not a byte of copying
+//
+// Every command is a group, undone as a whole -- Runs of typing or deleting a character at a time are amalgamated
+//   into one group, up to typingRun characters like Emacs does, so undo takes back words rather than letters
+//   Typed characters that follow on from each other share a single record
+// Undoing is itself an edit and goes into the log, so undoing an undo is redo, and nothing is ever lost:
+//   Consecutive undos walk back through the log, any other command ends the chain, and undoing again from there
+//   starts by taking back the undos -- redo( ) is the shortcut for that while a chain is still going
+//
+// The log has a byte budget, covering records and copied text alike, and forgets its oldest groups to stay in it
+// A single erase too big to copy into the budget isn't copied at all, the history before it is forgotten instead
+class UndoLog {
+public:
+
+	// Where a piece of erased text lives -- Sources other than ownText are up to the backend
+	struct Span {
+		size_t start;
+		size_t len;
+		uint32_t source;
+	};
+
+	static constexpr uint32_t ownText = 0;
+
+	struct Op {
+		size_t off;
+		size_t len;
+		// Spans holding an erase's text, starting here and running up to the next op's
+		size_t span;
+		bool erase;
+	};
+
+	// What undoing a group has to reverse -- ops[ first, last ), in reverse order
+	struct Step {
+		size_t first;
+		size_t last;
+		size_t cursor;
+	};
+
+protected:
+
+	// Copied text -- Fixed blocks, addressed by one running offset, so the oldest can be dropped off the front
+	struct Block {
+		size_t base;
+		size_t used;
+		size_t size;
+		std::unique_ptr<char[ ]> data;
+	};
+
+	struct Group {
+		size_t op;
+		// Cursor before the group, which is where undoing it puts the cursor back
+		size_t cursor;
+	};
+
+	// Records, oldest dropped off the front -- A ring that doubles when it's full, so once the history is at its
+	//   budget, adding records and dropping old ones never allocates
+	template<typename T>
+	class Ring {
+
+		std::vector<T> slots;
+		size_t head = 0;
+		size_t count = 0;
+
+	public:
+
+		size_t size( ) const { return this->count; };
+		bool empty( ) const { return this->count == 0; };
+
+		T & operator[ ]( size_t idx ) { return this->slots[ ( this->head + idx ) & ( this->slots.size( ) - 1 ) ]; };
+		const T & operator[ ]( size_t idx ) const { return this->slots[ ( this->head + idx ) & ( this->slots.size( ) - 1 ) ]; };
+
+		void push_back( const T & item ) {
+			if( this->count == this->slots.size( ) ) {
+				std::vector<T> grown( std::max<size_t>( this->slots.size( ) * 2, 64 ) );
+				for( size_t idx = 0; idx < this->count; ++idx )
+					grown[ idx ] = ( *this )[ idx ];
+				this->slots.swap( grown );
+				this->head = 0;
+			}
+			( *this )[ this->count++ ] = item;
+		};
+
+		void pop_front( ) {
+			this->head = ( this->head + 1 ) & ( this->slots.size( ) - 1 );
+			--this->count;
+		};
+
+		void clear( ) { this->head = this->count = 0; };
+
+	};
+
+	static constexpr size_t blockSize = 65536;
+	static constexpr size_t typingRun = 20;
+
+	// Everything is indexed by a running count, with the front of each ring sitting at its base
+	Ring<Op> ops;
+	Ring<Span> spans;
+	Ring<Group> groups;
+	std::deque<Block> blocks;
+	size_t opBase = 0;
+	size_t spanBase = 0;
+	size_t groupBase = 0;
+	size_t textEnd = 0;
+
+	// Bytes in use, against the budget
+	size_t budget = 64 << 20;
+	size_t bytes = 0;
+
+	// Spans added since the last erase, waiting to be claimed by it
+	size_t spanMark = 0;
+
+	// Set until the next edit starts a new group
+	bool boundary = true;
+
+	// Amalgamation -- What kind of run this command / the one before was part of, and how long the current run is
+	enum class Run { none, inserting, erasing };
+	Run runNow = Run::none;
+	Run runLast = Run::none;
+	size_t typed = 0;
+
+	// Undo chain -- Next group to undo, and the groups the chain added for redo( ) to take back
+	bool undoingNow = false;
+	bool chaining = false;
+	size_t pending = 0;
+	std::vector<size_t> undone;
+
+	bool recording = true;
+
+	// A step is being played back, reading ops and text that have to stay put until it's done -- An erase too big
+	//   for the budget then stops recording for the rest of the step, and the history is forgotten once it's over
+	bool playing = false;
+	bool forget = false;
+
+	size_t opEnd( ) const { return this->opBase + this->ops.size( ); };
+	size_t spanEnd( ) const { return this->spanBase + this->spans.size( ); };
+	size_t groupEnd( ) const { return this->groupBase + this->groups.size( ); };
+
+	Op & op( size_t idx ) { return this->ops[ idx - this->opBase ]; };
+	const Group & group( size_t idx ) const { return this->groups[ idx - this->groupBase ]; };
+
+	// First op past group idx
+	size_t groupLast( size_t idx ) const { return idx + 1 < this->groupEnd( ) ? this->group( idx + 1 ).op : this->opEnd( ); };
+
+	void openGroup( size_t cursor ) {
+
+		if( !this->boundary )
+			return;
+
+		this->groups.push_back( { this->opEnd( ), cursor } );
+		this->bytes += sizeof( Group );
+		this->boundary = false;
+		this->typed = 1;
+
+	};
+
+	void addOp( size_t off, size_t len, bool erase ) {
+		this->ops.push_back( { off, len, this->spanMark, erase } );
+		this->bytes += sizeof( Op );
+		this->spanMark = this->spanEnd( );
+	};
+
+	// Whether a run edit can go into the group the last command's edit made, as in Emacs typing or deleting a character at a time
+	bool amalgamates( Run run ) {
+
+		if( run == Run::none )
+			return false;
+
+		this->runNow = run;
+		if( this->runLast != run || this->typed >= typingRun || this->groups.empty( ) || this->opEnd( ) == this->group( this->groupEnd( ) - 1 ).op )
+			return false;
+
+		this->boundary = false;
+		return true;
+
+	};
+
+	// Drop the oldest group, and whatever text only it needed
+	void dropOldest( ) {
+
+		size_t last = this->groupLast( this->groupBase );
+
+		size_t spanLast = last < this->opEnd( ) ? this->op( last ).span : this->spanMark;
+		for( ; this->spanBase < spanLast; ++this->spanBase ) {
+			this->spans.pop_front( );
+			this->bytes -= sizeof( Span );
+		}
+		for( ; this->opBase < last; ++this->opBase ) {
+			this->ops.pop_front( );
+			this->bytes -= sizeof( Op );
+		}
+		this->groups.pop_front( );
+		this->bytes -= sizeof( Group );
+		++this->groupBase;
+
+		// Text blocks wholly before the oldest copied text still referenced can go
+		if( this->blocks.size( ) < 2 )
+			return;
+
+		size_t keep = this->textEnd;
+		for( size_t idx = 0; idx < this->spans.size( ); ++idx )
+			if( this->spans[ idx ].source == ownText ) {
+				keep = this->spans[ idx ].start;
+				break;
+			}
+		while( this->blocks.size( ) > 1 && this->blocks.front( ).base + this->blocks.front( ).size <= keep ) {
+			this->bytes -= this->blocks.front( ).size;
+			this->blocks.pop_front( );
+		}
+
+	};
+
+	Block * blockOf( size_t start ) {
+		auto found = std::upper_bound( this->blocks.begin( ), this->blocks.end( ), start,
+			[ ]( size_t at, const Block & block ) { return at < block.base; } );
+		return &*--found;
+	};
+
+public:
+
+	// Cap on the memory the history can hold -- Trimmed to it at the next command
+	void setBudget( size_t limit ) { this->budget = limit; };
+	size_t used( ) const { return this->bytes; };
+
+	// Forget everything, e.g. when the text the history refers to is replaced
+	void clear( ) {
+		this->ops.clear( );
+		this->spans.clear( );
+		this->groups.clear( );
+		this->blocks.clear( );
+		this->opBase = this->spanBase = this->groupBase = this->textEnd = 0;
+		this->bytes = 0;
+		this->spanMark = 0;
+		this->boundary = true;
+		this->runNow = this->runLast = Run::none;
+		this->undoingNow = this->chaining = false;
+		this->undone.clear( );
+		this->recording = true;
+		this->playing = this->forget = false;
+	};
+
+	// A command is starting -- Closes the previous group, ends the runs and undo chains it didn't continue,
+	//   and brings the history back under budget
+	void command( ) {
+
+		this->boundary = true;
+		this->runLast = this->runNow;
+		this->runNow = Run::none;
+
+		if( !this->undoingNow ) {
+			this->chaining = false;
+			this->undone.clear( );
+		}
+		this->undoingNow = false;
+
+		// Never the newest group, that would leave nothing to undo
+		while( this->bytes > this->budget && this->groups.size( ) > 1 )
+			this->dropOldest( );
+
+	};
+
+	// Recording -- The editor calls these just before making the change, typing for single characters typed or deleted
+
+	void inserted( size_t off, size_t len, size_t cursor, bool typing = false ) {
+
+		if( !this->recording || len == 0 )
+			return;
+
+		if( this->amalgamates( typing ? Run::inserting : Run::none ) ) {
+			++this->typed;
+
+			// Typing straight on from the last key extends the record it made
+			Op & last = this->op( this->opEnd( ) - 1 );
+			if( !last.erase && last.off + last.len == off ) {
+				last.len += len;
+				return;
+			}
+		}
+
+		this->openGroup( cursor );
+		this->addOp( off, len, false );
+
+	};
+
+	// Before an erase, the backend describes the text going away with copy( ) and reference( ) -- Then call erased( )
+	// Returns nullptr, and forgets the history, rather than copy more than the whole budget
+	char * copy( size_t len ) {
+
+		if( !this->recording )
+			return nullptr;
+		if( len > this->budget ) {
+			if( this->playing )
+				this->forget = true;
+			else
+				this->clear( );
+			this->recording = false;
+			return nullptr;
+		}
+
+		if( this->blocks.empty( ) || this->blocks.back( ).used + len > this->blocks.back( ).size ) {
+			size_t size = std::max( blockSize, len );
+			this->blocks.push_back( { this->textEnd, 0, size, std::make_unique<char[ ]>( size ) } );
+			this->bytes += size;
+		}
+
+		Block & block = this->blocks.back( );
+		char * at = block.data.get( ) + block.used;
+		this->spans.push_back( { block.base + block.used, len, ownText } );
+		this->bytes += sizeof( Span );
+		block.used += len;
+		this->textEnd = block.base + block.used;
+		return at;
+
+	};
+
+	void reference( uint32_t source, size_t start, size_t len ) {
+		if( !this->recording || len == 0 )
+			return;
+		this->spans.push_back( { start, len, source } );
+		this->bytes += sizeof( Span );
+	};
+
+	void erased( size_t off, size_t len, size_t cursor, bool typing = false ) {
+
+		// A copy that didn't fit threw the history away, this erase can't be undone but everything after it can
+		if( !this->recording ) {
+			this->recording = !this->forget;
+			return;
+		}
+		if( len == 0 )
+			return;
+
+		if( this->amalgamates( typing ? Run::erasing : Run::none ) )
+			++this->typed;
+
+		this->openGroup( cursor );
+		this->addOp( off, len, true );
+
+	};
+
+	// Playing back -- Edits made while undoing are recorded as usual, into a group of their own
+
+	// Start undoing the next group back -- False if there is nothing left to undo
+	bool undo( Step & step ) {
+
+		if( !this->chaining ) {
+			this->chaining = true;
+			this->pending = this->groupEnd( );
+		}
+		this->undoingNow = true;
+
+		if( this->pending <= this->groupBase )
+			return false;
+
+		--this->pending;
+		step = { this->group( this->pending ).op, this->groupLast( this->pending ), this->group( this->pending ).cursor };
+		this->undone.push_back( this->groupEnd( ) );
+		this->playing = true;
+		return true;
+
+	};
+
+	// Take back the last undo of the current chain -- False if the chain hasn't undone anything
+	bool redo( Step & step ) {
+
+		if( !this->chaining || this->undone.empty( ) )
+			return false;
+		this->undoingNow = true;
+
+		size_t idx = this->undone.back( );
+		this->undone.pop_back( );
+		++this->pending;
+
+		if( idx < this->groupBase || idx >= this->groupEnd( ) )
+			return false;
+
+		step = { this->group( idx ).op, this->groupLast( idx ), this->group( idx ).cursor };
+		this->playing = true;
+		return true;
+
+	};
+
+	// The step from undo( ) or redo( ) has been played back -- If it had to stop recording, the history goes now
+	void played( ) {
+		this->playing = false;
+		if( this->forget )
+			this->clear( );
+	};
+
+	const Op & at( size_t idx ) { return this->op( idx ); };
+
+	// Spans holding an erase op's text
+	size_t spanFirst( size_t idx ) { return this->op( idx ).span; };
+	size_t spanLast( size_t idx ) { return idx + 1 < this->opEnd( ) ? this->op( idx + 1 ).span : this->spanMark; };
+	const Span & spanAt( size_t idx ) const { return this->spans[ idx - this->spanBase ]; };
+
+	// Bytes behind an ownText span
+	const char * text( const Span & span ) {
+		Block * block = this->blockOf( span.start );
+		return block->data.get( ) + ( span.start - block->base );
+	};
+
+};
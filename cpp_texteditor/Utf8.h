@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// UTF-8 in and out, and how much room text takes on a terminal
+// Everything the editor stores is UTF-8, and everything the screen is handed is too -- These are the only places
+//   that look inside a character, the rest of the program moves bytes around and asks here where the boundaries are
+//
+// Malformed input never stops anything: a byte that doesn't start a valid sequence decodes on its own as U+FFFD,
+//   so every offset is still reachable and the bytes go back out unchanged
+
+constexpr char32_t replacementChar = 0xFFFD;
+
+// Bytes in the sequence a lead byte starts -- 0 for a continuation byte or one that can't start anything
+inline size_t utf8Length( unsigned char lead ) {
+	if( lead < 0x80 )
+		return 1;
+	if( lead < 0xC2 )
+		return 0;
+	if( lead < 0xE0 )
+		return 2;
+	if( lead < 0xF0 )
+		return 3;
+	if( lead < 0xF5 )
+		return 4;
+	return 0;
+};
+
+// Decode the character at s, len > 0 -- Returns the bytes used, always at least 1
+inline size_t utf8Decode( const char * s, size_t len, char32_t & cp ) {
+
+	const unsigned char * b = (const unsigned char *)s;
+	size_t need = utf8Length( b[ 0 ] );
+
+	if( need == 1 ) {
+		cp = b[ 0 ];
+		return 1;
+	}
+
+	cp = replacementChar;
+	if( need == 0 || need > len )
+		return 1;
+
+	char32_t value = b[ 0 ] & ( 0x7F >> need );
+	for( size_t idx = 1; idx < need; ++idx ) {
+		if( ( b[ idx ] & 0xC0 ) != 0x80 )
+			return 1;
+		value = ( value << 6 ) | ( b[ idx ] & 0x3F );
+	}
+
+	// Overlong forms, surrogates and anything past the last plane are as bad as a broken sequence
+	static constexpr char32_t least[ 5 ] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if( value < least[ need ] || value > 0x10FFFF || ( value >= 0xD800 && value <= 0xDFFF ) )
+		return 1;
+
+	cp = value;
+	return need;
+
+};
+
+// Whether [ s, s + len ) is the front of a valid sequence that needs more bytes than are there
+inline bool utf8Incomplete( const char * s, size_t len ) {
+
+	const unsigned char * b = (const unsigned char *)s;
+	size_t need = utf8Length( b[ 0 ] );
+	if( need <= len )
+		return false;
+
+	for( size_t idx = 1; idx < len; ++idx )
+		if( ( b[ idx ] & 0xC0 ) != 0x80 )
+			return false;
+	return true;
+
+};
+
+// Encode cp into out, which needs room for 4 -- Returns the bytes written
+inline size_t utf8Encode( char32_t cp, char * out ) {
+
+	if( cp < 0x80 ) {
+		out[ 0 ] = (char)cp;
+		return 1;
+	}
+	if( cp < 0x800 ) {
+		out[ 0 ] = (char)( 0xC0 | ( cp >> 6 ) );
+		out[ 1 ] = (char)( 0x80 | ( cp & 0x3F ) );
+		return 2;
+	}
+	if( cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) )
+		cp = replacementChar;
+	if( cp < 0x10000 ) {
+		out[ 0 ] = (char)( 0xE0 | ( cp >> 12 ) );
+		out[ 1 ] = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+		out[ 2 ] = (char)( 0x80 | ( cp & 0x3F ) );
+		return 3;
+	}
+	out[ 0 ] = (char)( 0xF0 | ( cp >> 18 ) );
+	out[ 1 ] = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+	out[ 2 ] = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+	out[ 3 ] = (char)( 0x80 | ( cp & 0x3F ) );
+	return 4;
+
+};
+
+// Columns a character takes on its own -- 0 for combining marks and other zero width characters,
+//   2 for East Asian wide and fullwidth characters and emoji, 1 for everything else
+// Control characters count as 1, the editor shows them as a blank
+size_t charWidth( char32_t cp );
+
+// Whether cp attaches to the character before it rather than starting a cluster of its own -- Combining marks,
+//   zero width joiners, variation selectors and emoji skin tones
+bool charExtends( char32_t cp );
+
+// The grapheme cluster starting at s, len > 0 -- What the cursor steps over and what takes up one place on screen
+// Returns its length in bytes, and sets columns to how wide it is, never less than 1
+// This follows the common cases of UAX #29 ( a base and its marks, ZWJ emoji sequences, flag pairs ), not all of it
+size_t clusterAt( const char * s, size_t len, size_t & columns );
+
+// Bytes of the whole clusters at the front of [ s, s + len ) that fit in width columns -- Sets columns to how many they take
+size_t clustersFitting( const char * s, size_t len, size_t width, size_t & columns );
+
+// Bytes in [ s, s + len ) that aren't part of a valid sequence -- Each is one U+FFFD on screen
+size_t utf8Invalid( const char * s, size_t len );
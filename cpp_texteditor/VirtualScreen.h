@@ -0,0 +1,75 @@
+#pragma once
+
+#include "GridScreen.h"
+
+#include <cstdint>
+#include <string>
+
+// Headless screen -- The cell grid lives in memory and never goes anywhere
+// Counts what it is asked to do so a replayed session can be measured, and checksums the final grid
+//   so two runs of the same trace can be compared for regressions
+class VirtualScreen : public GridScreen {
+protected:
+
+	size_t commands = 0;
+	size_t runs = 0;
+	size_t bytes = 0;
+	size_t frames = 0;
+	size_t scrolls = 0;
+
+	bool doInit( ) { return true; };
+
+	// Count commands on the way through to the grid
+	bool doClear( ) { ++this->commands; return GridScreen::doClear( ); };
+	bool doSetSize( size_t cols, size_t rows ) { ++this->commands; return GridScreen::doSetSize( cols, rows ); };
+	bool doScroll( size_t top, size_t bottom, ptrdiff_t lines ) { ++this->commands; return GridScreen::doScroll( top, bottom, lines ); };
+	size_t doPutString( std::string_view str, std::span<const ColourRun> runs, size_t x, size_t y, bool insert = true ) {
+		++this->commands;
+		return GridScreen::doPutString( str, runs, x, y, insert );
+	};
+
+	// The "device" -- Just count what would have been written
+	bool doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour ) { ++this->runs; this->bytes += len; return true; };
+	bool doMoveCursor( size_t x, size_t y ) { return true; };
+	bool doScrollRows( size_t top, size_t bottom, ptrdiff_t lines ) { ++this->scrolls; return true; };
+	bool doPresent( ) { ++this->frames; return true; };
+
+public:
+	VirtualScreen( size_t cols, size_t rows ) { this->cols = cols; this->rows = rows; };
+
+	size_t commandCount( ) const { return this->commands; };
+	size_t runCount( ) const { return this->runs; };
+	size_t byteCount( ) const { return this->bytes; };
+	size_t frameCount( ) const { return this->frames; };
+	size_t scrollCount( ) const { return this->scrolls; };
+
+	// One row of what the device would be showing, as UTF-8
+	std::string row( size_t y ) const {
+		std::string out;
+		for( size_t x = 0; x < this->cols; ++x )
+			this->appendCell( out, this->front[ y * this->cols + x ] );
+		return out;
+	};
+
+	// Colour of one cell of what the device would be showing
+	Colour colourAt( size_t x, size_t y ) const { return colourOf( this->front[ y * this->cols + x ] ); };
+
+	// FNV-1a over what the device would be showing, as the UTF-8 it was sent -- Cells not in the default colour
+	//   hash their colour after their text
+	uint64_t checksum( ) const {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		std::string text;
+		for( Cell cell : this->front ) {
+			text.clear( );
+			this->appendCell( text, cell );
+			if( colourOf( cell ) != Colour::CL_DEFAULT )
+				text += (char)colourOf( cell );
+			for( char c : text ) {
+				hash ^= (unsigned char)c;
+				hash *= 0x100000001b3ULL;
+			}
+		}
+		return hash;
+	};
+
+};
\ No newline at end of file
@@ -0,0 +1,292 @@
+#include "VtDecoder.h"
+#include <algorithm>
+#include <string_view>
+#include <cstring>
+
+namespace {
+
+	// Sequences longer than this are garbage, or something we'll never understand
+	constexpr size_t maxSequence = 32;
+
+	// Bracketed paste, ESC [ 200 ~ starts it and this ends it
+	constexpr size_t pasteStart = 200;
+	constexpr std::string_view pasteEnd = "\x1b[201~";
+
+	// Everything is looked up, nothing is decided by a switch at decode time
+	struct Tables {
+
+		// Single bytes, everything but ESC
+		KeyEvent bytes[ 256 ];
+
+		// ESC [ ... final and ESC O ... final, indexed by final - 0x40
+		KeyEvent csi[ 64 ];
+		KeyEvent ss3[ 64 ];
+
+		// ESC [ n ~, indexed by n
+		KeyEvent tilde[ 64 ];
+
+		Tables( ) {
+
+			for( size_t c = 0; c < 256; ++c ) {
+				if( c < 0x20 )
+					// Ctrl-letters come in as 1 through 26
+					this->bytes[ c ] = KeyEvent( (char)( 'a' + c - 1 ), false, true );
+				else
+					this->bytes[ c ] = KeyEvent( (char)c, c >= 'A' && c <= 'Z' );
+			}
+			// Past Ctrl-Z the control bytes are Ctrl with the punctuation after Z -- C-/ sends C-_ on most terminals
+			for( size_t c = 0x1c; c < 0x20; ++c )
+				this->bytes[ c ] = KeyEvent( (char)( c + 0x40 ), false, true );
+			this->bytes[ 0x0d ] = KeyEvent( '\n' );
+			this->bytes[ 0x09 ] = KeyEvent( '\t' );
+			this->bytes[ 0x08 ] = KeyEvent( KeyEventControl::CK_BKSPC );
+			this->bytes[ 0x7f ] = KeyEvent( KeyEventControl::CK_BKSPC );
+			this->bytes[ 0x00 ] = KeyEvent( ' ', false, true );
+			this->bytes[ 0x1b ] = KeyEvent( KeyEventControl::CK_ESC );
+
+			// Cursor keys come as either, depending on the keypad mode
+			for( KeyEvent * finals : { this->csi, this->ss3 } ) {
+				finals[ 'A' - 0x40 ] = KeyEvent( KeyEventControl::CK_UP );
+				finals[ 'B' - 0x40 ] = KeyEvent( KeyEventControl::CK_DOWN );
+				finals[ 'C' - 0x40 ] = KeyEvent( KeyEventControl::CK_RIGHT );
+				finals[ 'D' - 0x40 ] = KeyEvent( KeyEventControl::CK_LEFT );
+				finals[ 'H' - 0x40 ] = KeyEvent( KeyEventControl::CK_HOME );
+				finals[ 'F' - 0x40 ] = KeyEvent( KeyEventControl::CK_END );
+				finals[ 'P' - 0x40 ] = KeyEvent( KeyEventControl::CK_F_1 );
+				finals[ 'Q' - 0x40 ] = KeyEvent( KeyEventControl::CK_F_2 );
+				finals[ 'R' - 0x40 ] = KeyEvent( KeyEventControl::CK_F_3 );
+				finals[ 'S' - 0x40 ] = KeyEvent( KeyEventControl::CK_F_4 );
+			}
+			this->csi[ 'Z' - 0x40 ] = KeyEvent( '\t', true );
+			this->ss3[ 'M' - 0x40 ] = KeyEvent( '\n' );
+
+			this->tilde[ 1 ] = KeyEvent( KeyEventControl::CK_HOME );
+			this->tilde[ 7 ] = KeyEvent( KeyEventControl::CK_HOME );
+			this->tilde[ 4 ] = KeyEvent( KeyEventControl::CK_END );
+			this->tilde[ 8 ] = KeyEvent( KeyEventControl::CK_END );
+			this->tilde[ 2 ] = KeyEvent( KeyEventControl::CK_INSERT );
+			this->tilde[ 3 ] = KeyEvent( KeyEventControl::CK_DEL );
+			this->tilde[ 5 ] = KeyEvent( KeyEventControl::CK_PGUP );
+			this->tilde[ 6 ] = KeyEvent( KeyEventControl::CK_PGDN );
+
+			// rxvt sends F1 - F4 this way, everybody sends F5 - F12 this way, with gaps where the VT220 had them
+			const size_t fkeys[ ] = { 11, 12, 13, 14, 15, 17, 18, 19, 20, 21, 23, 24 };
+			for( size_t fkey = 0; fkey < 12; ++fkey )
+				this->tilde[ fkeys[ fkey ] ] = KeyEvent( (KeyEventControl)( (int)KeyEventControl::CK_F_1 + fkey ) );
+
+		};
+
+	};
+
+	const Tables & tables( ) {
+		static const Tables t;
+		return t;
+	};
+
+	bool known( const KeyEvent & key ) {
+		return key.type != KeyEventType::KET_CONTROL || std::get<KeyEventControl>( key.event ) != KeyEventControl::CK_ERROR;
+	};
+
+	// Add xterm's modifier parameter ( 1 + shift 1, alt 2, ctrl 4, meta 8 ) to a printable result
+	KeyEvent withModifiers( KeyEvent key, size_t mods ) {
+		if( mods > 1 && key.type == KeyEventType::KET_PRINT ) {
+			KeyEventPrintable & prnt = std::get<KeyEventPrintable>( key.event );
+			prnt.shft |= ( ( mods - 1 ) & 1 ) != 0;
+			prnt.alt |= ( ( mods - 1 ) & 2 ) != 0;
+			prnt.ctrl |= ( ( mods - 1 ) & 4 ) != 0;
+			prnt.os |= ( ( mods - 1 ) & 8 ) != 0;
+		}
+		return key;
+	};
+
+}
+
+void VtDecoder::pasteText( const char * data, size_t len ) {
+
+	if( len > 0 && this->pasteCR && data[ 0 ] == '\n' ) {
+		++data;
+		--len;
+	}
+	this->pasteCR = false;
+
+	// Terminals send line breaks as CR, so this is every line of a multi line paste
+	while( const char * cr = (const char *)memchr( data, '\r', len ) ) {
+		this->paste.append( data, cr - data );
+		this->paste.push_back( '\n' );
+		len -= cr + 1 - data;
+		data = cr + 1;
+		if( len == 0 ) {
+			this->pasteCR = true;
+			return;
+		}
+		if( data[ 0 ] == '\n' ) {
+			++data;
+			--len;
+		}
+	}
+	this->paste.append( data, len );
+
+};
+
+size_t VtDecoder::pasteMore( const char * data, size_t len, std::vector<KeyEvent> & out ) {
+
+	std::string_view text( data, len );
+	size_t end = text.find( pasteEnd );
+
+	if( end != std::string_view::npos ) {
+		this->pasteText( data, end );
+		out.push_back( KeyEvent::paste( std::move( this->paste ) ) );
+		this->paste = std::string( );
+		this->pasting = false;
+		this->pasteCR = false;
+		return end + pasteEnd.length( );
+	}
+
+	size_t keep = 0;
+	for( size_t tail = std::min( len, pasteEnd.length( ) - 1 ); tail > 0 && keep == 0; --tail )
+		if( text.substr( len - tail ) == pasteEnd.substr( 0, tail ) )
+			keep = tail;
+
+	this->pasteText( data, len - keep );
+	return len - keep;
+
+};
+
+size_t VtDecoder::decode( const char * data, size_t len, std::vector<KeyEvent> & out, bool final ) {
+
+	const Tables & t = tables( );
+	const unsigned char * bytes = (const unsigned char *)data;
+	size_t pos = 0;
+
+	while( pos < len ) {
+
+		if( this->pasting ) {
+			pos += this->pasteMore( data + pos, len - pos, out );
+			if( this->pasting )
+				return pos;
+			continue;
+		}
+
+		// Everything up to the next ESC is a table lookup per byte, bar multibyte characters
+		while( pos < len && bytes[ pos ] != 0x1b ) {
+			if( bytes[ pos ] < 0x80 ) {
+				out.push_back( t.bytes[ bytes[ pos++ ] ] );
+				continue;
+			}
+
+			// A character cut off at the end waits for the rest of it, same as a sequence
+			if( !final && utf8Incomplete( data + pos, len - pos ) )
+				return pos;
+
+			char32_t code;
+			pos += utf8Decode( data + pos, len - pos, code );
+			out.push_back( KeyEvent::character( code ) );
+		}
+		if( pos == len )
+			break;
+
+		// ESC -- Nothing after it yet means wait for more, unless nothing more is coming
+		if( pos + 1 == len ) {
+			if( !final )
+				return pos;
+			out.push_back( t.bytes[ 0x1b ] );
+			return len;
+		}
+
+		unsigned char intro = bytes[ pos + 1 ];
+
+		if( intro != '[' && intro != 'O' ) {
+			// Esc then a key is how terminals send Alt, Ctrl chords included -- Anything else was a lone Esc, leave the next byte be
+			if( intro < 0x20 || intro == 0x7f ) {
+				if( t.bytes[ intro ].type == KeyEventType::KET_PRINT ) {
+					out.push_back( withModifiers( t.bytes[ intro ], 3 ) );
+					pos += 2;
+				} else {
+					out.push_back( t.bytes[ 0x1b ] );
+					pos += 1;
+				}
+			} else if( intro < 0x80 ) {
+				out.push_back( KeyEvent( (char)intro, intro >= 'A' && intro <= 'Z', false, true ) );
+				pos += 2;
+			} else {
+				if( !final && utf8Incomplete( data + pos + 1, len - pos - 1 ) )
+					return pos;
+
+				char32_t code;
+				pos += 1 + utf8Decode( data + pos + 1, len - pos - 1, code );
+				out.push_back( KeyEvent::character( code, false, false, true ) );
+			}
+			continue;
+		}
+
+		// CSI or SS3 -- Parameters 0x30 - 0x3f, intermediates 0x20 - 0x2f, then a final 0x40 - 0x7e
+		size_t at = pos + 2;
+		size_t params[ 2 ] = { 0, 0 };
+		size_t param = 0;
+		bool priv = false;
+		bool bad = false;
+		unsigned char fin = 0;
+
+		while( at < len && at - pos < maxSequence ) {
+			unsigned char b = bytes[ at ];
+			if( b >= '0' && b <= '9' ) {
+				if( param < 2 )
+					params[ param ] = std::min<size_t>( params[ param ] * 10 + ( b - '0' ), 1000 );
+			} else if( b == ';' ) {
+				++param;
+			} else if( b >= 0x3a && b <= 0x3f ) {
+				// < = > ? are private markers, mouse reports and the like
+				priv = true;
+			} else if( b >= 0x20 && b <= 0x2f ) {
+				priv = true;
+			} else if( b >= 0x40 && b <= 0x7e ) {
+				fin = b;
+				break;
+			} else {
+				// A control byte in the middle, the sequence was broken off -- Drop what we have, decode the byte
+				bad = true;
+				break;
+			}
+			++at;
+		}
+
+		if( !fin && !bad && at - pos < maxSequence ) {
+			// Ran out of bytes mid sequence
+			if( !final )
+				return pos;
+			// ESC [ or ESC O on their own were really Alt-[ and Alt-O
+			if( at == pos + 2 )
+				out.push_back( KeyEvent( (char)intro, intro == 'O', false, true ) );
+			return len;
+		}
+
+		if( !fin ) {
+			pos = at;
+			continue;
+		}
+
+		pos = at + 1;
+
+		if( priv )
+			continue;
+
+		if( fin == '~' && params[ 0 ] == pasteStart ) {
+			this->pasting = true;
+			this->paste.clear( );
+			continue;
+		}
+
+		KeyEvent key;
+		if( fin == '~' )
+			key = params[ 0 ] < 64 ? t.tilde[ params[ 0 ] ] : KeyEvent( );
+		else
+			key = ( intro == '[' ? t.csi : t.ss3 )[ fin - 0x40 ];
+
+		if( known( key ) )
+			out.push_back( withModifiers( key, params[ 1 ] ) );
+
+	}
+
+	return pos;
+
+};
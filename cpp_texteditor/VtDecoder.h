@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Keyboard.h"
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Turns raw bytes from a VT compatible terminal into KeyEvents, independent of where the bytes came from
+// Plain bytes go through a 256 entry table, the common case being a run of printables
+// Bytes from 0x80 up are UTF-8, and decode to one KeyEvent per character -- Malformed ones come out as U+FFFD
+// ESC starts a small state machine: ESC x is Alt-x, ESC [ and ESC O start CSI / SS3 sequences, which are parsed
+//   by the ECMA-48 grammar ( parameters, intermediates, final byte ) and then looked up by final byte,
+//   or by first parameter for the ESC [ n ~ family
+// Modifier parameters ( ESC [ 1 ; 5 A ) are understood, but only printable results can carry them,
+//   KeyEventControl has nowhere to put them so Ctrl-Up is just Up
+// Sequences we don't know are swallowed whole rather than leaking their bytes in as typing
+// Bracketed paste ( ESC [ 200 ~ text ESC [ 201 ~ ) comes out as one KET_PASTE -- The text can take any number of
+//   reads to arrive, so it's gathered here rather than left unconsumed, and only the end marker ends it
+class VtDecoder {
+
+	bool pasting = false;
+	std::string paste;
+
+	// The last byte pasted was a CR, so an LF straight after it is the same line break
+	bool pasteCR = false;
+
+	// Append pasted bytes, with CR LF and lone CRs as LF
+	void pasteText( const char * data, size_t len );
+
+	// Paste in [ data, data + len ), up to the end marker if it's there -- Returns bytes consumed, all but
+	//   whatever might be the start of a marker cut off at the end
+	size_t pasteMore( const char * data, size_t len, std::vector<KeyEvent> & out );
+
+public:
+
+	// Decode every complete key in [ data, data + len ), appending them to out -- Returns bytes consumed
+	// A sequence cut off at the end is left unconsumed, to be retried once more bytes arrive
+	//   With final set nothing more is coming, so it is decoded as whatever it looks like so far -- Bar a paste,
+	//   which a pause in the middle of doesn't end
+	size_t decode( const char * data, size_t len, std::vector<KeyEvent> & out, bool final = false );
+
+};
@@ -42,6 +42,16 @@ WinConsole::WinConsole( ) {
 			), "GetConsoleMode on output failed!" );
 
 
+	// Manual reset, once we're interrupted we stay that way
+	this->hInterrupt = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if( this->hInterrupt == NULL )
+		throw std::system_error(
+			std::error_code(
+				GetLastError( ),
+				std::system_category( )
+			), "CreateEvent for interrupt failed!" );
+
+
 	// Enable window inputs
 	DWORD reqInMode = ENABLE_WINDOW_INPUT;
 	if( !SetConsoleMode( this->hStdin, reqInMode ) )
@@ -62,6 +72,15 @@ WinConsole::WinConsole( ) {
 			), "SetConsoleMode on output failed!" );
 
 
+	// Everything we write is UTF-8
+	this->savedOutCP = GetConsoleOutputCP( );
+	if( !SetConsoleOutputCP( CP_UTF8 ) )
+		throw std::system_error(
+			std::error_code(
+				GetLastError( ),
+				std::system_category( )
+			), "SetConsoleOutputCP failed!" );
+
 	// Switch to alternate screen buffer
 	// VTESC [ ? 1 0 4 9 h
 	DWORD written;
@@ -94,10 +113,16 @@ WinConsole::WinConsole( ) {
 
 WinConsole::~WinConsole( ) {
 
-	// Write out the switch back to the standard screenbuffer
+	// Write out the switch back to the standard screenbuffer, drawing in the default colour
 	// If this fails, the console is in an undefined state, but nothing we can do :shrug:
-	// VTESC [ ? 1 0 4 9 l
+	// VTESC [ 0 m VTESC [ ? 1 0 4 9 l
 	DWORD written;
+	WriteConsoleA(
+		this->hStdout,
+		"\x1B[0m",
+		4,
+		&written,
+		NULL );
 	WriteConsole(
 		this->hStdout,
 		L"\x1B[?1049l",
@@ -109,6 +134,9 @@ WinConsole::~WinConsole( ) {
 	// If these fail, we don't really care since there's not much we can do
 	SetConsoleMode( this->hStdin, this->savedInMode );
 	SetConsoleMode( this->hStdout, this->savedOutMode );
+	SetConsoleOutputCP( this->savedOutCP );
+
+	CloseHandle( this->hInterrupt );
 
 };
 
@@ -119,88 +147,109 @@ bool WinConsole::doInit( ) {
 
 };
 
-bool WinConsole::doClear( ) {
+bool WinConsole::doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour ) {
 
-	// Clear the screen, reset cursor to 0,0
-	DWORD written;
-	if( !WriteConsole(
+	// Build the cursor move and the text into one buffer, so it's one call to the console
+	std::string out;
+	out.reserve( len + 32 );
+
+	// VT positions are 1 based
+	if( x != this->curx || y != this->cury )
+		out += std::format( "\x1B[{};{}H", y + 1, x + 1 );
+	if( colour != this->colour )
+		out += sgrFor( colour );
+	out.append( str, len );
+
+	DWORD written = 0;
+	if( !WriteConsoleA(
 		this->hStdout,
-		L"\x1B[2J\x1B[0;0H",
-		10,
+		out.c_str( ),
+		(DWORD)out.length( ),
 		&written,
-		NULL ) )
+		NULL ) || written != out.length( ) )
 		return false;
 
-	this->curx = 0;
-	this->cury = 0;
-
-	return written == 10;
-
-}
+	this->curx = x + width;
+	this->cury = y;
+	this->colour = colour;
 
+	return true;
 
-bool WinConsole::doSetSize( size_t cols, size_t rows ) {
+};
 
-	// We cannot force a resize of the console buffer, fail
-	throw std::runtime_error( "Not implementable for this console interface!" );
+bool WinConsole::doMoveCursor( size_t x, size_t y ) {
 
-};
+	x = min( x, this->cols - 1 );
+	if( x == this->curx && y == this->cury )
+		return true;
 
-size_t WinConsole::doPutString( std::string & str, size_t x, size_t y, bool insert ) {
+	std::string movecmd = std::format( "\x1B[{};{}H", y + 1, x + 1 );
 
-	// Don't rely on wrapping behaviour
-	// Write to end of string or line
-	int lenToWrite = min( str.length( ), this->cols - x );
 	DWORD written = 0;
+	if( !WriteConsoleA(
+		this->hStdout,
+		movecmd.c_str( ),
+		(DWORD)movecmd.length( ),
+		&written,
+		NULL ) || written != movecmd.length( ) )
+		return false;
 
-	// Write cursor position
-	if( x != this->curx || y != this->cury ) {
+	this->curx = x;
+	this->cury = y;
 
-		std::string movecmd = std::format( "\x1B[{};{}H", y, x );
+	return true;
 
-		if( !WriteConsoleA(
-			this->hStdout,
-			movecmd.c_str( ),
-			movecmd.length( ),
-			&written,
-			NULL ) || written != movecmd.length( ) )
+};
 
-			return 0;
+bool WinConsole::doScrollRows( size_t top, size_t bottom, ptrdiff_t lines ) {
 
-	}
+	// Rows scroll in blank in whatever colour is set, so back to the default first
+	// VTESC [ top ; bottom r VTESC [ n S ( or T for down ) VTESC [ r
+	std::string out;
+	if( this->colour != Colour::CL_DEFAULT )
+		out += sgrFor( Colour::CL_DEFAULT );
+	out += std::format( "\x1B[{};{}r\x1B[{}{}\x1B[r", top + 1, bottom, lines < 0 ? -lines : lines, lines < 0 ? 'T' : 'S' );
 
-	// Now write chars back out
-	// If this fails here, should we care? Might cause caller to infinite loop returning 0...
-	WriteConsoleA(
+	DWORD written = 0;
+	if( !WriteConsoleA(
 		this->hStdout,
-		str.c_str( ),
-		lenToWrite,
+		out.c_str( ),
+		(DWORD)out.length( ),
 		&written,
-		NULL );
+		NULL ) || written != out.length( ) )
+		return false;
 
-	this->curx += written;
-	
-	return written;
+	// Setting the region sends the cursor home
+	this->curx = 0;
+	this->cury = 0;
+	this->colour = Colour::CL_DEFAULT;
+
+	return true;
 
 };
 
 KeyEvent WinConsole::doReadKey( ) {
 
-	// TODO: Profile, would batch reading be faster than one at a time?
+	// Take everything that's waiting in one call, then hand it out a record at a time
+	if( this->inPos == this->inCount ) {
+		this->inPos = 0;
+		this->inCount = 0;
+		if( !ReadConsoleInput(
+			this->hStdin,
+			this->inRecords,
+			inBatch,
+			&this->inCount
+		) )
+			throw std::system_error(
+				std::error_code(
+					GetLastError( ),
+					std::system_category( )
+				), "Failed to read from console" );
+		if( this->inCount == 0 )
+			return KeyEvent( );
+	}
 
-	DWORD read;
-	INPUT_RECORD input;
-	if( !ReadConsoleInput(
-		this->hStdin,
-		&input,
-		1,
-		&read
-	) )
-		throw std::system_error(
-			std::error_code(
-				GetLastError( ),
-				std::system_category( )
-			), "Failed to read from console" );
+	INPUT_RECORD & input = this->inRecords[ this->inPos++ ];
 
 
 	switch( input.EventType ) {
@@ -246,83 +295,23 @@ KeyEvent WinConsole::doReadKey( ) {
 				return KeyEvent( KeyEventControl::CK_DEL );
 
 			// Printables! Output correctly cased, with the appropriate control keys
+			// Digits, or the symbols above them with shift -- US layout
 			case 0x30:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '!',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x31:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '@',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x32:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '#',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x33:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '$',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x34:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '%',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x35:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '^',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x36:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '&',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x37:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '*',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x38:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( '(',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
 			case 0x39:
-				if( controlKeys & 0x0010 )
-					return KeyEvent( ')',
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
-				else
-					return KeyEvent(
-						'0' + ( vKeycode - 0x30 ),
-						false,
-						controlKeys & ( 0x0008 | 0x0004 ),
-						controlKeys & ( 0x0002 | 0x0001 ),
-						false );
+				return KeyEvent(
+					controlKeys & 0x0010 ? ")!@#$%^&*("[ vKeycode - 0x30 ] : (char)( '0' + ( vKeycode - 0x30 ) ),
+					false,
+					controlKeys & ( 0x0008 | 0x0004 ),
+					controlKeys & ( 0x0002 | 0x0001 ),
+					false );
 
 			case 0x41:
 			case 0x42:
@@ -357,6 +346,16 @@ KeyEvent WinConsole::doReadKey( ) {
 					controlKeys & ( 0x0002 | 0x0001 ),
 					false );
 
+			// The punctuation Emacs wants chorded -- US layout
+			case VK_OEM_2:
+			case VK_OEM_MINUS:
+				return KeyEvent(
+					vKeycode == VK_OEM_2 ? ( controlKeys & 0x0010 ? '?' : '/' ) : ( controlKeys & 0x0010 ? '_' : '-' ),
+					false,
+					controlKeys & ( 0x0008 | 0x0004 ),
+					controlKeys & ( 0x0002 | 0x0001 ),
+					false );
+
 			// I HATE everything about this arithmetic, but it works :D
 			case VK_F1:
 			case VK_F2:
@@ -375,8 +374,30 @@ KeyEvent WinConsole::doReadKey( ) {
 			case VK_NUMLOCK:
 				return KeyEvent( KeyEventControl::CK_NUMLK );
 
+			// Anything else that types something is taken as the layout typed it, IME and pasted input included
+			// Characters past the BMP arrive as two records, one per UTF-16 surrogate
 			default:
-				return KeyEvent( );
+			{
+				WCHAR unit = input.Event.KeyEvent.uChar.UnicodeChar;
+
+				if( unit >= 0xD800 && unit <= 0xDBFF ) {
+					this->highSurrogate = unit;
+					return KeyEvent( );
+				}
+
+				char32_t code = unit;
+				if( unit >= 0xDC00 && unit <= 0xDFFF ) {
+					if( !this->highSurrogate )
+						return KeyEvent( );
+					code = 0x10000 + ( ( this->highSurrogate - 0xD800 ) << 10 ) + ( unit - 0xDC00 );
+				}
+				this->highSurrogate = 0;
+
+				// Ctrl and Alt are already in the character, AltGr is how half of Europe types punctuation
+				if( code < 0x20 || code == 0x7f )
+					return KeyEvent( );
+				return KeyEvent::character( code );
+			}
 			};
 		}
 		break;
@@ -397,6 +418,9 @@ KeyEvent WinConsole::doReadKey( ) {
 
 bool WinConsole::doKeysReady( ) {
 
+	if( this->inPos < this->inCount )
+		return true;
+
 	DWORD num;
 	if( !GetNumberOfConsoleInputEvents( this->hStdin, &num ) )
 		throw std::system_error(
@@ -407,4 +431,31 @@ bool WinConsole::doKeysReady( ) {
 
 	return num > 0;
 
+};
+
+bool WinConsole::doWaitKeys( ) {
+
+	// Records already read don't signal the handle, only check we weren't interrupted
+	if( this->inPos < this->inCount )
+		return WaitForSingleObject( this->hInterrupt, 0 ) != WAIT_OBJECT_0;
+
+	// The console input handle is signalled whenever its buffer is not empty
+	HANDLE handles[ 2 ] = { this->hStdin, this->hInterrupt };
+	DWORD which = WaitForMultipleObjects( 2, handles, FALSE, INFINITE );
+
+	if( which == WAIT_FAILED )
+		throw std::system_error(
+			std::error_code(
+				GetLastError( ),
+				std::system_category( )
+			), "Failed to wait for input events!" );
+
+	return which == WAIT_OBJECT_0;
+
+};
+
+void WinConsole::doInterrupt( ) {
+
+	SetEvent( this->hInterrupt );
+
 };
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Screen.h"
+#include "GridScreen.h"
 #include "Keyboard.h"
 #include "Editor.h"
 
@@ -8,40 +8,63 @@
 
 // This is an RAII wrapper around the windows Console, that handles input and output
 // Since the console is both I and O, we inherit from Screen and Keyboard, and share access to the Console
+// Screen side goes through GridScreen, so we only ever get asked to write the runs that changed
 // We will have separate classes for Editors, do not combine it here
-class WinConsole : public Screen, public Keyboard {
+class WinConsole : public GridScreen, public Keyboard {
 protected:
 
 	// StdIn, StdOut streams
 	HANDLE hStdin;
 	HANDLE hStdout;
 
+	// Signalled to break the input thread out of its wait
+	HANDLE hInterrupt;
+
 	// Saved console modes, we reset on destruction
 	DWORD savedOutMode;
 	DWORD savedInMode;
+	UINT savedOutCP;
 
 	// Screen operations!
 
 	// WinConsole can track cursor for optimizations
 	// This duplicates effort in Editor however
-	size_t curx = 0, cury = 0;
+	// Unknown until the first move, so start somewhere we can never be
+	size_t curx = (size_t)-1, cury = (size_t)-1;
+
+	// What the console is drawing text in
+	Colour colour = Colour::CL_DEFAULT;
 
 	// All init done in the constructor
 	bool doInit( );
 
-	// Clear the screen, reset cursor
-	bool doClear( );
+	// Write a run of changed cells, with the cursor move in the same call
+	bool doWriteRun( const char * str, size_t len, size_t x, size_t y, size_t width, Colour colour );
 
-	bool doSetSize( size_t cols, size_t rows );
+	bool doMoveCursor( size_t x, size_t y );
 
-	size_t doPutString( std::string & str, size_t x, size_t y, bool insert = true );
+	// Region scrolls, same as a VT terminal
+	bool doScrollRows( size_t top, size_t bottom, ptrdiff_t lines );
 
 	// Keyboard operations!
-	
+
+	// Records read from the console but not handed out yet
+	static constexpr DWORD inBatch = 128;
+	INPUT_RECORD inRecords[ inBatch ];
+	DWORD inCount = 0;
+	DWORD inPos = 0;
+
+	// First half of a character that came in as a UTF-16 surrogate pair
+	WCHAR highSurrogate = 0;
+
 	// Read some keys, interpreting some platform specific ones to ControlKeyEvents
 	KeyEvent doReadKey( );
 	bool doKeysReady( );
 
+	// Sleep on the input handle and the interrupt event together
+	bool doWaitKeys( );
+	void doInterrupt( );
+
 public:
 	// Get the console handle, save the current settings
 	WinConsole( );
@@ -0,0 +1,126 @@
+#include "Workers.h"
+
+#include <iostream>
+
+void printError( std::system_error & e, const char * msg ) {
+	std::cerr << "Received a system error!" << std::endl;
+	std::cerr << msg << std::endl;
+	std::cerr << e.code( ) << " " << e.what( ) << std::endl;
+}
+
+
+void input_worker(
+	std::shared_ptr<Keyboard> kb,
+	std::shared_ptr<Channel<KeyEvent>> ch,
+	std::shared_ptr<State> state ) {
+
+	try {
+		while( state->shouldRun( ) && kb->waitKeys( ) ) {
+
+			while( kb->keysReady( ) ) {
+				
+				KeyEvent c = kb->readKey( );
+
+				// If KeyEvent is a Ctrl-Q, emit quit and tell global state to stop
+				if( isQuitKey( c ) ) {
+					// Quit!
+					state->stop( );
+					return;
+				}
+
+				if( !ch->push( std::move( c ) ) )
+					break;
+
+			}
+
+		}
+	} catch( std::system_error & e ) {
+		// Failed to read!
+		// Set state and return
+		state->stop( );
+		printError( e, "Input worker caught system error!" );
+	}
+
+	// No more keys are coming -- The editor finishes what's queued and then follows us out
+	ch->close( );
+
+}
+
+void screen_worker(
+	std::shared_ptr<Screen> screen,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free,
+	std::shared_ptr<State> state ) {
+
+	// Reused every pass so draining the channel doesn't allocate
+	std::vector<std::unique_ptr<ScreenBatch>> batches;
+
+	while( state->shouldRun( ) && ch->wait( ) ) {
+
+		batches.clear( );
+		ch->pop_n( batches );
+
+		for( std::unique_ptr<ScreenBatch> & batch : batches )
+			for( ScreenCommand & c : batch->commands( ) )
+				screen->consumeCommand( c );
+
+		// One frame per drain
+		screen->flush( );
+		state->painted( );
+
+		// There's room for the whole pool on the way back, so this never blocks
+		for( std::unique_ptr<ScreenBatch> & batch : batches ) {
+			batch->clear( );
+			ch_free->push( std::move( batch ) );
+		}
+
+	}
+
+}
+
+void editor_worker(
+	std::shared_ptr<Editor> editor,
+	std::shared_ptr<Channel<KeyEvent>> ch_in,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_out,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free,
+	std::shared_ptr<State> state ) {
+
+	std::vector<KeyEvent> keys;
+	std::unique_ptr<ScreenBatch> batch, next;
+	if( !ch_free->wait( ) || !ch_free->pop( batch ) )
+		return;
+
+	while( state->shouldRun( ) && ch_in->wait( ) ) {
+
+		keys.clear( );
+		ch_in->pop_n( keys );
+
+		for( KeyEvent & c : keys )
+			editor->consumeKey( c, *batch );
+
+		// We may have been woken by background work rather than keys
+		editor->poll( *batch );
+
+		if( batch->empty( ) )
+			continue;
+
+		// Only block on the screen once we've caught up with the keyboard
+		if( !ch_free->pop( next ) ) {
+			if( ch_in->size( ) > 0 )
+				continue;
+			if( !ch_free->wait( ) || !ch_free->pop( next ) )
+				return;
+		}
+
+		if( !ch_out->push( std::move( batch ) ) )
+			return;
+		batch = std::move( next );
+
+	}
+
+	// Let the screen drain what we sent, then stop
+	if( !batch->empty( ) )
+		ch_out->push( std::move( batch ) );
+	ch_out->close( );
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Keyboard.h"
+#include "Editor.h"
+#include "Screen.h"
+#include "Channel.h"
+#include "ScreenBatch.h"
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <system_error>
+
+// The threads the editor runs on -- Keyboard -> Editor -> Screen, joined by Channels
+// main sets them going on the console, and the tests run the same loops to measure them
+
+// Batches in the loop between the editor and the screen
+constexpr size_t batchPool = 4;
+
+void printError( std::system_error & e, const char * msg );
+
+// Global state
+class State {
+	std::atomic<bool> _shouldRun = true;
+	std::mutex state_mtx;
+
+	// Run on stop, to break every worker out of whatever it is waiting on
+	std::vector<std::function<void( )>> _onStop;
+
+	// Open to first paint timing
+	std::chrono::steady_clock::time_point _opened = std::chrono::steady_clock::now( );
+	std::chrono::steady_clock::duration _firstPaint = std::chrono::steady_clock::duration::zero( );
+
+public:
+
+	bool shouldRun( ) {
+		return _shouldRun.load( std::memory_order_acquire );
+	}
+
+	void stop( ) {
+		std::unique_lock<std::mutex> state_lock( state_mtx );
+		_shouldRun.store( false, std::memory_order_release );
+		for( std::function<void( )> & wake : _onStop )
+			wake( );
+	}
+
+	void start( ) {
+		_shouldRun.store( true, std::memory_order_release );
+	}
+
+	// Register something to interrupt when we stop -- Set these up before starting threads
+	void onStop( std::function<void( )> && wake ) {
+		std::unique_lock<std::mutex> state_lock( state_mtx );
+		_onStop.push_back( std::move( wake ) );
+	}
+
+	// Screen has finished drawing something -- Only the first time counts
+	void painted( ) {
+		std::unique_lock<std::mutex> state_lock( state_mtx );
+		if( _firstPaint == std::chrono::steady_clock::duration::zero( ) )
+			_firstPaint = std::chrono::steady_clock::now( ) - _opened;
+	}
+
+	std::chrono::steady_clock::duration firstPaint( ) {
+		std::unique_lock<std::mutex> state_lock( state_mtx );
+		return _firstPaint;
+	}
+
+};
+
+
+// Input worker thread
+// Takes:
+//   Message queue to output to
+//   Shared state
+// Does:
+//   Exit if no longer running
+//   If input, read and interpret, output messages to queue
+//   Else sleep until the keyboard has input, or we are interrupted by State stopping
+//
+void input_worker(
+	std::shared_ptr<Keyboard> kb,
+	std::shared_ptr<Channel<KeyEvent>> ch,
+	std::shared_ptr<State> state );
+
+// Screen worker thread
+// Takes:
+//   Message queue of full batches to read from
+//   Message queue to hand emptied batches back on
+//   Shared state
+// Does:
+//   Exit if no longer running
+//   If input, read and interpret, then send the batches back to be refilled
+//   Else sleep on the channel until the editor pushes more
+void screen_worker(
+	std::shared_ptr<Screen> screen,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free,
+	std::shared_ptr<State> state );
+
+// Editor thread
+// Takes:
+//   Message queue from Keyboard
+//   Message queue of full batches to Screen
+//   Message queue of empty batches back from Screen
+//   Shared state
+// Does:
+//   Exit if no longer running
+//   If input, read and interpret into the current batch
+//   Swap the batch for an empty one if the screen has one spare
+//   If it doesn't and more keys are waiting, keep adding to the same batch, where newer output collapses older
+//   Else sleep until the screen hands a batch back
+void editor_worker(
+	std::shared_ptr<Editor> editor,
+	std::shared_ptr<Channel<KeyEvent>> ch_in,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_out,
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free,
+	std::shared_ptr<State> state );
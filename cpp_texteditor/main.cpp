@@ -1,198 +1,313 @@
 #include "Screen.h"
 #include "Keyboard.h"
+#ifdef _WIN32
 #include "WinConsole.h"
+using Console = WinConsole;
+#else
+#include "PosixTerminal.h"
+using Console = PosixTerminal;
+#endif
 #include "Channel.h"
+#include "ScreenBatch.h"
 #include "Emacs.h"
-
+#include "GapBuffer.h"
+#include "PieceTree.h"
+#include "MappedFile.h"
+#include "VirtualScreen.h"
+#include "ScriptKeyboard.h"
+#include "Latency.h"
+#include "Pipeline.h"
+#include "Workers.h"
+
+#include <thread>
 #include <mutex>
+#include <atomic>
+#include <functional>
 #include <iostream>
-#include <format>
+#include <iomanip>
 #include <string>
+#include <stdexcept>
+#include <chrono>
+#ifndef _WIN32
+#include <csignal>
+#include <pthread.h>
+#endif
+
+// Zero padded hex, so runs can be compared by eye
+void printChecksum( uint64_t sum ) {
+	std::cout << "Final screen checksum: " << std::hex << std::setw( 16 ) << std::setfill( '0' ) << sum << std::dec << std::endl;
+}
 
-void printError( std::system_error & e, const char * msg ) {
-	std::cerr << "Received a system error!" << std::endl;
+// Bad arguments -- Say what was wrong and how it should look, then main exits with this
+int usageError( const std::string & msg ) {
 	std::cerr << msg << std::endl;
-	std::cerr << e.code( ) << " " << e.what( ) << std::endl;
+	std::cerr << "Usage: cpp_texteditor [file] [--replay <trace> [--realtime] [--size <cols> <rows>] [--pipeline threads | static | dynamic]]" << std::endl;
+	std::cerr << "                      [--record <trace>] [--stats <file>] [--durability none | file | dir]" << std::endl;
+	return 2;
 }
 
-// Global state
-class State {
-	bool _shouldRun = true;
-	std::mutex state_mtx;
-
-public:
-
-	bool shouldRun( ) {
-		std::unique_lock<std::mutex> state_lock( state_mtx );
-		return _shouldRun;
-	}
-
-	void stop( ) {
-		std::unique_lock<std::mutex> state_lock( state_mtx );
-		_shouldRun = false;
-	}
-
-	void start( ) {
-		std::unique_lock<std::mutex> state_lock( state_mtx );
-		_shouldRun = true;
-	}
-
-};
-
-
-// Input worker thread
-// Takes:
-//   Message queue to output to
-//   Shared state
-// Does:
-//   Exit if no longer running
-//   If input, read and interpret, output messages to queue
-//   Else wait on State change semaphore with timeout -- Or naively sleep
-//
-void input_worker(
-	std::shared_ptr<Keyboard> kb,
-	std::shared_ptr<Channel<KeyEvent>> ch,
-	std::shared_ptr<State> state ) {
-
-	while( state->shouldRun( ) ) {
-
-		while( kb->keysReady( ) ) {
-			
-			KeyEvent c;
-
-			try {
-				c = kb->readKey( );
-			} catch( std::system_error & e ) {
-				// Failed to read!
-				// Set state and return
-				state->stop( );
-				printError( e, "Input worker caught system error!" );
-			}
-
-			// If KeyEvent is a Ctrl-Q, emit quit and tell global state to stop
-			if( c.type == KeyEventType::KET_PRINT ) {
-				KeyEventPrintable & prnt = std::get<KeyEventPrintable>( c.event );
-				if( prnt.ascii == 'q' && prnt.shft == false && prnt.ctrl == true && prnt.alt == false ) {
-					// Quit!
-					state->stop( );
-					return;
-				}
-			}
-
-			ch->push( std::move( c ) );
-
-		}
-
-		// Sleep 5 ms
-		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
-
+// A whole, positive number with nothing after it -- std::stoul on its own would take "-1" or "80x"
+bool parseCount( const std::string & text, size_t & out ) {
+	if( text.empty( ) || text[ 0 ] < '0' || text[ 0 ] > '9' )
+		return false;
+	try {
+		size_t used;
+		out = std::stoul( text, &used );
+		return used == text.length( ) && out > 0;
+	} catch( std::logic_error & ) {
+		// invalid_argument or out_of_range
+		return false;
 	}
-
 }
 
-// Screen worker thread
+#ifndef _WIN32
+// Stats thread
 // Takes:
-//   Message queue to read from
-//   Shared state
+//   Signals to wait on, blocked in every thread
+//   File to write the latency report to
 // Does:
-//   Exit if no longer running
-//   If input, read and interpret
-//   Else wait 
-void screen_worker(
-	std::shared_ptr<Screen> screen,
-	std::shared_ptr<Channel<ScreenCommand>> ch,
-	std::shared_ptr<State> state ) {
+//   Write the report every SIGUSR1, so a live session can be inspected with `kill -USR1`
+//   Exit on SIGUSR2, which main sends once everything else has stopped
+void stats_worker(
+	sigset_t signals,
+	std::string path ) {
 
-	while( state->shouldRun( ) ) {
+	int sig;
+	while( sigwait( &signals, &sig ) == 0 && sig == SIGUSR1 )
+		latencyDump( path );
 
-		while( ch->size( ) > 0 ) {
+}
+#endif
 
-			std::unique_ptr<ScreenCommand> c = ch->pop( );
-			screen->consumeCommand( *c );
 
-		}
+int main( int argc, char ** argv ) {
 
-		// Sleep 5 ms
-		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+	// Make the state first, it starts the open to first paint clock
+	std::shared_ptr<State> state = std::make_shared<State>( );
 
+	// Arguments
+	//   [file]              Open file
+	//   --replay <trace>    Run headless, keys from a recorded trace instead of the console
+	//   --realtime          Replay with the original timing instead of flat out
+	//   --size <cols> <rows> Headless screen size
+	//   --record <trace>    Record the keys typed into the console
+	//   --stats <file>      Write keystroke latency percentiles here on exit, and on SIGUSR1
+	//   --pipeline <kind>   Headless only -- threads (default), or static / dynamic to replay on one thread
+	//                         through a compile-time or a virtual pipeline, for comparing per-key cost
+	//   --durability <mode> How far C-x C-s flushes before it's done -- none, file, or dir (default) for the
+	//                         directory as well
+	std::string path, replay, record, stats, pipeline = "threads";
+	Durability durability = Durability::DU_DIRECTORY;
+	bool realtime = false;
+	size_t headlessCols = 80, headlessRows = 24;
+	for( int arg = 1; arg < argc; ++arg ) {
+		std::string opt = argv[ arg ];
+		if( opt == "--replay" && arg + 1 < argc )
+			replay = argv[ ++arg ];
+		else if( opt == "--record" && arg + 1 < argc )
+			record = argv[ ++arg ];
+		else if( opt == "--stats" && arg + 1 < argc )
+			stats = argv[ ++arg ];
+		else if( opt == "--pipeline" && arg + 1 < argc ) {
+			pipeline = argv[ ++arg ];
+			if( pipeline != "threads" && pipeline != "static" && pipeline != "dynamic" )
+				return usageError( "Unknown pipeline: " + pipeline );
+		} else if( opt == "--durability" && arg + 1 < argc ) {
+			std::string mode = argv[ ++arg ];
+			if( mode == "none" )
+				durability = Durability::DU_NONE;
+			else if( mode == "file" )
+				durability = Durability::DU_FILE;
+			else if( mode == "dir" )
+				durability = Durability::DU_DIRECTORY;
+			else
+				return usageError( "Unknown durability: " + mode );
+		} else if( opt == "--realtime" )
+			realtime = true;
+		else if( opt == "--size" && arg + 2 < argc ) {
+			std::string cols = argv[ ++arg ], rows = argv[ ++arg ];
+			if( !parseCount( cols, headlessCols ) || !parseCount( rows, headlessRows ) )
+				return usageError( "Bad screen size: " + cols + " " + rows );
+		} else if( opt.starts_with( "--" ) )
+			return usageError( "Unknown option, or missing its value: " + opt );
+		else
+			path = opt;
 	}
 
-}
+	// Either a real console, or a virtual screen fed by a trace
+	std::shared_ptr<Console> console;
+	std::shared_ptr<Sealed<VirtualScreen>> virt;
+	std::shared_ptr<Sealed<ScriptKeyboard>> script;
+	std::shared_ptr<Screen> screen;
+	std::shared_ptr<Keyboard> keyboard;
+	try {
 
-// Editor thread
-// Takes:
-//   Message queue from Keyboard
-//   Message queue to Screen
-//   Shared state
-// Does:
-//   Exit if no longer running
-//   If input, read and interpret
-//   Else wait
-void editor_worker(
-	std::shared_ptr<Editor> editor,
-	std::shared_ptr<Channel<KeyEvent>> ch_in,
-	std::shared_ptr<Channel<ScreenCommand>> ch_out,
-	std::shared_ptr<State> state ) {
+		if( replay.empty( ) ) {
+			console = std::make_shared<Console>( );
+			screen = console;
+			keyboard = console;
+			if( !record.empty( ) )
+				keyboard = std::make_shared<RecordingKeyboard>( console, record );
+		} else {
+			virt = std::make_shared<Sealed<VirtualScreen>>( headlessCols, headlessRows );
+			screen = virt;
+			script = std::make_shared<Sealed<ScriptKeyboard>>( replay, realtime );
+			keyboard = script;
+		}
 
-	while( state->shouldRun( ) ) {
+		screen->init( );
 
-		while( ch_in->size( ) > 0 ) {
+	} catch( std::system_error & e ) {
+		printError( e, "Failed to initialize the Console!" );
+		return 1;
+	}
 
-			std::unique_ptr<KeyEvent> c = ch_in->pop( );
-			if( c->type == KeyEventType::KET_PRINT ) {
+	// Start with a piece tree-backed emacs, so a file can be edited straight off its mapping
+	std::shared_ptr<Sealed<Emacs<PieceTree>>> editor = std::make_shared<Sealed<Emacs<PieceTree>>>( );
+	editor->setDurability( durability );
 
-				KeyEventPrintable & prnt = std::get<KeyEventPrintable>( c->event );
+	if( !path.empty( ) ) {
+		try {
 
-				ch_out->push( ScreenCommand( std::format(
-					"{}{}{}",
-					prnt.ctrl ? 'C' : ' ',
-					prnt.alt ? 'A' : ' ',
-					prnt.ascii ),
-					0, 0, false ) );
+			std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>( path );
+			editor->load( file->data( ), file->size( ), file );
+			editor->watchFile( file );
 
+		} catch( std::system_error & e ) {
+			// A file that isn't there yet starts empty, and the first save creates it
+			if( e.code( ) != std::errc::no_such_file_or_directory ) {
+				printError( e, "Failed to open the file!" );
+				return 1;
 			}
-
 		}
 
-		// Sleep 5 ms
-		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
-
+		editor->setPath( path );
+		if( Highlighter::handles( path ) )
+			editor->setHighlighting( true );
 	}
 
-}
+	// Tell the editor how big the screen is before any keys arrive
+	std::pair<size_t, size_t> size = screen->getSize( );
+	KeyEvent initialSize( size.second, size.first );
 
+	// Single threaded replays -- No channels, just the per-key path
+	if( virt && pipeline != "threads" ) {
 
-int main( ) {
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now( );
 
-	// Create console object 
-	std::shared_ptr<WinConsole> console;
-	try {
-
-		console = std::make_shared<WinConsole>( );
-		console->init( );
-
-	} catch( std::system_error & e ) {
-		printError( e, "Failed to initialize the Console!" );
-	}
+		size_t events;
+		if( pipeline == "static" ) {
+			Pipeline<Sealed<ScriptKeyboard>, Sealed<Emacs<PieceTree>>, Sealed<VirtualScreen>> inlined( *script, *editor, *virt );
+			inlined.step( initialSize );
+			events = inlined.run( );
+		} else {
+			DynamicPipeline erased( *keyboard, *editor, *screen );
+			erased.step( initialSize );
+			events = erased.run( );
+		}
 
-	// Start with a line buffer-backed emacs
-	std::shared_ptr<Emacs<LineEditor>> editor = std::make_shared<Emacs<LineEditor>>( );
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - started;
 
+		std::cout << std::fixed << "Replayed " << events << " events in " << std::setprecision( 3 ) << elapsed.count( )
+			<< "s through the " << pipeline << " pipeline: " << std::setprecision( 0 ) << elapsed.count( ) * 1e9 / events << " ns/event" << std::endl;
+		printChecksum( virt->checksum( ) );
+		return 0;
 
-	// Make a state and a few channels
-	std::shared_ptr<State> state = std::make_shared<State>( );
+	}
 
+	// Make a few channels
 	std::shared_ptr<Channel<KeyEvent>> ch_keybrd = std::make_shared<Channel<KeyEvent>>( );
-	std::shared_ptr<Channel<ScreenCommand>> ch_screen = std::make_shared<Channel<ScreenCommand>>( );
+
+	// Batches go round in a loop, editor -> screen -> back empty -- Once they're all with the screen,
+	//   the editor keeps merging into the one it has until the screen catches up
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_screen = std::make_shared<Channel<std::unique_ptr<ScreenBatch>>>( batchPool );
+	std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free = std::make_shared<Channel<std::unique_ptr<ScreenBatch>>>( batchPool );
+	for( size_t batch = 0; batch < batchPool; ++batch )
+		ch_free->push( std::make_unique<ScreenBatch>( ) );
+
+	ch_keybrd->push( std::move( initialSize ) );
+
+	// Background work in the editor gets it polled by poking its key channel
+	// Its threads can outlive ours, so the channel goes with them
+	editor->setWake( [ ch_keybrd ]( ) { ch_keybrd->poke( ); } );
+
+	// Stopping wakes everybody up -- The channels and keyboard outlive the threads, so raw pointers are fine here
+	Channel<KeyEvent> * keys = ch_keybrd.get( );
+	Channel<std::unique_ptr<ScreenBatch>> * full = ch_screen.get( );
+	Channel<std::unique_ptr<ScreenBatch>> * empty = ch_free.get( );
+	Keyboard * kb = keyboard.get( );
+	state->onStop( [ keys, full, empty, kb ]( ) {
+		keys->close( );
+		full->close( );
+		empty->close( );
+		kb->interrupt( );
+	} );
+
+#ifndef _WIN32
+	// Block the stats signals before any threads start, so they all inherit the mask and only sigwait sees them
+	sigset_t statSignals;
+	sigemptyset( &statSignals );
+	sigaddset( &statSignals, SIGUSR1 );
+	sigaddset( &statSignals, SIGUSR2 );
+	std::thread stats_thread;
+	if( !stats.empty( ) ) {
+		pthread_sigmask( SIG_BLOCK, &statSignals, nullptr );
+		stats_thread = std::thread( stats_worker, statSignals, stats );
+	}
+#endif
 
 	// Start up some worker threads
-	std::thread input_thread( input_worker, console, ch_keybrd, state );
-	std::thread editor_thread( editor_worker, editor, ch_keybrd, ch_screen, state );
-	std::thread screen_thread( screen_worker, console, ch_screen, state );
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now( );
+
+	std::thread input_thread( input_worker, keyboard, ch_keybrd, state );
+	std::thread editor_thread( editor_worker, editor, ch_keybrd, ch_screen, ch_free, state );
+	std::thread screen_thread( screen_worker, screen, ch_screen, ch_free, state );
 
 	input_thread.join( );
+	editor_thread.join( );
 	screen_thread.join( );
 
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - started;
+
+#ifndef _WIN32
+	if( stats_thread.joinable( ) ) {
+		pthread_kill( stats_thread.native_handle( ), SIGUSR2 );
+		stats_thread.join( );
+	}
+#endif
+	if( !stats.empty( ) && !latencyDump( stats ) )
+		std::cerr << "Failed to write latency stats to " << stats << std::endl;
+
+	// Headless runs report throughput, and a checksum of the final screen to compare against
+	if( virt ) {
+		size_t events = script->eventCount( );
+		std::cout << std::fixed << "Replayed " << events << " events in " << std::setprecision( 3 ) << elapsed.count( )
+			<< "s: " << std::setprecision( 0 ) << events / elapsed.count( ) << " events/s" << std::endl;
+		std::cout << "Screen commands: " << virt->commandCount( ) << ", scrolls: " << virt->scrollCount( )
+			<< ", runs written: " << virt->runCount( ) << ", bytes written: " << virt->byteCount( ) << ", frames: " << virt->frameCount( ) << std::endl;
+		printChecksum( virt->checksum( ) );
+		std::cout << latencyReport( );
+		return 0;
+	}
+
+#ifndef _WIN32
+	size_t frames = console->frameCount( );
+	double perFrame = console->syscallsPerFrame( );
+#endif
+
+	// Drop the console first so the report lands on the normal screen
+	keyboard.reset( );
+	screen.reset( );
+	console.reset( );
+
+#ifndef _WIN32
+	std::cout << "Frames: " << frames << ", write syscalls per frame: " << std::fixed << std::setprecision( 2 ) << perFrame << std::endl;
+#endif
+	if( !path.empty( ) )
+		std::cout << "Open to first paint: "
+			<< std::chrono::duration_cast<std::chrono::microseconds>( state->firstPaint( ) ).count( ) << "us" << std::endl;
+	std::cout << latencyReport( );
+
 	return 0;
 
 }
\ No newline at end of file
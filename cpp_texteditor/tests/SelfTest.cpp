@@ -0,0 +1,402 @@
+// Checks that need the whole editor but no console, one per run, named on the command line -- The exit code says
+//   whether it passed, and what it measured is printed either way
+//   alloc          Heap allocations per typed key once warmed up, for both backends, on one thread and through
+//                    the worker threads and channels main runs them on
+//   decoder        Terminal input decodes to the same keys however it's split between reads
+//   decoder-speed  Terminal input decoded in bytes a second, for typing, cursor keys, UTF-8 and pastes
+//   channel-speed  Keys a second from one thread to another, through Channel and through the mutex queue it replaced
+#include "Emacs.h"
+#include "GapBuffer.h"
+#include "PieceTree.h"
+#include "VirtualScreen.h"
+#include "Pipeline.h"
+#include "VtDecoder.h"
+#include "ScriptKeyboard.h"
+#include "Workers.h"
+#include "OldChannel.h"
+
+#include <new>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+// Every allocation in the test goes through here, so it can be counted
+namespace {
+
+	std::atomic<size_t> allocations = 0;
+
+	void * counted( size_t size ) {
+		allocations.fetch_add( 1, std::memory_order_relaxed );
+		if( void * p = std::malloc( size ? size : 1 ) )
+			return p;
+		throw std::bad_alloc( );
+	};
+
+}
+
+void * operator new( size_t size ) { return counted( size ); }
+void * operator new[ ]( size_t size ) { return counted( size ); }
+void operator delete( void * p ) noexcept { std::free( p ); }
+void operator delete[ ]( void * p ) noexcept { std::free( p ); }
+void operator delete( void * p, size_t ) noexcept { std::free( p ); }
+void operator delete[ ]( void * p, size_t ) noexcept { std::free( p ); }
+
+namespace {
+
+	// Typing, the way a person does -- Words, a line break now and then, the odd typo taken back,
+	//   and a look up and down the file
+	KeyEvent typedKey( size_t n ) {
+
+		static const std::string words = "the quick brown fox jumps over the lazy dog ";
+		size_t at = n % ( words.length( ) * 2 + 4 );
+
+		if( at < words.length( ) )
+			return KeyEvent( words[ at ] );
+		if( at == words.length( ) )
+			return KeyEvent( KeyEventControl::CK_BKSPC );
+		if( at == words.length( ) + 1 )
+			return KeyEvent( KeyEventControl::CK_UP );
+		if( at == words.length( ) + 2 )
+			return KeyEvent( KeyEventControl::CK_DOWN );
+		if( at == words.length( ) + 3 )
+			return KeyEvent( '\n' );
+		return KeyEvent( words[ at - words.length( ) - 4 ] );
+
+	};
+
+	// What the keys are typed into
+	std::string typedText( ) {
+		std::string text;
+		for( size_t line = 0; line < 1000; ++line )
+			text += "Line " + std::to_string( line ) + " of the text being typed into\n";
+		return text;
+	};
+
+	constexpr size_t warmup = 100000;
+	constexpr size_t measured = 1000000;
+
+	// Keys through the editor and onto a headless screen, the single threaded replay path -- Allocations while
+	//   the measured keys go through, after enough have gone through first for every buffer to have grown
+	// Storage still grows as the text does, geometrically or a block at a time, so it's allocations a key
+	//   that have to round to zero rather than the count
+	template<typename B>
+	bool typingAllocations( const char * name ) {
+
+		Sealed<Emacs<B>> editor;
+		Sealed<VirtualScreen> screen( 80, 24 );
+		ScreenBatch batch;
+		screen.init( );
+
+		std::string text = typedText( );
+		editor.insert( 0, text.data( ), text.length( ) );
+
+		KeyEvent size( (size_t)80, (size_t)24 );
+		editor.consumeKey( size, batch );
+
+		size_t before = 0;
+		for( size_t n = 0; n < warmup + measured; ++n ) {
+
+			if( n == warmup )
+				before = allocations.load( std::memory_order_relaxed );
+
+			KeyEvent key = typedKey( n );
+			editor.consumeKey( key, batch );
+			editor.poll( batch );
+			for( ScreenCommand & sc : batch.commands( ) )
+				screen.consumeCommand( sc );
+			screen.flush( );
+			batch.clear( );
+
+		}
+
+		size_t count = allocations.load( std::memory_order_relaxed ) - before;
+		std::cout << name << ": " << count << " allocations over " << measured << " keys" << std::endl;
+
+		// Fewer than one in ten thousand keys
+		return count * 10000 < measured;
+
+	};
+
+	// The typed keys as a keyboard, noting the count when the warm-up is over
+	class TypedKeyboard : public Keyboard {
+
+		size_t n = 0;
+		std::atomic<bool> interrupted = false;
+
+	protected:
+
+		KeyEvent doReadKey( ) {
+			if( n == warmup )
+				before = allocations.load( std::memory_order_relaxed );
+			return typedKey( n++ );
+		};
+
+		bool doKeysReady( ) { return n < warmup + measured; };
+		bool doWaitKeys( ) { return doKeysReady( ) && !interrupted.load( std::memory_order_acquire ); };
+		void doInterrupt( ) { interrupted.store( true, std::memory_order_release ); };
+
+	public:
+
+		size_t before = 0;
+
+	};
+
+	// The same keys through the worker threads, set up as main does -- Adds the channels and the batch pool
+	//   to what's counted, and the keys now arrive in runs rather than one at a time
+	template<typename B>
+	bool threadedAllocations( const char * name ) {
+
+		std::shared_ptr<TypedKeyboard> keyboard = std::make_shared<TypedKeyboard>( );
+		std::shared_ptr<Sealed<Emacs<B>>> editor = std::make_shared<Sealed<Emacs<B>>>( );
+		std::shared_ptr<Sealed<VirtualScreen>> screen = std::make_shared<Sealed<VirtualScreen>>( 80, 24 );
+		std::shared_ptr<State> state = std::make_shared<State>( );
+		screen->init( );
+
+		std::string text = typedText( );
+		editor->insert( 0, text.data( ), text.length( ) );
+
+		std::shared_ptr<Channel<KeyEvent>> ch_keybrd = std::make_shared<Channel<KeyEvent>>( );
+		std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_screen = std::make_shared<Channel<std::unique_ptr<ScreenBatch>>>( batchPool );
+		std::shared_ptr<Channel<std::unique_ptr<ScreenBatch>>> ch_free = std::make_shared<Channel<std::unique_ptr<ScreenBatch>>>( batchPool );
+		for( size_t i = 0; i < batchPool; ++i )
+			ch_free->push( std::make_unique<ScreenBatch>( ) );
+		KeyEvent initialSize( (size_t)80, (size_t)24 );
+		ch_keybrd->push( std::move( initialSize ) );
+
+		std::thread input_thread( input_worker, keyboard, ch_keybrd, state );
+		std::thread editor_thread( editor_worker, editor, ch_keybrd, ch_screen, ch_free, state );
+		std::thread screen_thread( screen_worker, screen, ch_screen, ch_free, state );
+
+		input_thread.join( );
+		editor_thread.join( );
+		screen_thread.join( );
+
+		size_t count = allocations.load( std::memory_order_relaxed ) - keyboard->before;
+		std::cout << name << ", threaded: " << count << " allocations over " << measured << " keys" << std::endl;
+
+		return count * 10000 < measured;
+
+	};
+
+	// Terminal input, mostly things a terminal really sends, some of it cut short or not quite right, and some noise
+	std::string terminalBytes( std::mt19937 & rng, size_t len ) {
+
+		static const char * const pieces[ ] = {
+			"\x1b[A", "\x1b[B", "\x1b[C", "\x1b[D", "\x1bOA", "\x1bOP", "\x1b[1;5C", "\x1b[1;2D", "\x1b[3~", "\x1b[5;3~",
+			"\x1b[15~", "\x1b[24~", "\x1b[Z", "\x1bOM", "\x1bx", "\x1b\x1b", "\x1b[99q", "\x1b[?1;2c", "\x1b[1;5", "\x1b[",
+			"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xe2\x82", "\xff", "\r\n", "\x7f", "\x01", "\t",
+			"\x1b[200~", "\x1b[201~", "\x1b[201", "\r", "\n",
+		};
+
+		std::string out;
+		while( out.length( ) < len ) {
+			switch( rng( ) % 4 ) {
+			case 0:
+				out += pieces[ rng( ) % std::size( pieces ) ];
+				break;
+			case 1:
+				out += (char)( rng( ) % 256 );
+				break;
+			default:
+				out += (char)( ' ' + rng( ) % 95 );
+				break;
+			}
+		}
+		return out;
+
+	};
+
+	// Every key decoded from bytes, in one call or a read at a time -- Keys come out as trace lines to compare
+	std::vector<std::string> decodeAll( const std::string & bytes, const std::vector<size_t> & cuts ) {
+
+		VtDecoder decoder;
+		std::vector<KeyEvent> keys;
+		std::string pending;
+		size_t from = 0;
+
+		for( size_t cut : cuts ) {
+			pending.append( bytes, from, cut - from );
+			from = cut;
+			pending.erase( 0, decoder.decode( pending.data( ), pending.length( ), keys ) );
+		}
+		pending.append( bytes, from, std::string::npos );
+		decoder.decode( pending.data( ), pending.length( ), keys, true );
+
+		std::vector<std::string> lines;
+		for( KeyEvent & key : keys )
+			lines.push_back( formatTraceLine( { 0, key } ) );
+		return lines;
+
+	};
+
+	// However the bytes are split between reads, the same keys come out as when they all arrive at once
+	bool decoderSplits( ) {
+
+		std::mt19937 rng( 1 );
+		size_t keys = 0;
+
+		for( size_t round = 0; round < 2000; ++round ) {
+
+			std::string bytes = terminalBytes( rng, 1 + rng( ) % 512 );
+
+			// Cut anywhere, down to a byte at a time
+			std::vector<size_t> cuts;
+			for( size_t at = 0; at < bytes.length( ); at += 1 + rng( ) % ( round % 2 ? 4 : 64 ) )
+				cuts.push_back( at );
+
+			std::vector<std::string> whole = decodeAll( bytes, { } );
+			std::vector<std::string> split = decodeAll( bytes, cuts );
+			keys += whole.size( );
+
+			if( whole != split ) {
+				std::cout << "Decoder: round " << round << " decoded " << whole.size( ) << " keys whole but " << split.size( )
+					<< " split into " << cuts.size( ) << " reads" << std::endl;
+				return false;
+			}
+
+		}
+
+		std::cout << "Decoder: 2000 inputs, " << keys << " keys, the same however they were split" << std::endl;
+		return true;
+
+	};
+
+	// Bytes decoded a second, for what a terminal sends fastest -- Anything a person types is nowhere near,
+	//   but a paste or a held key arrives as fast as the terminal can write it, and has to be read faster still
+	bool decoderSpeed( ) {
+
+		constexpr size_t size = 16 << 20;
+
+		std::string typing, arrows, utf8, paste = "\x1b[200~";
+		while( typing.length( ) < size )
+			typing += "the quick brown fox jumps over the lazy dog\r";
+		while( arrows.length( ) < size )
+			arrows += "\x1b[B\x1b[1;5C";
+		while( utf8.length( ) < size )
+			utf8 += "na\xc3\xafve caf\xc3\xa9 \xe2\x82\xac" "5 \xf0\x9f\x98\x80\n";
+		while( paste.length( ) < size )
+			paste += "pasted line of text\r\n";
+		paste += "\x1b[201~";
+
+		// A full 64KiB read every 4ms, well beyond what a terminal writes to us, so falling below it is a regression
+		constexpr double floor = 16.0 * 1024 * 1024;
+		bool fast = true;
+
+		std::vector<KeyEvent> keys;
+		keys.reserve( size );
+		for( auto [ name, bytes ] : { std::pair<const char *, std::string *>{ "typing", &typing }, { "arrows", &arrows }, { "UTF-8", &utf8 }, { "paste", &paste } } ) {
+
+			VtDecoder decoder;
+			size_t decoded = 0;
+			auto started = std::chrono::steady_clock::now( );
+
+			// A read at a time, the way the terminal hands it over
+			for( size_t at = 0; at < bytes->length( ); ) {
+				size_t len = std::min<size_t>( 65536, bytes->length( ) - at );
+				at += decoder.decode( bytes->data( ) + at, len, keys, at + len == bytes->length( ) );
+				decoded += keys.size( );
+				keys.clear( );
+			}
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - started;
+			double rate = bytes->length( ) / elapsed.count( );
+			std::cout << "Decoder " << name << ": " << std::fixed << std::setprecision( 1 ) << rate / ( 1 << 20 ) << " MiB/s, "
+				<< decoded << " keys" << std::endl;
+			fast &= rate > floor;
+
+		}
+
+		return fast;
+
+	};
+
+	// Keys a second from one thread to another -- The ring is pushed a key at a time and drained with pop_n, the old
+	//   queue is drained the way the workers used to, size( ) then pop( ) until it's empty
+	bool channelSpeed( ) {
+
+		constexpr size_t count = 4000000;
+
+		auto rate = []( std::chrono::steady_clock::duration took ) {
+			return count / std::chrono::duration<double>( took ).count( );
+		};
+
+		// Timed from starting the producer to the consumer having every key
+		auto started = std::chrono::steady_clock::now( );
+		Channel<KeyEvent> ring;
+		std::thread ringProducer( [ &ring ]( ) {
+			for( size_t n = 0; n < count; ++n )
+				ring.push( typedKey( n ) );
+			ring.close( );
+		} );
+		std::vector<KeyEvent> keys;
+		size_t received = 0;
+		while( ring.wait( ) ) {
+			keys.clear( );
+			received += ring.pop_n( keys );
+		}
+		ringProducer.join( );
+		double ringRate = rate( std::chrono::steady_clock::now( ) - started );
+
+		if( received != count ) {
+			std::cout << "Channel: " << received << " of " << count << " keys came through" << std::endl;
+			return false;
+		}
+
+		// Without the 5ms sleep the workers took between drains, which would only measure the sleep
+		started = std::chrono::steady_clock::now( );
+		OldChannel<KeyEvent> queue;
+		std::thread queueProducer( [ &queue ]( ) {
+			for( size_t n = 0; n < count; ++n )
+				queue.push( typedKey( n ) );
+		} );
+		received = 0;
+		while( received < count ) {
+			while( queue.size( ) > 0 ) {
+				std::unique_ptr<KeyEvent> key = queue.pop( );
+				++received;
+			}
+			std::this_thread::yield( );
+		}
+		queueProducer.join( );
+		double queueRate = rate( std::chrono::steady_clock::now( ) - started );
+
+		std::cout << std::fixed << std::setprecision( 1 )
+			<< "Channel: " << ringRate / 1e6 << "M keys/s, mutex queue: " << queueRate / 1e6 << "M keys/s, "
+			<< ringRate / queueRate << "x" << std::endl;
+
+		// Both share the machine with whatever else is running, so only insist the ring isn't the slower one
+		return ringRate >= queueRate;
+
+	};
+
+}
+
+int main( int argc, char ** argv ) {
+
+	std::string name = argc > 1 ? argv[ 1 ] : "";
+
+	if( name == "alloc" ) {
+		bool gap = typingAllocations<GapBuffer>( "Gap buffer" );
+		bool piece = typingAllocations<PieceTree>( "Piece tree" );
+		bool gapThreaded = threadedAllocations<GapBuffer>( "Gap buffer" );
+		bool pieceThreaded = threadedAllocations<PieceTree>( "Piece tree" );
+		return gap && piece && gapThreaded && pieceThreaded ? 0 : 1;
+	}
+
+	if( name == "decoder" )
+		return decoderSplits( ) ? 0 : 1;
+
+	if( name == "decoder-speed" )
+		return decoderSpeed( ) ? 0 : 1;
+
+	if( name == "channel-speed" )
+		return channelSpeed( ) ? 0 : 1;
+
+	std::cerr << "Usage: selftest alloc | decoder | decoder-speed | channel-speed" << std::endl;
+	return 2;
+
+}